@@ -88,10 +88,11 @@ protected:
 
 struct PosesLink
 {
-    PosesLink(int srcIndex=-1, int dstIndex=-1, const cv::Mat& Rt=cv::Mat());
+    PosesLink(int srcIndex=-1, int dstIndex=-1, const cv::Mat& Rt=cv::Mat(), const cv::Mat& information=cv::Mat());
     int srcIndex;
     int dstIndex;
     cv::Mat Rt; // optional (for loop closure)
+    cv::Mat information; // optional 6x6 information matrix of Rt (as cv::OdometryStats::information)
 };
 
 struct TrajectoryFrames
@@ -160,6 +161,8 @@ protected:
     cv::Ptr<cv::RgbdNormals> normalsComputer; // inner only
     cv::Ptr<TableMasker> tableMasker;
     cv::Ptr<cv::Odometry> odometry;
+    cv::Ptr<cv::MotionModel> motionModel; // predicts initial Rt of the frame to frame odometry
+    cv::OdometryWorkspace odometryWorkspace; // the odometry buffers reused by the frames
 
     // output keyframes data
     cv::Ptr<TrajectoryFrames> trajectoryFrames;
@@ -191,6 +194,7 @@ protected:
     cv::Mat closureBgrImage;
     cv::Mat closureObjectMask;
     cv::Mat closurePose, closurePoseWithFirst;
+    cv::Mat closureInformation; // of closurePoseWithFirst
 
     bool isInitialied, isFinalized;
 };
@@ -318,6 +322,7 @@ protected:
     cv::Mat prevTableMask;
     std::vector<cv::Ptr<TrajectorySegment> > trajectorySegments;
     std::vector<Feature2dEdge> feature2dEdges;
+    cv::OdometryWorkspace odometryWorkspace; // the odometry buffers reused by the frames
 
     bool isInitialied, isFinalized;
 };
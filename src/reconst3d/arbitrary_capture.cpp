@@ -96,6 +96,7 @@ void ArbitraryCaptureServer::reset()
     prevTableMask.release();
     trajectorySegments.clear();
     feature2dEdges.clear();
+    odometryWorkspace.release();
 
     isFinalized = false;
 }
@@ -125,8 +126,12 @@ void ArbitraryCaptureServer::estimateFeatures2dEdges(int srcSegmentIndex, int sr
         int representFrameIndex = trajectorySegments[segmentIndex]->representFrameIndex;
         const vector<KeyPoint>& dstKeypoints = trajectorySegments[segmentIndex]->representFrameKeypoints;
         const Mat& dstDescriptors = trajectorySegments[segmentIndex]->representFrameDescriptors;
-        Mat dstCloud;// = trajectorySegments[segmentIndex]->frames[representFrameIndex]->pyramidCloud[0];
-        depthTo3d(trajectorySegments[segmentIndex]->frames[representFrameIndex]->depth, cameraMatrix, dstCloud);
+        const Ptr<OdometryFrame>& dstFrame = trajectorySegments[segmentIndex]->frames[representFrameIndex];
+        Mat dstCloud;
+        if(!dstFrame->pyramidCloud.empty() && !dstFrame->pyramidCloud[0].empty())
+            dstCloud = dstFrame->pyramidCloud[0];
+        else
+            depthTo3d(dstFrame->depth, cameraMatrix, dstCloud);
 
         vector<DMatch> matches;
         cv::Mat Rt = (*feature2dPoseEstimator)(srcKeypoints, srcDescriptors, srcCloud,
@@ -370,6 +375,8 @@ ArbitraryCaptureServer::FramePushOutput ArbitraryCaptureServer::push(const cv::M
 
     Mat pose;
     Ptr<OdometryFrame> currFrame = new OdometryFrame(grayImage, depth, tableMask | objectMask, normals, frameID);
+    // the cloud is computed from the same depth, so the odometry will build only the coarser levels
+    currFrame->pyramidCloud.push_back(cloud);
     if(trajectorySegments.empty())
     {
         // it's just a beginning of the trajectory construction
@@ -388,7 +395,7 @@ ArbitraryCaptureServer::FramePushOutput ArbitraryCaptureServer::push(const cv::M
             // we continue active segment construction
             Ptr<TrajectorySegment> segment = getActiveSegment();
             Mat Rt;
-            bool isOdometryOk = odometry->compute(currFrame, segment->lastFrame, Rt);
+            bool isOdometryOk = odometry->compute(currFrame, segment->lastFrame, Rt, Mat(), odometryWorkspace);
             if(!isOdometryOk)
             {
                 // we stop to construct the segment
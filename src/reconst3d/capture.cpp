@@ -7,6 +7,8 @@
 #include <opencv_candidate_reconst3d/reconst3d.hpp>
 #include <iomanip>
 
+#include "graph_optimizations.hpp"
+
 using namespace std;
 using namespace cv;
 
@@ -14,22 +16,6 @@ const char checkDataMessage[] = "Please check the data! Sequential frames have t
                                 "The first and one of the last frames also have to be "
                                 "really taken from close camera positions and the close lighting conditions.";
 
-// get norms
-//
-static inline
-float tvecNorm(const Mat& Rt)
-{
-    return norm(Rt(Rect(3,0,1,3)));
-}
-
-static inline
-float rvecNormDegrees(const Mat& Rt)
-{
-    Mat rvec;
-    Rodrigues(Rt(Rect(0,0,3,3)), rvec);
-    return norm(rvec) * 180. / CV_PI;
-}
-
 //
 static
 float computeInliersRatio(const Ptr<OdometryFrame>& srcFrame,
@@ -51,8 +37,8 @@ float computeInliersRatio(const Ptr<OdometryFrame>& srcFrame,
 }
 
 //---------------------------------------------------------------------------------------------------------------------------
-PosesLink::PosesLink(int srcIndex, int dstIndex, const Mat& Rt)
-    : srcIndex(srcIndex), dstIndex(dstIndex), Rt(Rt)
+PosesLink::PosesLink(int srcIndex, int dstIndex, const Mat& Rt, const Mat& information)
+    : srcIndex(srcIndex), dstIndex(dstIndex), Rt(Rt), information(information)
 {}
 
 void TrajectoryFrames::push(const Ptr<RgbdFrame>& frame, const Mat& pose, const Mat& objectMask, int state)
@@ -115,6 +101,7 @@ void TrajectoryFrames::save(const std::string& dirname) const
         fs << "srcIndex" << link.srcIndex;
         fs << "dstIndex" << link.dstIndex;
         fs << "Rt" << link.Rt;
+        fs << "information" << link.information;
         fs << "}";
     }
     fs << "]";
@@ -185,13 +172,14 @@ void TrajectoryFrames::load(const std::string& dirname)
     for(; fnIt != fnEnd; ++fnIt)
     {
         int srcIndex = -1, dstIndex = -1;
-        Mat Rt;
+        Mat Rt, information;
         (*fnIt)["srcIndex"] >> srcIndex;
         (*fnIt)["dstIndex"] >> dstIndex;
         (*fnIt)["Rt"] >> Rt;
+        (*fnIt)["information"] >> information;
         CV_Assert(srcIndex >= 0);
         CV_Assert(dstIndex >= 0);
-        keyframePosesLinks.push_back(PosesLink(srcIndex, dstIndex, Rt));
+        keyframePosesLinks.push_back(PosesLink(srcIndex, dstIndex, Rt, information));
     }
 }
 
@@ -298,11 +286,15 @@ Ptr<CircularCaptureServer::FramePushOutput> CircularCaptureServer::push(const Ma
         {
             Mat Rt;
             cout << "odometry " << frameID << " -> " << prevFrameID << endl;
-            if(odometry->compute(currFrame, prevFrame, Rt) && computeInliersRatio(currFrame, prevFrame, Rt, cameraMatrix, maxCorrespColorDiff,
-                                                                                  maxCorrespDepthDiff) >= minInliersRatio)
+            // the motion model is updated here only, the loop closure odometry does not change it
+            if(odometry->compute(currFrame, prevFrame, Rt, motionModel->predict(), odometryWorkspace) &&
+               computeInliersRatio(currFrame, prevFrame, Rt, cameraMatrix, maxCorrespColorDiff, maxCorrespDepthDiff) >= minInliersRatio)
             {
                 pushOutput->frameState |= TrajectoryFrames::VALIDFRAME;
+                motionModel->update(Rt);
             }
+            else
+                motionModel->reset();
 
             pushOutput->pose = prevPose * Rt;
             if((pushOutput->frameState & TrajectoryFrames::VALIDFRAME) != TrajectoryFrames::VALIDFRAME)
@@ -350,7 +342,8 @@ Ptr<CircularCaptureServer::FramePushOutput> CircularCaptureServer::push(const Ma
         if(translationSum > skippedTranslation) // ready for closure
         {
             Mat Rt;
-            if(odometry->compute(currFrame, firstKeyframe, Rt))
+            OdometryStats stats;
+            if(odometry->compute(currFrame, firstKeyframe, Rt, Mat(), odometryWorkspace, &stats))
             {
                 // we check inliers ratio for the loop closure frames because we didn't do this before
                 float inliersRatio = computeInliersRatio(currFrame, firstKeyframe, Rt, cameraMatrix, maxCorrespColorDiff, maxCorrespDepthDiff);
@@ -363,6 +356,7 @@ Ptr<CircularCaptureServer::FramePushOutput> CircularCaptureServer::push(const Ma
                         closureFrame = currFrame;
                         closureFrameID = frameID;
                         closurePoseWithFirst = Rt;
+                        closureInformation = stats.information;
                         closurePose = pushOutput->pose;
                         closureObjectMask = pushOutput->objectMask;
                         closureBgrImage = _image;
@@ -413,6 +407,10 @@ void CircularCaptureServer::reset()
     prevPose.release();
     prevFrameID = -1;
 
+    if(!motionModel.empty())
+        motionModel->reset();
+    odometryWorkspace.release();
+
     isTrajectoryBroken = false;
     isLoopClosing = false;
     isLoopClosed = false;
@@ -425,6 +423,7 @@ void CircularCaptureServer::reset()
     closureObjectMask.release();
     closurePose.release();
     closurePoseWithFirst.release();
+    closureInformation.release();
 
     isFinalized = false;
 }
@@ -450,6 +449,9 @@ void CircularCaptureServer::initialize(const Size& frameResolution, int storeFra
         odometry = new RgbdOdometry();
     odometry->set("cameraMatrix", cameraMatrix);
 
+    if(motionModel.empty())
+        motionModel = new ConstantVelocityModel();
+
     isInitialied = true;
 }
 
@@ -526,7 +528,8 @@ Ptr<TrajectoryFrames> CircularCaptureServer::finalize()
     CV_Assert((trajectoryFrames->frameStates[trajectoryFrames->frameStates.size()-1] & TrajectoryFrames::KEYFRAME) == TrajectoryFrames::KEYFRAME);
 
     if(!closureFrame.empty())
-        trajectoryFrames->keyframePosesLinks.push_back(PosesLink(0, trajectoryFrames->poses.size()-1, closurePoseWithFirst.inv(DECOMP_SVD)));
+        trajectoryFrames->keyframePosesLinks.push_back(PosesLink(0, trajectoryFrames->poses.size()-1, closurePoseWithFirst.inv(DECOMP_SVD),
+                                                                 invertedTransformInformation(closurePoseWithFirst, closureInformation)));
 
     isFinalized = true;
 
@@ -153,6 +153,17 @@ g2o::SparseOptimizer* createOptimizer(g2o::OptimizationAlgorithm* solver)
     return optimizer;
 }
 
+// information matrices
+//
+// The information matrix of the g2o::EdgeSE3 measurement Rt01.inv() for the given one of Rt01 (see PosesLink).
+Eigen::Matrix<double,6,6> informationMatrixSE3(const cv::Mat& information);
+
+// The same scaled to the determinant of the constant information of the edges without the odometry one.
+Eigen::Matrix<double,6,6> normalizedInformationMatrixSE3(const cv::Mat& information);
+
+// The information matrix of Rt.inv() for the given one of Rt.
+cv::Mat invertedTransformInformation(const cv::Mat& Rt, const cv::Mat& information);
+
 // graph opt
 
 // Restore refined camera poses from the graph.
@@ -38,8 +38,76 @@ Eigen::Matrix<double,6,6> informationMatrixSE3()
     return informationMatrix;
 }
 
+/*
+ * The information matrix of the edge measurement Rt01.inv() for the given one of Rt01 (as in PosesLink, for the left
+ * increment exp(ksi) * Rt01 with the rotation vector and then the translation in ksi). The inverse of the increment
+ * is Rt01.inv() * exp(-ksi), so ksi is the right increment of the measurement, that's the error of g2o::EdgeSE3:
+ * the translation and then the vector part of the quaternion (a half of the rotation vector).
+ */
+Eigen::Matrix<double,6,6> informationMatrixSE3(const Mat& information)
+{
+    CV_Assert(information.size() == Size(6,6) && information.type() == CV_64FC1);
+
+    Eigen::Matrix<double,6,6> ksiInformation;
+    cv2eigen(information, ksiInformation);
+
+    Eigen::Matrix<double,6,6> informationMatrix;
+    informationMatrix.block<3,3>(0,0) = ksiInformation.block<3,3>(3,3);
+    informationMatrix.block<3,3>(0,3) = 2 * ksiInformation.block<3,3>(3,0);
+    informationMatrix.block<3,3>(3,0) = 2 * ksiInformation.block<3,3>(0,3);
+    informationMatrix.block<3,3>(3,3) = 4 * ksiInformation.block<3,3>(0,0);
+
+    return informationMatrix;
+}
+
+/*
+ * The odometry information treats its correspondences as independent, so it grows with their count and its scale
+ * is not comparable with the constant informationMatrixSE3() of the edges without it. Only its shape (the relative
+ * uncertainty of the directions) is kept: it's scaled to the determinant of the constant one.
+ */
+Eigen::Matrix<double,6,6> normalizedInformationMatrixSE3(const Mat& information)
+{
+    Eigen::Matrix<double,6,6> informationMatrix = informationMatrixSE3(information);
+
+    const double det = informationMatrix.determinant();
+    if(!(det > DBL_EPSILON) || cvIsInf(det))
+        return informationMatrixSE3();
+
+    return informationMatrix * std::pow(informationMatrixSE3().determinant() / det, 1./6);
+}
+
+/*
+ * The information matrix of Rt.inv() for the given one of Rt (both are for the left increment exp(ksi) * Rt,
+ * ksi is the rotation vector and then the translation): the inverse of exp(ksi) * Rt is exp(-Ad(Rt^-1) ksi) * Rt^-1,
+ * so the information is transformed by the adjoint of Rt.
+ */
+Mat invertedTransformInformation(const Mat& Rt, const Mat& information)
+{
+    if(information.empty())
+        return Mat();
+
+    CV_Assert(information.size() == Size(6,6) && information.type() == CV_64FC1);
+
+    Mat R = Rt(Rect(0,0,3,3)), t = Rt(Rect(3,0,1,3));
+    Mat tx = (Mat_<double>(3,3) <<             0, -t.at<double>(2),  t.at<double>(1),
+                                   t.at<double>(2),                0, -t.at<double>(0),
+                                  -t.at<double>(1),  t.at<double>(0),                0);
+
+    // the adjoint for the rotation then the translation: [R 0; [t]x*R R]
+    Mat adjoint = Mat::zeros(6, 6, CV_64FC1), dst;
+    dst = adjoint(Rect(0,0,3,3));
+    R.copyTo(dst);
+    dst = adjoint(Rect(3,3,3,3));
+    R.copyTo(dst);
+    dst = adjoint(Rect(0,3,3,3));
+    Mat(tx * R).copyTo(dst);
+
+    return adjoint.t() * information * adjoint;
+}
+
 static
-g2o::EdgeSE3* createEdgeSE3(g2o::HyperGraph::Vertex* v0, g2o::HyperGraph::Vertex* v1, const Mat& Rt01)
+g2o::EdgeSE3* createEdgeSE3(g2o::HyperGraph::Vertex* v0, g2o::HyperGraph::Vertex* v1, const Mat& Rt01,
+                            const Mat& information = Mat())
 {
     g2o::EdgeSE3* g2o_edge = new g2o::EdgeSE3;
 
@@ -47,7 +115,7 @@ g2o::EdgeSE3* createEdgeSE3(g2o::HyperGraph::Vertex* v0, g2o::HyperGraph::Vertex
     g2o_edge->vertices()[1] = v1;
 
     g2o_edge->setMeasurement(cv2G2O(Rt01.inv(DECOMP_SVD)));
-    g2o_edge->setInformation(informationMatrixSE3());
+    g2o_edge->setInformation(information.empty() ? informationMatrixSE3() : normalizedInformationMatrixSE3(information));
 
     g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
     g2o_edge->setRobustKernel(rk);
@@ -89,8 +157,11 @@ void fillGraphSE3(g2o::SparseOptimizer* optimizer,
             frameIndices.push_back(dstVertexIndex);
 
         // add edge between the vertices
-        Mat Rt = posesLinks[edgeIndex].Rt.empty() ? poses[dstVertexIndex].inv(DECOMP_SVD) * poses[srcVertexIndex] : posesLinks[edgeIndex].Rt;
-        optimizer->addEdge(createEdgeSE3(optimizer->vertex(srcVertexIndex), optimizer->vertex(dstVertexIndex), Rt));
+        // the information matrix is given for the link Rt only
+        const PosesLink& link = posesLinks[edgeIndex];
+        Mat Rt = link.Rt.empty() ? poses[dstVertexIndex].inv(DECOMP_SVD) * poses[srcVertexIndex] : link.Rt;
+        Mat information = link.Rt.empty() ? Mat() : link.information;
+        optimizer->addEdge(createEdgeSE3(optimizer->vertex(srcVertexIndex), optimizer->vertex(dstVertexIndex), Rt, information));
     }
 
     int fixedVertexIndex = posesLinks[0].dstIndex;
@@ -43,6 +43,7 @@ CV_INIT_ALGORITHM_FIX(TableMasker, "ModelCapture.TableMasker",
 CV_INIT_ALGORITHM_FIX(CircularCaptureServer, "ModelCapture.CircularCaptureServer",
     obj.info()->addParam(obj, "tableMasker", obj.tableMasker);
     obj.info()->addParam(obj, "odometry", obj.odometry);
+    obj.info()->addParam(obj, "motionModel", obj.motionModel);
     obj.info()->addParam(obj, "cameraMatrix", obj.cameraMatrix);
     obj.info()->addParam(obj, "maxCorrespColorDiff", obj.maxCorrespColorDiff);
     obj.info()->addParam(obj, "maxCorrespDepthDiff", obj.maxCorrespDepthDiff);
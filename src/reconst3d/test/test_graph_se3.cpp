@@ -0,0 +1,192 @@
+#include "test_precomp.hpp"
+
+using namespace cv;
+
+// The increment exp(ksi) for ksi with the rotation vector and then the translation (as in the odometry)
+static
+Mat expSE3(const Mat& ksi)
+{
+    Mat Rt = Mat::eye(4, 4, CV_64FC1), dst;
+    dst = Rt(Rect(0,0,3,3));
+    Rodrigues(ksi.rowRange(0,3), dst);
+    dst = Rt(Rect(3,0,1,3));
+    ksi.rowRange(3,6).copyTo(dst);
+    return Rt;
+}
+
+static
+Mat logSE3(const Mat& Rt)
+{
+    Mat ksi(6, 1, CV_64FC1), dst;
+    dst = ksi.rowRange(0,3);
+    Rodrigues(Rt(Rect(0,0,3,3)), dst);
+    dst = ksi.rowRange(3,6);
+    Rt(Rect(3,0,1,3)).copyTo(dst);
+    return ksi;
+}
+
+// The error vector of g2o::EdgeSE3: the translation and then the vector part of the quaternion
+static
+Mat errorSE3(const Mat& Rt)
+{
+    Mat rvec;
+    Rodrigues(Rt(Rect(0,0,3,3)), rvec);
+    double angle = norm(rvec);
+
+    Mat error(6, 1, CV_64FC1), dst;
+    dst = error.rowRange(0,3);
+    Rt(Rect(3,0,1,3)).copyTo(dst);
+    dst = error.rowRange(3,6);
+    Mat(angle > DBL_EPSILON ? rvec * (std::sin(0.5 * angle) / angle) : 0.5 * rvec).copyTo(dst);
+    return error;
+}
+
+static
+Mat randomRigidTransform(RNG& rng)
+{
+    Mat ksi(6, 1, CV_64FC1);
+    rng.fill(ksi, RNG::UNIFORM, -0.5, 0.5);
+    return expSE3(ksi);
+}
+
+static
+Mat randomInformation(RNG& rng)
+{
+    Mat A(6, 6, CV_64FC1);
+    rng.fill(A, RNG::UNIFORM, -1, 1);
+    return A.t() * A + Mat::eye(6, 6, CV_64FC1);
+}
+
+class IncrementFunction
+{
+public:
+    virtual ~IncrementFunction() {}
+    virtual Mat operator()(const Mat& ksi) const = 0;
+};
+
+/*
+ * Propagates the covariance of the left increment ksi of Rt (the inverse of the information) to the given function
+ * of the increment by its numerical Jacobian at zero and returns the propagated information.
+ */
+static
+Mat propagateInformation(const IncrementFunction& f, const Mat& information)
+{
+    const double h = 1e-6;
+    Mat J(6, 6, CV_64FC1);
+    for(int i = 0; i < 6; i++)
+    {
+        Mat ksi = Mat::zeros(6, 1, CV_64FC1);
+        ksi.at<double>(i) = h;
+        Mat column = (f(ksi) - f(-ksi)) / (2 * h), dst = J.col(i);
+        column.copyTo(dst);
+    }
+    return (J * information.inv(DECOMP_SVD) * J.t()).inv(DECOMP_SVD);
+}
+
+// The g2o::EdgeSE3 error of the measurement Rt01.inv() when Rt01 is perturbed by the left increment
+class EdgeErrorFunction : public IncrementFunction
+{
+public:
+    EdgeErrorFunction(const Mat& Rt01) : Rt01(Rt01) {}
+    virtual Mat operator()(const Mat& ksi) const
+    {
+        Mat measurement = Rt01.inv(DECOMP_SVD), perturbedMeasurement = (expSE3(ksi) * Rt01).inv(DECOMP_SVD);
+        return errorSE3(perturbedMeasurement.inv(DECOMP_SVD) * measurement);
+    }
+private:
+    Mat Rt01;
+};
+
+// The left increment of Rt.inv() when Rt is perturbed by the left increment
+class InverseIncrementFunction : public IncrementFunction
+{
+public:
+    InverseIncrementFunction(const Mat& Rt) : Rt(Rt) {}
+    virtual Mat operator()(const Mat& ksi) const
+    {
+        return logSE3((expSE3(ksi) * Rt).inv(DECOMP_SVD) * Rt);
+    }
+private:
+    Mat Rt;
+};
+
+static
+double relativeDiff(const Mat& m0, const Mat& m1)
+{
+    return norm(m0, m1) / norm(m1);
+}
+
+class CV_InformationMatrixSE3Test : public cvtest::BaseTest
+{
+public:
+    CV_InformationMatrixSE3Test() {}
+protected:
+    virtual void run(int)
+    {
+        RNG& rng = theRNG();
+        const double maxDiff = 1e-6;
+        const int testCount = 10;
+        for(int testIndex = 0; testIndex < testCount; testIndex++)
+        {
+            Mat Rt = randomRigidTransform(rng), information = randomInformation(rng);
+
+            // ksi -> g2o: the swapped blocks and the halved rotation
+            Mat g2oInformation;
+            eigen2cv(informationMatrixSE3(information), g2oInformation);
+            Mat propagatedInformation = propagateInformation(EdgeErrorFunction(Rt), information);
+            if(relativeDiff(g2oInformation, propagatedInformation) > maxDiff)
+            {
+                ts->printf(cvtest::TS::LOG, "\nIncorrect g2o information matrix, relative diff %g",
+                           relativeDiff(g2oInformation, propagatedInformation));
+                ts->set_failed_test_info(cvtest::TS::FAIL_BAD_ACCURACY);
+                return;
+            }
+
+            // the normalized one has the same shape and the determinant of the constant one
+            Mat normalizedInformation;
+            eigen2cv(normalizedInformationMatrixSE3(information), normalizedInformation);
+            double scale = normalizedInformation.at<double>(0,0) / g2oInformation.at<double>(0,0);
+            if(relativeDiff(normalizedInformation, scale * g2oInformation) > maxDiff ||
+               std::abs(determinant(normalizedInformation) / 1e12 - 1) > maxDiff)
+            {
+                ts->printf(cvtest::TS::LOG, "\nIncorrect normalized information matrix");
+                ts->set_failed_test_info(cvtest::TS::FAIL_BAD_ACCURACY);
+                return;
+            }
+
+            // Rt -> Rt.inv()
+            Mat invertedInformation = invertedTransformInformation(Rt, information);
+            propagatedInformation = propagateInformation(InverseIncrementFunction(Rt), information);
+            if(relativeDiff(invertedInformation, propagatedInformation) > maxDiff)
+            {
+                ts->printf(cvtest::TS::LOG, "\nIncorrect information matrix of the inverted transformation, relative diff %g",
+                           relativeDiff(invertedInformation, propagatedInformation));
+                ts->set_failed_test_info(cvtest::TS::FAIL_BAD_ACCURACY);
+                return;
+            }
+        }
+
+        // a degenerate information falls back to the constant one
+        Mat constantInformation = Mat::eye(6, 6, CV_64FC1), normalizedInformation, dst;
+        dst = constantInformation(Rect(3,3,3,3));
+        dst *= 10000;
+        eigen2cv(normalizedInformationMatrixSE3(Mat::zeros(6, 6, CV_64FC1)), normalizedInformation);
+        if(norm(normalizedInformation, constantInformation) > 0)
+        {
+            ts->printf(cvtest::TS::LOG, "\nThe degenerate information matrix is not replaced by the constant one");
+            ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+        }
+
+        if(!invertedTransformInformation(Mat::eye(4, 4, CV_64FC1), Mat()).empty())
+        {
+            ts->printf(cvtest::TS::LOG, "\nThe inverted empty information matrix is not empty");
+            ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+        }
+    }
+};
+
+TEST(Reconst3d_GraphSE3, informationMatrix)
+{
+    CV_InformationMatrixSE3Test test;
+    test.safe_run();
+}
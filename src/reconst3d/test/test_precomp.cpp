@@ -0,0 +1 @@
+#include "test_precomp.hpp"
@@ -0,0 +1,9 @@
+#ifndef __RECONST3D_TEST_PRECOMP_HPP__
+#define __RECONST3D_TEST_PRECOMP_HPP__
+
+#include <opencv2/ts/ts.hpp>
+#include <iostream>
+
+#include "../graph_optimizations.hpp"
+
+#endif
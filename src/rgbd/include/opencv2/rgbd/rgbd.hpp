@@ -96,6 +96,8 @@ namespace cv
    * - the normals with bilateral filtering on a depth image from
    * ``Gradient Response Maps for Real-Time Detection of Texture-Less Objects``
    * by S. Hinterstoisser, C. Cagniart, S. Ilic, P. Sturm, N. Navab, P. Fua, and V. Lepetit
+   * - INTEGRAL: the smallest eigenvector of the covariance of the points in the window, computed from
+   * integral images as in PCL's IntegralImageNormalEstimation, so its cost does not depend on the window size
    */
   CV_EXPORTS
   class RgbdNormals: public Algorithm
@@ -103,7 +105,7 @@ namespace cv
   public:
     enum RGBD_NORMALS_METHOD
     {
-      RGBD_NORMALS_METHOD_FALS, RGBD_NORMALS_METHOD_LINEMOD, RGBD_NORMALS_METHOD_SRI
+      RGBD_NORMALS_METHOD_FALS, RGBD_NORMALS_METHOD_LINEMOD, RGBD_NORMALS_METHOD_SRI, RGBD_NORMALS_METHOD_INTEGRAL
     };
 
     RgbdNormals()
@@ -124,7 +126,9 @@ namespace cv
      * @param depth the depth of the normals (only CV_32F or CV_64F for FALS and SRI, CV_16U for LINEMOD)
      * @param K the calibration matrix to use
      * @param window_size the window size to compute the normals: can only be 1,3,5 or 7
-     * @param method one of the methods to use: RGBD_NORMALS_METHOD_SRI, RGBD_NORMALS_METHOD_FALS
+     *        (any odd size from 3 for RGBD_NORMALS_METHOD_INTEGRAL)
+     * @param method one of the methods to use: RGBD_NORMALS_METHOD_SRI, RGBD_NORMALS_METHOD_FALS,
+     *        RGBD_NORMALS_METHOD_LINEMOD, RGBD_NORMALS_METHOD_INTEGRAL
      */
     RgbdNormals(int rows, int cols, int depth, InputArray K, int window_size = 5, int method =
         RGBD_NORMALS_METHOD_FALS);
@@ -136,13 +140,16 @@ namespace cv
 
     /** Given a set of 3d points in a depth image, compute the normals at each point.
      * @param points a rows x cols x 3 matrix of CV_32F/CV64F or a rows x cols x 1 CV_U16S
-     * @param normals a rows x cols x 3 matrix
+     *        (in millimeters) or CV_32F/CV_64F (in meters) depth image. With a depth image, the methods
+     *        work from the cached rays of the pixels and the 3d points are never created
+     * @param normals a rows x cols x 3 matrix (NaN on the borders that RGBD_NORMALS_METHOD_LINEMOD can't compute)
      */
     void
     operator()(InputArray points, OutputArray normals) const;
 
     /** Initializes some data that is cached for later computation
-     * If that function is not called, it will be called the first time normals are computed
+     * If that function is not called, it will be called the first time normals are computed.
+     * That data is shared by all the RgbdNormals of the process with the same parameters
      */
     void
     initialize() const;
@@ -159,6 +166,11 @@ namespace cv
     void
     initialize_normals_impl(int rows, int cols, int depth, const Mat & K, int window_size, int method) const;
 
+    /** Return the number of the cached data shared by the RgbdNormals of the process (for the tests)
+     */
+    static int
+    shared_impls_count();
+
     int rows_, cols_, depth_;
     Mat K_;
     int window_size_;
@@ -380,11 +392,170 @@ namespace cv
     std::vector<Mat> pyramid_dI_dx;
     std::vector<Mat> pyramid_dI_dy;
     std::vector<Mat> pyramidTexturedMask;
+    // Pixels of pyramidTexturedMask as the CV_32FC3 column of (u, v, depth), used by the sparse RgbdOdometry
+    std::vector<Mat> pyramidTexturedSamples;
 
     std::vector<Mat> pyramidNormals;
     std::vector<Mat> pyramidNormalsMask;
   };
 
+  /** Scratch data of the Odometry computation: the camera matrix pyramid and the per level buffers of the
+   * correspondences and of the normal equations. The buffers are allocated by create() or at the first use and
+   * are reused by next computations on the frames of the same size, so that the steady-state Odometry::compute
+   * does not allocate them again when the same workspace is passed to it. A workspace can not be shared
+   * by simultaneous computations.
+   */
+  CV_EXPORTS struct OdometryWorkspace
+  {
+    OdometryWorkspace();
+
+    /** Allocate all the buffers for the frames of the given size.
+     * @param frameSize The resolution of the frames (the size of the pyramid level 0)
+     * @param levelCount The count of the pyramid levels (the size of iterCounts of the odometry)
+     * @param pyramidScale The ratio of the sizes of the successive pyramid levels (pyramidScale of the odometry)
+     */
+    void
+    create(const Size& frameSize, int levelCount, double pyramidScale = 2.);
+
+    void
+    release();
+
+    /** Buffers of one pyramid level. Two terms (RGB-D and ICP) have their own correspondences.
+     */
+    struct Level
+    {
+      Mat projTables;
+      Mat projIndices, projDepths, projRowRanges;
+      Mat stripeCounts;
+      Mat selectMask;
+      Mat corresps[2], zBuffers[2], correspsLists[2];
+      Mat diffs, transformedPoints, blockSums;
+      // Jacobians of the samples and their Hessian for the inverse compositional RgbdOdometry
+      Mat jacobians, hessian;
+    };
+
+    Matx33d cameraMatrix;
+    double pyramidScale;
+    std::vector<Matx33d> pyramidCameraMatrix;
+    std::vector<Matx33d> pyramidCameraMatrixInv;
+    std::vector<int> iterCounts;
+    std::vector<Level> levels;
+    Mat AtA, AtB, ksi;
+  };
+
+  /** Statistics of the Odometry computation, it's filled by Odometry::compute if it's requested.
+   */
+  CV_EXPORTS struct OdometryStats
+  {
+    /** Count of the done iterations on each pyramid level (level 0 is the finest one). It's less than iterCounts
+     * of the odometry if the iterations converged or stopped because of too few correspondences.
+     */
+    std::vector<int> iterCounts;
+
+    /** Count of the RGB-D and ICP correspondences on the last iteration of each pyramid level
+     * (0 if the odometry does not have the term).
+     */
+    std::vector<int> correspsRgbdCounts, correspsICPCounts;
+
+    /** RMS residual of the RGB-D and ICP terms on the last iteration of each pyramid level (before its update).
+     * The final residual of the computation is the one of the level 0.
+     */
+    std::vector<double> rmsRgbd, rmsICP;
+
+    /** The matrix of the normal equations (Gauss-Newton approximation of the Hessian, with the robust weights)
+     * of the last solved iteration on the finest processed level, its inverse approximates the covariance
+     * of the increment. It's 6x6 or 3x3 (depending on the transformType) of CV_64FC1 type, it's empty
+     * if no system was solved.
+     */
+    Mat hessian;
+
+    /** 6x6 information matrix (the inverse covariance) of the resulting transformation Rt of the RIGID_BODY_MOTION
+     * odometry. It's given for the increment exp(ksi) * Rt, where ksi is the rotation vector and then the translation.
+     * It's empty if the computation failed or if it can't be estimated: the residuals of the RgbdICPOdometry
+     * have to be normalized by the default robust kernel for this.
+     */
+    Mat information;
+
+    /** Wall-clock times in seconds: the preparation of the frame caches (pyramids, normals, etc.) and then
+     * the correspondences search and the solving (the accumulation of the normal equations and their solution)
+     * summed over the iterations of each pyramid level.
+     */
+    double prepareTime;
+    std::vector<double> correspsTimes, solveTimes;
+
+    OdometryStats();
+
+    /** Reset all the fields for the given count of the pyramid levels.
+     */
+    void
+    reset(int levelCount);
+  };
+
+  /** Pair of frames (and the initial transformation) processed by the batch Odometry::compute.
+   * Several pairs may share a frame.
+   */
+  CV_EXPORTS struct OdometryFramePair
+  {
+    OdometryFramePair();
+    OdometryFramePair(const Ptr<OdometryFrame>& srcFrame, const Ptr<OdometryFrame>& dstFrame, const Mat& initRt = Mat());
+
+    Ptr<OdometryFrame> srcFrame;
+    Ptr<OdometryFrame> dstFrame;
+    Mat initRt;
+  };
+
+  /** Base class of the camera motion models. A model predicts the transformation between successive frames
+   * (in the format of Rt of Odometry::compute) from the previously estimated ones.
+   */
+  class CV_EXPORTS MotionModel: public Algorithm
+  {
+  public:
+    /** Predict the transformation from the next frame to the last one.
+     * @param dt The time between the last frame and the next one (in the units of update)
+     * @return 4x4 matrix of CV_64FC1 type, it's the identity matrix if there is no motion history
+     */
+    virtual Mat
+    predict(double dt = 1.) const = 0;
+
+    /** Add the estimated transformation from the new frame to the last one.
+     * @param Rt 4x4 matrix of rigid body motion
+     * @param dt The time between these frames
+     */
+    virtual void
+    update(const Mat& Rt, double dt = 1.) = 0;
+
+    /** Forget the motion history (e.g. after a tracking failure).
+     */
+    virtual void
+    reset() = 0;
+  };
+
+  /** The motion model with constant linear and angular velocities. The velocity is the twist (the logarithm
+   * of SE(3) transformation) of the last update divided by its time, the prediction is the exponent of the velocity
+   * multiplied by the given time.
+   */
+  class CV_EXPORTS ConstantVelocityModel: public MotionModel
+  {
+  public:
+    ConstantVelocityModel();
+
+    virtual Mat
+    predict(double dt = 1.) const;
+
+    virtual void
+    update(const Mat& Rt, double dt = 1.);
+
+    virtual void
+    reset();
+
+    AlgorithmInfo*
+    info() const;
+
+  protected:
+    // 6x1 twist per time unit (rotation then translation), empty if there is no motion history
+    Mat velocity;
+  };
+
   /** Base class for computation of odometry.
    */
   CV_EXPORTS class Odometry: public Algorithm
@@ -397,6 +568,29 @@ namespace cv
       ROTATION = 1, TRANSLATION = 2, RIGID_BODY_MOTION = 4
     };
 
+    /** Robust kernels of the residuals (the weights of the iteratively reweighted least squares).
+     * @param ROBUST_KERNEL_SIGMA The weight 1/(sigma + |r|)^2, where sigma is the RMS residual of the term (default)
+     * @param ROBUST_KERNEL_NONE The ordinary least squares
+     * @param ROBUST_KERNEL_HUBER Huber kernel with the threshold 1.345*sigma
+     * @param ROBUST_KERNEL_TUKEY Tukey biweight kernel with the threshold 4.685*sigma
+     * @param ROBUST_KERNEL_CAUCHY Cauchy kernel with the scale 2.3849*sigma
+     */
+    enum
+    {
+      ROBUST_KERNEL_SIGMA = 0, ROBUST_KERNEL_NONE = 1, ROBUST_KERNEL_HUBER = 2, ROBUST_KERNEL_TUKEY = 3,
+      ROBUST_KERNEL_CAUCHY = 4
+    };
+
+    /** Downsampling of the depth pyramid levels.
+     * @param DEPTH_DOWNSAMPLING_GAUSSIAN The Gaussian smoothing as for the image (default), it blurs the depth edges
+     * @param DEPTH_DOWNSAMPLING_NEAREST_VALID The valid depth nearest to the sampled position
+     * @param DEPTH_DOWNSAMPLING_MEDIAN The median of the valid depths around the sampled position
+     */
+    enum
+    {
+      DEPTH_DOWNSAMPLING_GAUSSIAN = 0, DEPTH_DOWNSAMPLING_NEAREST_VALID = 1, DEPTH_DOWNSAMPLING_MEDIAN = 2
+    };
+
     static inline float
     DEFAULT_MIN_DEPTH()
     {
@@ -452,13 +646,40 @@ namespace cv
 
     /** One more method to compute a transformation from the source frame to the destination one.
      * It is designed to save on computing the frame data (image pyramids, normals, etc.).
+     * @param stats The statistics of the computation (optional)
      */
     bool
-    compute(Ptr<OdometryFrame>& srcFrame, Ptr<OdometryFrame>& dstFrame, Mat& Rt, const Mat& initRt = Mat()) const;
+    compute(Ptr<OdometryFrame>& srcFrame, Ptr<OdometryFrame>& dstFrame, Mat& Rt, const Mat& initRt = Mat(),
+            OdometryStats* stats = 0) const;
+
+    /** The same as above but with the scratch buffers of the given workspace instead of temporary ones.
+     * The method above allocates its buffers on each call, so that several threads can use one odometry object;
+     * passing the same workspace to successive calls reuses them.
+     */
+    bool
+    compute(Ptr<OdometryFrame>& srcFrame, Ptr<OdometryFrame>& dstFrame, Mat& Rt, const Mat& initRt,
+            OdometryWorkspace& workspace, OdometryStats* stats = 0) const;
+
+    /** Compute the transformations of several pairs of frames concurrently. The caches of the frames are prepared
+     * first, once per frame even if it is shared by several pairs (as srcFrame and dstFrame maybe), then the pairs
+     * are computed in parallel and the frames are only read.
+     * @param pairs The pairs of frames
+     * @param Rts The resulting transformations, Rts[i] is the result of pairs[i] (see the compute method above)
+     * @param isOk The per pair results of the computation
+     * @param workspaces The scratch buffers, one per concurrent computation. The vector is resized to the count
+     *                   of them, so it can be passed to the next calls to reuse the buffers.
+     * @param stats The per pair statistics of the computation (optional), the preparation time of a frame
+     *              is counted in the first pair using it
+     * @return The count of the successfully computed pairs
+     */
+    int
+    compute(std::vector<OdometryFramePair>& pairs, std::vector<Mat>& Rts, std::vector<uchar>& isOk,
+            std::vector<OdometryWorkspace>& workspaces, std::vector<OdometryStats>* stats = 0) const;
 
     /** Prepare a cache for the frame. The function checks the precomputed/passed data (throws the error if this data
      * does not satisfy) and computes all remaining cache data needed for the frame. Returned size is a resolution
-     * of the prepared frame.
+     * of the prepared frame. The pyramids are prepared level by level: the empty (or missing) levels are computed,
+     * the existing ones are reused. So the frame prepared as a dstFrame becomes a srcFrame (and vice versa) at a small cost.
      * @param odometry The odometry which will process the frame.
      * @param cacheType The cache type: CACHE_SRC, CACHE_DST or CACHE_ALL.
      */
@@ -466,12 +687,15 @@ namespace cv
     prepareFrameCache(Ptr<OdometryFrame>& frame, int cacheType) const;
 
   protected:
+    // the parallel stage of the batch compute, it calls computeImpl on the prepared frames
+    friend struct BatchComputeBody;
+
     virtual void
     checkParams() const = 0;
 
     virtual bool
     computeImpl(const Ptr<OdometryFrame>& srcFrame, const Ptr<OdometryFrame>& dstFrame, Mat& Rt,
-                const Mat& initRt) const = 0;
+                const Mat& initRt, OdometryWorkspace& workspace, OdometryStats* stats) const = 0;
   };
 
   /** Odometry based on the paper "Real-Time Visual Odometry from Dense RGB-D Images", 
@@ -508,7 +732,7 @@ namespace cv
 
     virtual bool
     computeImpl(const Ptr<OdometryFrame>& srcFrame, const Ptr<OdometryFrame>& dstFrame, Mat& Rt,
-                const Mat& initRt) const;
+                const Mat& initRt, OdometryWorkspace& workspace, OdometryStats* stats) const;
 
     // Some params have commented desired type. It's due to cv::AlgorithmInfo::addParams does not support it now.
     /*float*/
@@ -523,6 +747,47 @@ namespace cv
     int transformType;
 
     double maxTranslation, maxRotation;
+
+    // The iterations on a level stop if the norm of the increment or the relative change
+    // of the residual between two iterations is less than these thresholds (0 disables them).
+    double minKsiNorm, minResidualChange;
+
+    // One of ROBUST_KERNEL_*, it weights the photometric residuals of the correspondences.
+    // It is ignored when inverseCompositional is set, the residuals are not reweighted then
+    int robustKernel;
+
+    // If true, the normal equations are accumulated in float by blocks that are merged in double.
+    // It's faster, the results differ from the double accumulation by the float rounding only.
+    bool floatAccumulation;
+
+    // The correspondences are rejected if their depth difference is more than
+    // maxDepthDiffs[level] + sensorErrorA * z^2 + sensorErrorB * z, where z is the source depth.
+    // maxDepthDiffs is optional (maxDepthDiff is used on all levels if it's empty), the depth dependent
+    // part follows the sensor noise (sensorErrorA = 0.0075 for a Kinect, as in RgbdPlane). The sensor errors are 0 by default.
+    /*vector<float>*/
+    Mat maxDepthDiffs;
+    double sensorErrorA, sensorErrorB;
+
+    // The ratio of the sizes of the successive pyramid levels (2 by default), e.g. 1.5 gives a finer pyramid,
+    // so the iterations of the finest level can be dropped. The camera matrix of a level is scaled by 1/pyramidScale.
+    double pyramidScale;
+    // One of DEPTH_DOWNSAMPLING_*
+    int depthDownsampling;
+
+    // If true, the correspondences are searched only for the pyramidTexturedSamples of the dstFrame
+    // instead of scanning its whole image, so the cost of an iteration follows the count of selected pixels.
+    bool sparse;
+
+    // If true, the inverse compositional scheme is used: the Jacobians of pyramidTexturedSamples of the dstFrame
+    // and the Hessian are computed once per pyramid level and an iteration only warps the samples and accumulates
+    // the residuals. The residuals are not reweighted then (robustKernel is not used). It implies the sparse
+    // correspondences search.
+    bool inverseCompositional;
+
+    // If true, the source intensity and point of a correspondence are sampled bilinearly at the subpixel
+    // projection of the dstFrame pixel instead of the nearest pixel. It's more accurate on the coarse levels,
+    // so fewer iterations are needed. It isn't used by the inverse compositional scheme.
+    bool bilinearSampling;
   };
 
   /** Odometry based on the paper "KinectFusion: Real-Time Dense Surface Mapping and Tracking", 
@@ -557,7 +822,7 @@ namespace cv
 
     virtual bool
     computeImpl(const Ptr<OdometryFrame>& srcFrame, const Ptr<OdometryFrame>& dstFrame, Mat& Rt,
-                const Mat& initRt) const;
+                const Mat& initRt, OdometryWorkspace& workspace, OdometryStats* stats) const;
 
     // Some params have commented desired type. It's due to cv::AlgorithmInfo::addParams does not support it now.
     /*float*/
@@ -572,6 +837,31 @@ namespace cv
 
     double maxTranslation, maxRotation;
 
+    // The iterations on a level stop if the norm of the increment or the relative change
+    // of the residual between two iterations is less than these thresholds (0 disables them).
+    double minKsiNorm, minResidualChange;
+
+    // One of ROBUST_KERNEL_*, it weights the point-to-plane residuals of the correspondences
+    int robustKernel;
+
+    // If true, the normal equations are accumulated in float by blocks that are merged in double.
+    // It's faster, the results differ from the double accumulation by the float rounding only.
+    bool floatAccumulation;
+
+    // The correspondences are rejected if their depth difference is more than
+    // maxDepthDiffs[level] + sensorErrorA * z^2 + sensorErrorB * z, where z is the source depth.
+    // maxDepthDiffs is optional (maxDepthDiff is used on all levels if it's empty), the depth dependent
+    // part follows the sensor noise (sensorErrorA = 0.0075 for a Kinect, as in RgbdPlane). The sensor errors are 0 by default.
+    /*vector<float>*/
+    Mat maxDepthDiffs;
+    double sensorErrorA, sensorErrorB;
+
+    // The ratio of the sizes of the successive pyramid levels (2 by default), e.g. 1.5 gives a finer pyramid,
+    // so the iterations of the finest level can be dropped. The camera matrix of a level is scaled by 1/pyramidScale.
+    double pyramidScale;
+    // One of DEPTH_DOWNSAMPLING_*
+    int depthDownsampling;
+
     mutable cv::Ptr<cv::RgbdNormals> normalsComputer;
   };
 
@@ -611,7 +901,7 @@ namespace cv
 
     virtual bool
     computeImpl(const Ptr<OdometryFrame>& srcFrame, const Ptr<OdometryFrame>& dstFrame, Mat& Rt,
-                const Mat& initRt) const;
+                const Mat& initRt, OdometryWorkspace& workspace, OdometryStats* stats) const;
 
     // Some params have commented desired type. It's due to cv::AlgorithmInfo::addParams does not support it now.
     /*float*/
@@ -628,9 +918,135 @@ namespace cv
 
     double maxTranslation, maxRotation;
 
+    // The iterations on a level stop if the norm of the increment or the relative change
+    // of the residual between two iterations is less than these thresholds (0 disables them).
+    double minKsiNorm, minResidualChange;
+
+    // One of ROBUST_KERNEL_*, it is applied to both the RGB-D and the ICP residuals, each with the sigma of its term
+    int robustKernel;
+
+    // If true, the normal equations are accumulated in float by blocks that are merged in double.
+    // It's faster, the results differ from the double accumulation by the float rounding only.
+    bool floatAccumulation;
+
+    // The correspondences are rejected if their depth difference is more than
+    // maxDepthDiffs[level] + sensorErrorA * z^2 + sensorErrorB * z, where z is the source depth.
+    // maxDepthDiffs is optional (maxDepthDiff is used on all levels if it's empty), the depth dependent
+    // part follows the sensor noise (sensorErrorA = 0.0075 for a Kinect, as in RgbdPlane). The sensor errors are 0 by default.
+    /*vector<float>*/
+    Mat maxDepthDiffs;
+    double sensorErrorA, sensorErrorB;
+
+    // The ratio of the sizes of the successive pyramid levels (2 by default), e.g. 1.5 gives a finer pyramid,
+    // so the iterations of the finest level can be dropped. The camera matrix of a level is scaled by 1/pyramidScale.
+    double pyramidScale;
+    // One of DEPTH_DOWNSAMPLING_*
+    int depthDownsampling;
+
     mutable cv::Ptr<cv::RgbdNormals> normalsComputer;
   };
 
+  /** Frame to keyframe tracking by an Odometry. Each new frame is registered to the current keyframe
+   * (the keyframe is the srcFrame of the odometry, so its SRC cache is computed once and kept alive while it's
+   * the keyframe), starting from the transformation of the previous frame. The keyframe is switched to the tracked
+   * frame if the part of the keyframe points visible in the frame or the part of inliers among them becomes small.
+   * The poses are the transformations from the frame coordinates to the coordinates of the first keyframe.
+   */
+  class CV_EXPORTS OdometryTracker: public Algorithm
+  {
+  public:
+    OdometryTracker();
+    OdometryTracker(const Ptr<Odometry>& odometry);
+
+    static inline double
+    DEFAULT_MIN_INLIERS_RATIO()
+    {
+      return 0.5; // in [0, 1]
+    }
+    static inline double
+    DEFAULT_MIN_KEYFRAME_OVERLAP()
+    {
+      return 0.7; // in [0, 1]
+    }
+    static inline double
+    DEFAULT_MIN_KEYFRAME_INLIERS_RATIO()
+    {
+      return 0.8; // in [0, 1]
+    }
+    static inline double
+    DEFAULT_MAX_INLIER_DEPTH_DIFF()
+    {
+      return 0.07; // in meters
+    }
+    static inline int
+    DEFAULT_MAX_INLIER_COLOR_DIFF()
+    {
+      return 50;
+    }
+
+    /** Track the next frame. The first frame (and the first one after reset) becomes the keyframe
+     * with the identity pose. If the tracker has the motionModel, its prediction of the motion since the last
+     * tracked frame seeds the odometry, the model is updated by the tracked frames and is reset on failure.
+     * @param frame The frame, its cache is prepared by the odometry. The tracker keeps it if it becomes the keyframe.
+     * @param pose The resulting pose of the frame (4x4 matrix of CV_64FC1 type), it's not changed on failure
+     * @return true if the odometry succeeded and the part of inliers among the points of the keyframe visible
+     *         in the frame is not less than minInliersRatio. The keyframe is not switched on failure,
+     *         so the next frames are tracked against it again.
+     */
+    bool
+    track(Ptr<OdometryFrame>& frame, Mat& pose);
+
+    /** Forget the keyframe, the next tracked frame starts a new trajectory.
+     */
+    void
+    reset();
+
+    /** The current keyframe, it's empty before the first frame.
+     */
+    Ptr<OdometryFrame>
+    getKeyframe() const;
+
+    /** The pose of the current keyframe.
+     */
+    Mat
+    getKeyframePose() const;
+
+    /** True if the last tracked frame has become the keyframe.
+     */
+    bool
+    isKeyframeSwitched() const;
+
+    AlgorithmInfo*
+    info() const;
+
+  protected:
+    Ptr<Odometry> odometry;
+
+    // The tracking fails if the part of inliers is less than minInliersRatio. The keyframe is switched
+    // if the part of its visible points is less than minKeyframeOverlap or the part of inliers is less
+    // than minKeyframeInliersRatio.
+    double minInliersRatio;
+    double minKeyframeOverlap, minKeyframeInliersRatio;
+
+    // Thresholds of the inliers, the color one is not used for the frames without images
+    double maxInlierDepthDiff;
+    int maxInlierColorDiff;
+
+    // The pyramid level on which the overlap and the inliers are counted
+    int checkLevel;
+
+    // It's optional, it predicts the motion between the successive tracked frames
+    Ptr<MotionModel> motionModel;
+
+    Ptr<OdometryFrame> keyframe;
+    Mat keyframePose;
+    // The transformation from the keyframe to the last tracked frame, the initial one for the next frame
+    Mat lastRt;
+    bool keyframeSwitched;
+
+    OdometryWorkspace workspace;
+  };
+
   /** Warp the image: compute 3d points from the depth, transform them using given transformation, 
    * then project color point cloud to an image plane. 
    * This function can be used to visualize results of the Odometry algorithm.
@@ -649,6 +1065,53 @@ namespace cv
   warpFrame(const Mat& image, const Mat& depth, const Mat& mask, const Mat& Rt, const Mat& cameraMatrix,
             const Mat& distCoeff, Mat& warpedImage, Mat* warpedDepth = 0, Mat* warpedMask = 0);
 
+  /** The same warp as warpFrame for the streaming use (e.g. the view synthesis of every frame).
+   * The back-projection rays of the pixels are tabulated once for the camera, the points are transformed,
+   * projected and z-buffered straight into the outputs in parallel, without the intermediate clouds.
+   * The output and the internal buffers are reused while the frame size does not change.
+   */
+  class CV_EXPORTS FrameWarper
+  {
+  public:
+    FrameWarper();
+
+    /**
+     * @param cameraMatrix Camera matrix
+     * @param frameSize The size of the frames
+     * @param distCoeff Distortion coefficients (of 4, 5 or 8 elements) of the projection, as in warpFrame
+     */
+    FrameWarper(const Mat& cameraMatrix, const Size& frameSize, const Mat& distCoeff = Mat());
+
+    /** Set the camera, the ray tables are rebuilt only if the camera matrix or the frame size are changed.
+     */
+    void
+    setCamera(const Mat& cameraMatrix, const Size& frameSize, const Mat& distCoeff = Mat());
+
+    /** Warp the frame as warpFrame does.
+     * @param image The image (of CV_8UC1 or CV_8UC3 type)
+     * @param depth The depth (of CV_32FC1 type in meters or of CV_16UC1 type in millimeters)
+     * @param mask The mask of used pixels (of CV_8UC1), it can be empty
+     * @param Rt The transformation that will be applied to the 3d points computed from the depth
+     * @param warpedImage The warped image.
+     * @param warpedDepth The warped depth (of CV_32FC1 type, NaN where nothing is projected).
+     * @param warpedMask The warped mask.
+     */
+    void
+    warp(const Mat& image, const Mat& depth, const Mat& mask, const Mat& Rt,
+         Mat& warpedImage, Mat& warpedDepth, Mat& warpedMask);
+
+  protected:
+    Matx33d cameraMatrix;
+    Size frameSize;
+    Mat distCoeff;
+
+    // The x of the rays per column, then the y of the rays per row (the rays have z = 1)
+    Mat rayTables;
+
+    // The target pixel index (or -1) and the depth of every source pixel, the range of the target rows per source row
+    Mat projIndices, projDepths, projRowRanges;
+  };
+
 // TODO Depth interpolation
 // Curvature
 // Get rescaleDepth return dubles if asked for
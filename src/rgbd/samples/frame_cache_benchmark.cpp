@@ -0,0 +1,126 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <opencv2/rgbd/rgbd.hpp>
+
+#include "opencv2/highgui/highgui.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/contrib/contrib.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+
+using namespace std;
+using namespace cv;
+
+static
+double measureFrameCacheTime(const Ptr<Odometry>& odometry, const Mat& image, const Mat& depth, int iterations)
+{
+    // the first frame also creates the normals computer of the odometry, so it's not measured
+    Ptr<OdometryFrame> frame = new OdometryFrame(image, depth);
+    odometry->prepareFrameCache(frame, OdometryFrame::CACHE_ALL);
+
+    TickMeter tm;
+    for(int i = 0; i < iterations; i++)
+    {
+        frame = new OdometryFrame(image, depth);
+        tm.start();
+        odometry->prepareFrameCache(frame, OdometryFrame::CACHE_ALL);
+        tm.stop();
+    }
+    return tm.getTimeMilli() / iterations;
+}
+
+/*
+ * This sample measures the wall-clock time of the RgbdICPOdometry frame cache preparation (pyramids, normals, masks)
+ * in one thread and with the default number of threads. The frame is resized to 640x480 and 1280x960.
+ * The depth is expected in the TUM format (16 bit, 5000 units per meter), e.g. testdata/rgbd/odometry/depth.png.
+ */
+int main(int argc, char** argv)
+{
+    if(argc != 3 && argc != 4)
+    {
+        cout << "Format: rgb_image depth_image [iterations]" << endl;
+        return -1;
+    }
+    const int iterations = argc == 4 ? std::max(1, atoi(argv[3])) : 20;
+
+    Mat image = imread(argv[1], 0);
+    Mat depth16 = imread(argv[2], -1);
+    if(image.empty() || depth16.empty() || depth16.type() != CV_16UC1 || image.size() != depth16.size())
+    {
+        cout << "Can not read the image or the depth (it has to be 16 bit image of the same size)." << endl;
+        return -1;
+    }
+
+    Mat depth;
+    depth16.convertTo(depth, CV_32FC1, 1.f/5000.f);
+    depth.setTo(std::numeric_limits<float>::quiet_NaN(), depth16 == 0);
+
+    const int defaultThreadsCount = getNumThreads();
+    const Size sizes[] = {Size(640, 480), Size(1280, 960)};
+    for(size_t sizeIndex = 0; sizeIndex < sizeof(sizes) / sizeof(sizes[0]); sizeIndex++)
+    {
+        const Size& size = sizes[sizeIndex];
+        const float scale = static_cast<float>(size.width) / image.cols;
+
+        Mat levelImage, levelDepth;
+        resize(image, levelImage, size, 0, 0, INTER_LINEAR);
+        resize(depth, levelDepth, size, 0, 0, INTER_NEAREST);
+
+        Mat cameraMatrix = Mat::eye(3,3,CV_32FC1);
+        cameraMatrix.at<float>(0,0) = 525.f * scale;
+        cameraMatrix.at<float>(1,1) = 525.f * scale;
+        cameraMatrix.at<float>(0,2) = 319.5f * scale;
+        cameraMatrix.at<float>(1,2) = 239.5f * scale;
+
+        Ptr<Odometry> odometry = Algorithm::create<Odometry>("RGBD.RgbdICPOdometry");
+        odometry->set("cameraMatrix", cameraMatrix);
+
+        setNumThreads(1);
+        double singleThreadTime = measureFrameCacheTime(odometry, levelImage, levelDepth, iterations);
+
+        setNumThreads(defaultThreadsCount);
+        double multiThreadTime = measureFrameCacheTime(odometry, levelImage, levelDepth, iterations);
+
+        cout << size.width << "x" << size.height << ": "
+             << "1 thread " << singleThreadTime << " ms, "
+             << defaultThreadsCount << " threads " << multiThreadTime << " ms, "
+             << "speedup " << singleThreadTime / multiThreadTime << endl;
+    }
+
+    return 0;
+}
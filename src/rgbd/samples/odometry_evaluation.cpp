@@ -42,6 +42,7 @@
 #include <dirent.h>
 #include <iostream>
 #include <fstream>
+#include <cstdlib>
 
 using namespace std;
 using namespace cv;
@@ -99,6 +100,42 @@ void setCameraMatrixFreiburg2(float& fx, float& fy, float& cx, float& cy)
     fx = 520.9f; fy = 521.0f; cx = 325.1f; cy = 249.7f;
 }
 
+/*
+ * Computes the pairs of the successive frames of the batch concurrently and appends their poses to Rts.
+ * The last frame of the batch stays in it as the first one of the next batch.
+ */
+static
+void computeBatch(const Ptr<Odometry>& odometry, vector<Ptr<OdometryFrame> >& frames,
+                  vector<OdometryWorkspace>& workspaces, vector<Mat>& Rts, TickMeter& gtm, int& count)
+{
+    if(frames.size() < 2)
+        return;
+
+    vector<OdometryFramePair> pairs;
+    for(size_t i = 1; i < frames.size(); i++)
+        pairs.push_back(OdometryFramePair(frames[i], frames[i-1]));
+
+    vector<Mat> batchRts;
+    vector<uchar> isOk;
+    TickMeter tm;
+    tm.start();
+    gtm.start();
+    odometry->compute(pairs, batchRts, isOk, workspaces);
+    gtm.stop();
+    tm.stop();
+    count += (int)pairs.size();
+    cout << "Time " << tm.getTimeSec() / pairs.size() << " (per pair of the batch)" << endl;
+
+    for(size_t i = 0; i < pairs.size(); i++)
+    {
+        Mat Rt = isOk[i] ? batchRts[i] : Mat::eye(4,4,CV_64FC1);
+        cout << "Rt " << Rt << endl;
+        Rts.push_back(*Rts.rbegin() * Rt);
+    }
+
+    frames.erase(frames.begin(), frames.end() - 1);
+}
+
 /*
  * This sample helps to evaluate odometry on TUM datasets and benchmark http://vision.in.tum.de/data/datasets/rgbd-dataset.
  * At this link you can find instructions for evaluation. The sample runs some opencv odometry and saves a camera trajectory
@@ -106,11 +143,13 @@ void setCameraMatrixFreiburg2(float& fx, float& fy, float& cx, float& cy)
  */
 int main(int argc, char** argv)
 {
-    if(argc != 4)
+    if(argc != 4 && argc != 5)
     {
-        cout << "Format: file_with_rgb_depth_pairs trajectory_file odometry_name [Rgbd or ICP or RgbdICP]" << endl;
+        cout << "Format: file_with_rgb_depth_pairs trajectory_file odometry_name [Rgbd or ICP or RgbdICP] [batch_size]" << endl;
+        cout << "If batch_size is more than 1, the pairs of frames are computed concurrently by batches." << endl;
         return -1;
     }
+    const int batchSize = argc == 5 ? atoi(argv[4]) : 1;
     
     vector<string> timestamps;
     vector<Mat> Rts;
@@ -156,6 +195,8 @@ int main(int argc, char** argv)
 
     TickMeter gtm;
     int count = 0;
+    vector<Ptr<OdometryFrame> > batchFrames;
+    vector<OdometryWorkspace> workspaces;
     for(int i = 0; !file.eof(); i++)
     {
         string str;
@@ -204,6 +245,18 @@ int main(int argc, char** argv)
             timestamps.push_back( timestap );
         }
 
+        if(batchSize > 1)
+        {
+            Mat gray;
+            cvtColor(image, gray, CV_BGR2GRAY);
+            if(Rts.empty())
+                Rts.push_back(Mat::eye(4,4,CV_64FC1));
+
+            batchFrames.push_back(new OdometryFrame(gray, depth));
+            if((int)batchFrames.size() > batchSize)
+                computeBatch(odometry, batchFrames, workspaces, Rts, gtm, count);
+        }
+        else
         {
             Mat gray;
             cvtColor(image, gray, CV_BGR2GRAY);
@@ -243,6 +296,8 @@ int main(int argc, char** argv)
         }
     }
 
+    computeBatch(odometry, batchFrames, workspaces, Rts, gtm, count);
+
     std::cout << "Average time " << gtm.getTimeSec()/count << std::endl;
     writeResults(argv[2], timestamps, Rts);
 
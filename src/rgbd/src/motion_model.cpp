@@ -0,0 +1,145 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/rgbd/rgbd.hpp>
+
+namespace cv
+{
+  static inline Matx33d
+  skewMatrix(const Vec3d& w)
+  {
+    return Matx33d(0, -w[2], w[1],
+                   w[2], 0, -w[0],
+                   -w[1], w[0], 0);
+  }
+
+  /** The logarithm of SE(3) transformation.
+   * @param Rt 4x4 matrix of rigid body motion
+   * @param twist The twist: the rotation vector (as for Rodrigues) and then the translational part
+   */
+  static void
+  logSE3(const Matx44d& Rt, Vec6d& twist)
+  {
+    Matx33d R(Rt(0,0), Rt(0,1), Rt(0,2),
+              Rt(1,0), Rt(1,1), Rt(1,2),
+              Rt(2,0), Rt(2,1), Rt(2,2));
+    Vec3d t(Rt(0,3), Rt(1,3), Rt(2,3));
+
+    Vec3d w;
+    Rodrigues(R, w);
+
+    const double theta = norm(w);
+    const Matx33d W = skewMatrix(w);
+    const Matx33d W2 = W * W;
+
+    // inverse of the left Jacobian of SO(3)
+    double c = 1. / 12;
+    if(theta > 1e-6)
+    {
+      const double a = std::sin(theta) / theta;
+      const double b = (1. - std::cos(theta)) / (theta * theta);
+      c = (1. - a / (2. * b)) / (theta * theta);
+    }
+    Matx33d V_inv = Matx33d::eye() - 0.5 * W + c * W2;
+
+    Vec3d v = V_inv * t;
+    twist = Vec6d(w[0], w[1], w[2], v[0], v[1], v[2]);
+  }
+
+  /** The exponent of the twist, it's inverse of logSE3.
+   */
+  static void
+  expSE3(const Vec6d& twist, Matx44d& Rt)
+  {
+    Vec3d w(twist[0], twist[1], twist[2]);
+    Vec3d v(twist[3], twist[4], twist[5]);
+
+    Matx33d R;
+    Rodrigues(w, R);
+
+    const double theta = norm(w);
+    const Matx33d W = skewMatrix(w);
+
+    // left Jacobian of SO(3)
+    double b = 0.5, c = 1. / 6;
+    if(theta > 1e-6)
+    {
+      b = (1. - std::cos(theta)) / (theta * theta);
+      c = (1. - std::sin(theta) / theta) / (theta * theta);
+    }
+    Matx33d V = Matx33d::eye() + b * W + c * (W * W);
+
+    Vec3d t = V * v;
+    Rt = Matx44d(R(0,0), R(0,1), R(0,2), t[0],
+                 R(1,0), R(1,1), R(1,2), t[1],
+                 R(2,0), R(2,1), R(2,2), t[2],
+                 0, 0, 0, 1);
+  }
+
+  ConstantVelocityModel::ConstantVelocityModel()
+  {}
+
+  Mat
+  ConstantVelocityModel::predict(double dt) const
+  {
+    if(velocity.empty())
+      return Mat::eye(4, 4, CV_64FC1);
+
+    Matx44d Rt;
+    expSE3(Vec6d(velocity) * dt, Rt);
+    return Mat(Rt);
+  }
+
+  void
+  ConstantVelocityModel::update(const Mat& Rt, double dt)
+  {
+    CV_Assert(Rt.size() == Size(4,4) && (Rt.type() == CV_64FC1 || Rt.type() == CV_32FC1));
+    CV_Assert(dt > 0);
+
+    Mat Rt_dbl;
+    Rt.convertTo(Rt_dbl, CV_64FC1);
+
+    Vec6d twist;
+    logSE3(Matx44d(Rt_dbl), twist);
+    velocity = Mat(twist * (1. / dt), true);
+  }
+
+  void
+  ConstantVelocityModel::reset()
+  {
+    velocity.release();
+  }
+}
@@ -33,6 +33,7 @@
  *
  */
 
+#include <opencv2/core/internal.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/rgbd/rgbd.hpp>
@@ -159,6 +160,56 @@ namespace
       normal[2] = c * norm;
     }
   }
+
+  /** Convert a depth value to meters: CV_16U depth is in millimeters and 0 means no measurement,
+   * floating point depth is already in meters and NaN means no measurement
+   */
+  template<typename T, typename DepthT>
+  inline
+  T
+  depthInMeters(DepthT depth)
+  {
+    return T(depth);
+  }
+
+  template<typename T>
+  inline
+  T
+  depthInMeters(unsigned short depth)
+  {
+    return depth ? T(depth * 0.001) : std::numeric_limits<T>::quiet_NaN();
+  }
+
+  /** Compute the radius of the points of a depth image as the depth times the norm of the ray of each pixel
+   */
+  template<typename T, typename DepthT>
+  struct RadiusFromDepthBody: public cv::ParallelLoopBody
+  {
+    RadiusFromDepthBody(const cv::Mat &depth, const cv::Mat &ray_norms, cv::Mat &r)
+        :
+          depth_(depth),
+          ray_norms_(ray_norms),
+          r_(r)
+    {
+    }
+
+    virtual void
+    operator()(const cv::Range& range) const
+    {
+      for (int y = range.start; y < range.end; ++y)
+      {
+        const DepthT * depth = depth_.ptr<DepthT>(y);
+        const T * ray_norm = ray_norms_.ptr<T>(y);
+        T * r = r_.ptr<T>(y);
+        for (int x = 0; x < depth_.cols; ++x)
+          r[x] = depthInMeters<T>(depth[x]) * ray_norm[x];
+      }
+    }
+
+    const cv::Mat &depth_;
+    const cv::Mat &ray_norms_;
+    cv::Mat &r_;
+  };
 }
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -188,20 +239,292 @@ namespace
     virtual void
     cache()=0;
 
+    /** Compute the radius of the points of a depth image from the cached rays, without going through
+     * the 3d points
+     * @param depth a CV_16U depth image in millimeters or a CV_32F/CV_64F one in meters
+     * @param r the distance of each point to the origin, NaN where there is no depth
+     */
+    void
+    computeRadiusFromDepth(const cv::Mat &depth, cv::Mat &r) const
+    {
+      r.create(depth.size(), depth_);
+      if (depth_ == CV_32F)
+        radiusFromDepth<float>(depth, r);
+      else
+        radiusFromDepth<double>(depth, r);
+    }
+
     bool
     validate(int rows, int cols, int depth, const cv::Mat &K_ori, int window_size, int method) const
     {
       if ((K_ori.cols != K_ori_.cols) || (K_ori.rows != K_ori_.rows) || (K_ori.type() != K_ori_.type()))
         return false;
       bool K_test = !(cv::countNonZero(K_ori != K_ori_));
-      return (rows == rows_) && (cols = cols_) && (window_size == window_size_) && (depth == depth_) && (K_test)
+      return (rows == rows_) && (cols == cols_) && (window_size == window_size_) && (depth == depth_) && (K_test)
              && (method == method_);
     }
   protected:
+    /** Cache the rays of the pixels: the point of pixel (u, v) is its depth times
+     * (rays_x_(u), rays_y_(v), 1), as in depthTo3d, and ray_norms_ holds the norms of those rays
+     */
+    void
+    cacheRays()
+    {
+      cv::Matx33d K = K_ori_;
+      rays_x_.create(1, cols_, CV_64F);
+      rays_y_.create(rows_, 1, CV_64F);
+      for (int x = 0; x < cols_; ++x)
+        rays_x_.at<double>(0, x) = (x - K(0, 2)) / K(0, 0);
+      for (int y = 0; y < rows_; ++y)
+        rays_y_.at<double>(y, 0) = (y - K(1, 2)) / K(1, 1);
+
+      cv::Mat_<double> ray_norms(rows_, cols_);
+      for (int y = 0; y < rows_; ++y)
+      {
+        const double ray_y = rays_y_.at<double>(y, 0);
+        for (int x = 0; x < cols_; ++x)
+        {
+          const double ray_x = rays_x_.at<double>(0, x);
+          ray_norms(y, x) = std::sqrt(ray_x * ray_x + ray_y * ray_y + 1);
+        }
+      }
+      ray_norms.convertTo(ray_norms_, depth_);
+    }
+
+    template<typename T>
+    void
+    radiusFromDepth(const cv::Mat &depth, cv::Mat &r) const
+    {
+      CV_Assert(!ray_norms_.empty() && depth.size() == ray_norms_.size());
+      cv::Range rows(0, depth.rows);
+      switch (depth.depth())
+      {
+        case CV_16U:
+          cv::parallel_for_(rows, RadiusFromDepthBody<T, unsigned short>(depth, ray_norms_, r));
+          break;
+        case CV_32F:
+          cv::parallel_for_(rows, RadiusFromDepthBody<T, float>(depth, ray_norms_, r));
+          break;
+        case CV_64F:
+          cv::parallel_for_(rows, RadiusFromDepthBody<T, double>(depth, ray_norms_, r));
+          break;
+        default:
+          CV_Error(CV_StsBadArg, "Unsupported depth type, it has to be CV_16U, CV_32F or CV_64F");
+      }
+    }
+
     int rows_, cols_, depth_;
     cv::Mat K_, K_ori_;
     int window_size_;
     cv::RgbdNormals::RGBD_NORMALS_METHOD method_;
+    /** The rays of the columns and of the rows (in double) and their norms (in depth_) */
+    cv::Mat rays_x_, rays_y_, ray_norms_;
+  };
+
+  /** Compute the FALS normal M^-1 * B of one pixel, normalized and pointing towards the camera
+   * (NaN if the radius is NaN). The SSE2 versions below do the same operations in the same order.
+   */
+  template<typename T>
+  inline
+  void
+  falsNormal(const T* const * M_inv, const T* const * B, const T* r, int x, cv::Vec<T, 3> & normal)
+  {
+    if (cvIsNaN(r[x]))
+    {
+      normal[0] = normal[1] = normal[2] = r[x];
+      return;
+    }
+    T b0 = B[0][x], b1 = B[1][x], b2 = B[2][x];
+    T n0 = M_inv[0][x] * b0 + M_inv[1][x] * b1 + M_inv[2][x] * b2;
+    T n1 = M_inv[3][x] * b0 + M_inv[4][x] * b1 + M_inv[5][x] * b2;
+    T n2 = M_inv[6][x] * b0 + M_inv[7][x] * b1 + M_inv[8][x] * b2;
+    T norm = std::sqrt(n0 * n0 + n1 * n1 + n2 * n2);
+    if (n2 > 0)
+      norm = -norm;
+    normal[0] = n0 / norm;
+    normal[1] = n1 / norm;
+    normal[2] = n2 / norm;
+  }
+
+#if CV_SSE2
+  /** SSE2 version of falsNormal for 4 floats, the normals of x..x+3 are written to normals
+   */
+  inline
+  void
+  falsNormalsSSE2(const float* const * M_inv, const float* const * B, const float* r, int x, cv::Vec3f* normals)
+  {
+    __m128 b0 = _mm_loadu_ps(B[0] + x), b1 = _mm_loadu_ps(B[1] + x), b2 = _mm_loadu_ps(B[2] + x);
+    __m128 n[3];
+    for (int i = 0; i < 3; ++i)
+      n[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(M_inv[3 * i] + x), b0),
+                                   _mm_mul_ps(_mm_loadu_ps(M_inv[3 * i + 1] + x), b1)),
+                        _mm_mul_ps(_mm_loadu_ps(M_inv[3 * i + 2] + x), b2));
+    __m128 norm = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(n[0], n[0]), _mm_mul_ps(n[1], n[1])),
+                                         _mm_mul_ps(n[2], n[2])));
+    // flip the sign of the norm if n2 > 0
+    norm = _mm_xor_ps(norm, _mm_and_ps(_mm_cmpgt_ps(n[2], _mm_setzero_ps()), _mm_set1_ps(-0.f)));
+    // NaN where the radius is NaN
+    __m128 r4 = _mm_loadu_ps(r + x), valid = _mm_cmpord_ps(r4, r4);
+    float CV_DECL_ALIGNED(16) res[3][4];
+    for (int i = 0; i < 3; ++i)
+      _mm_store_ps(res[i], _mm_or_ps(_mm_and_ps(valid, _mm_div_ps(n[i], norm)), _mm_andnot_ps(valid, r4)));
+    for (int k = 0; k < 4; ++k)
+      normals[k] = cv::Vec3f(res[0][k], res[1][k], res[2][k]);
+  }
+
+  /** SSE2 version of falsNormal for 2 doubles, the normals of x..x+1 are written to normals
+   */
+  inline
+  void
+  falsNormalsSSE2(const double* const * M_inv, const double* const * B, const double* r, int x, cv::Vec3d* normals)
+  {
+    __m128d b0 = _mm_loadu_pd(B[0] + x), b1 = _mm_loadu_pd(B[1] + x), b2 = _mm_loadu_pd(B[2] + x);
+    __m128d n[3];
+    for (int i = 0; i < 3; ++i)
+      n[i] = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_loadu_pd(M_inv[3 * i] + x), b0),
+                                   _mm_mul_pd(_mm_loadu_pd(M_inv[3 * i + 1] + x), b1)),
+                        _mm_mul_pd(_mm_loadu_pd(M_inv[3 * i + 2] + x), b2));
+    __m128d norm = _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(n[0], n[0]), _mm_mul_pd(n[1], n[1])),
+                                          _mm_mul_pd(n[2], n[2])));
+    norm = _mm_xor_pd(norm, _mm_and_pd(_mm_cmpgt_pd(n[2], _mm_setzero_pd()), _mm_set1_pd(-0.)));
+    __m128d r2 = _mm_loadu_pd(r + x), valid = _mm_cmpord_pd(r2, r2);
+    double CV_DECL_ALIGNED(16) res[3][2];
+    for (int i = 0; i < 3; ++i)
+      _mm_store_pd(res[i], _mm_or_pd(_mm_and_pd(valid, _mm_div_pd(n[i], norm)), _mm_andnot_pd(valid, r2)));
+    for (int k = 0; k < 2; ++k)
+      normals[k] = cv::Vec3d(res[0][k], res[1][k], res[2][k]);
+  }
+
+  /** SSE2 computation of B = V / r (0 if r is NaN) for 4 floats
+   */
+  inline
+  void
+  falsBSSE2(const float* const * V, const float* r, int x, float* const * B)
+  {
+    __m128 r4 = _mm_loadu_ps(r + x);
+    __m128 r_inv = _mm_and_ps(_mm_cmpord_ps(r4, r4), _mm_div_ps(_mm_set1_ps(1.f), r4));
+    for (int i = 0; i < 3; ++i)
+      _mm_storeu_ps(B[i] + x, _mm_mul_ps(_mm_loadu_ps(V[i] + x), r_inv));
+  }
+
+  /** SSE2 computation of B = V / r (0 if r is NaN) for 2 doubles
+   */
+  inline
+  void
+  falsBSSE2(const double* const * V, const double* r, int x, double* const * B)
+  {
+    __m128d r2 = _mm_loadu_pd(r + x);
+    __m128d r_inv = _mm_and_pd(_mm_cmpord_pd(r2, r2), _mm_div_pd(_mm_set1_pd(1.), r2));
+    for (int i = 0; i < 3; ++i)
+      _mm_storeu_pd(B[i] + x, _mm_mul_pd(_mm_loadu_pd(V[i] + x), r_inv));
+  }
+#endif
+
+  /** First pass of FALS::compute: B = V / r on the rows of the range
+   */
+  template<typename T>
+  struct FALSBBody: public cv::ParallelLoopBody
+  {
+    FALSBBody(const cv::Mat_<T>* V, const cv::Mat &r, cv::Mat_<T>* B)
+        :
+          V_(V),
+          r_(r),
+          B_(B)
+    {
+    }
+
+    virtual void
+    operator()(const cv::Range& range) const
+    {
+#if CV_SSE2
+      const bool haveSSE2 = cv::checkHardwareSupport(CV_CPU_SSE2);
+      const int step = 16 / sizeof(T);
+#endif
+      for (int y = range.start; y < range.end; ++y)
+      {
+        const T* V[3] = { V_[0][y], V_[1][y], V_[2][y] };
+        T* B[3] = { B_[0][y], B_[1][y], B_[2][y] };
+        const T* r = r_.ptr<T>(y);
+        int x = 0;
+#if CV_SSE2
+        if (haveSSE2)
+          for (; x <= r_.cols - step; x += step)
+            falsBSSE2(V, r, x, B);
+#endif
+        for (; x < r_.cols; ++x)
+        {
+          T r_inv = cvIsNaN(r[x]) ? 0 : 1 / r[x];
+          for (int i = 0; i < 3; ++i)
+            B[i][x] = V[i][x] * r_inv;
+        }
+      }
+    }
+
+    const cv::Mat_<T>* V_;
+    const cv::Mat &r_;
+    cv::Mat_<T>* B_;
+  };
+
+  /** Second pass of FALS::compute: each stripe of rows box filters its part of B (the rows around the stripe
+   * are the border as for the whole image) and computes the normals M^-1 * B
+   */
+  template<typename T>
+  struct FALSNormalsBody: public cv::ParallelLoopBody
+  {
+    FALSNormalsBody(const cv::Mat_<T>* M_inv, const cv::Mat_<T>* B, const cv::Mat &r, int window_size, int stripe_height,
+                    cv::Mat_<T>* B_filtered, cv::Mat &normals)
+        :
+          M_inv_(M_inv),
+          B_(B),
+          r_(r),
+          window_size_(window_size),
+          stripe_height_(stripe_height),
+          B_filtered_(B_filtered),
+          normals_(normals)
+    {
+    }
+
+    virtual void
+    operator()(const cv::Range& range) const
+    {
+      typedef cv::Vec<T, 3> Vec3T;
+#if CV_SSE2
+      const bool haveSSE2 = cv::checkHardwareSupport(CV_CPU_SSE2);
+      const int step = 16 / sizeof(T);
+#endif
+      const int y_begin = range.start * stripe_height_, y_end = std::min(r_.rows, range.end * stripe_height_);
+      for (int i = 0; i < 3; ++i)
+      {
+        cv::Mat dst = B_filtered_[i].rowRange(y_begin, y_end);
+        cv::boxFilter(B_[i].rowRange(y_begin, y_end), dst, dst.depth(), cv::Size(window_size_, window_size_),
+                      cv::Point(-1, -1), false);
+      }
+
+      for (int y = y_begin; y < y_end; ++y)
+      {
+        const T* M_inv[9];
+        for (int i = 0; i < 9; ++i)
+          M_inv[i] = M_inv_[i][y];
+        const T* B[3] = { B_filtered_[0][y], B_filtered_[1][y], B_filtered_[2][y] };
+        const T* r = r_.ptr<T>(y);
+        Vec3T* normal = normals_.ptr<Vec3T>(y);
+        int x = 0;
+#if CV_SSE2
+        if (haveSSE2)
+          for (; x <= r_.cols - step; x += step)
+            falsNormalsSSE2(M_inv, B, r, x, normal + x);
+#endif
+        for (; x < r_.cols; ++x)
+          falsNormal(M_inv, B, r, x, normal[x]);
+      }
+    }
+
+    const cv::Mat_<T>* M_inv_;
+    const cv::Mat_<T>* B_;
+    const cv::Mat &r_;
+    int window_size_, stripe_height_;
+    cv::Mat_<T>* B_filtered_;
+    cv::Mat &normals_;
   };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -233,39 +556,48 @@ namespace
     virtual void
     cache()
     {
+      cacheRays();
+
       // Compute theta and phi according to equation 3
       cv::Mat cos_theta, sin_theta, cos_phi, sin_phi;
       computeThetaPhi<T>(rows_, cols_, K_, cos_theta, sin_theta, cos_phi, sin_phi);
 
       // Compute all the v_i for every points
-      std::vector<cv::Mat> channels(3);
-      channels[0] = sin_theta.mul(cos_phi);
-      channels[1] = sin_phi;
-      channels[2] = cos_theta.mul(cos_phi);
-      cv::merge(channels, V_);
+      V_[0] = sin_theta.mul(cos_phi);
+      V_[1] = sin_phi;
+      V_[2] = cos_theta.mul(cos_phi);
 
       // Compute M
       cv::Mat_<Vec9T> M(rows_, cols_);
       Mat33T VVt;
-      const Vec3T * vec = V_[0];
-      Vec9T * M_ptr = M[0], *M_ptr_end = M_ptr + rows_ * cols_;
-      for (; M_ptr != M_ptr_end; ++vec, ++M_ptr)
+      for (int y = 0; y < rows_; ++y)
       {
-        VVt = (*vec) * vec->t();
-        *M_ptr = Vec9T(VVt.val);
+        const T *V0 = V_[0][y], *V1 = V_[1][y], *V2 = V_[2][y];
+        Vec9T * M_ptr = M[y];
+        for (int x = 0; x < cols_; ++x)
+        {
+          Vec3T vec(V0[x], V1[x], V2[x]);
+          VVt = vec * vec.t();
+          M_ptr[x] = Vec9T(VVt.val);
+        }
       }
 
       cv::boxFilter(M, M, M.depth(), cv::Size(window_size_, window_size_), cv::Point(-1, -1), false);
 
-      // Compute M's inverse
+      // Compute M's inverse, its coefficients are stored in separate planes for the vectorized product
       Mat33T M_inv;
-      M_inv_.create(rows_, cols_);
-      Vec9T * M_inv_ptr = M_inv_[0];
-      for (M_ptr = &M(0); M_ptr != M_ptr_end; ++M_inv_ptr, ++M_ptr)
+      for (int i = 0; i < 9; ++i)
+        M_inv_[i].create(rows_, cols_);
+      for (int y = 0; y < rows_; ++y)
       {
-        // We have a semi-definite matrix
-        cv::invert(Mat33T(M_ptr->val), M_inv, cv::DECOMP_CHOLESKY);
-        *M_inv_ptr = Vec9T(M_inv.val);
+        const Vec9T * M_ptr = M[y];
+        for (int x = 0; x < cols_; ++x)
+        {
+          // We have a semi-definite matrix
+          cv::invert(Mat33T(M_ptr[x].val), M_inv, cv::DECOMP_CHOLESKY);
+          for (int i = 0; i < 9; ++i)
+            M_inv_[i](y, x) = M_inv.val[i];
+        }
       }
     }
 
@@ -277,41 +609,24 @@ namespace
     compute(const cv::Mat&, const cv::Mat &r, cv::Mat & normals) const
     {
       // Compute B
-      cv::Mat_<Vec3T> B(rows_, cols_);
-
-      const T* row_r = r.ptr < T > (0), *row_r_end = row_r + rows_ * cols_;
-      const Vec3T *row_V = V_[0];
-      Vec3T *row_B = B[0];
-      for (; row_r != row_r_end; ++row_r, ++row_B, ++row_V)
+      cv::Mat_<T> B[3], B_filtered[3];
+      for (int i = 0; i < 3; ++i)
       {
-        if (cvIsNaN(*row_r))
-          *row_B = Vec3T();
-        else
-          *row_B = (*row_V) / (*row_r);
+        B[i].create(rows_, cols_);
+        B_filtered[i].create(rows_, cols_);
       }
+      cv::parallel_for_(cv::Range(0, rows_), FALSBBody<T>(V_, r, B));
 
-      // Apply a box filter to B
-      cv::boxFilter(B, B, B.depth(), cv::Size(window_size_, window_size_), cv::Point(-1, -1), false);
-
-      // compute the Minv*B products
-      row_r = r.ptr < T > (0);
-      const Vec3T * B_vec = B[0];
-      const Mat33T * M_inv = reinterpret_cast<const Mat33T *>(M_inv_.ptr(0));
-      Vec3T *normal = normals.ptr<Vec3T>(0);
-      for (; row_r != row_r_end; ++row_r, ++B_vec, ++normal, ++M_inv)
-        if (cvIsNaN(*row_r))
-        {
-          (*normal)[0] = *row_r;
-          (*normal)[1] = *row_r;
-          (*normal)[2] = *row_r;
-        }
-        else
-          signNormal((*M_inv) * (*B_vec), *normal);
+      // Apply a box filter to B and compute the Minv*B products by stripes of rows
+      const int stripe_height = 16;
+      cv::parallel_for_(cv::Range(0, (rows_ + stripe_height - 1) / stripe_height),
+                        FALSNormalsBody<T>(M_inv_, B, r, window_size_, stripe_height, B_filtered, normals));
     }
 
   private:
-    cv::Mat_<Vec3T> V_;
-    cv::Mat_<Vec9T> M_inv_;
+    // The planes of the v_i and of the inverses of M
+    cv::Mat_<T> V_[3];
+    cv::Mat_<T> M_inv_[9];
   };
 }
 
@@ -336,6 +651,233 @@ multiply_by_K_inv(const cv::Matx<T, 3, 3> & K_inv, U a, U b, U c, cv::Vec<T, 3>
 
 namespace
 {
+  /** The sampled neighborhood of the LINEMOD normals: a square grid around the pixel, with the offsets
+   * of the samples in the depth image and their coordinates (and their products) relative to the pixel
+   */
+  struct LinemodNeighborhood
+  {
+    enum
+    {
+      RADIUS = 5, // used to be 7
+      SAMPLE_STEP = RADIUS,
+      SQUARE_SIZE = 2 * RADIUS / SAMPLE_STEP + 1,
+      SAMPLES = SQUARE_SIZE * SQUARE_SIZE
+    };
+
+    explicit
+    LinemodNeighborhood(size_t depth_step)
+    {
+      for (int j = -RADIUS, index = 0; j <= RADIUS; j += SAMPLE_STEP)
+        for (int i = -RADIUS; i <= RADIUS; i += SAMPLE_STEP, ++index)
+        {
+          x[index] = i;
+          y[index] = j;
+          x_x[index] = i * i;
+          x_y[index] = i * j;
+          y_y[index] = j * j;
+          offsets[index] = j * long(depth_step) + i;
+        }
+    }
+
+    long offsets[SAMPLES];
+    long x[SAMPLES], y[SAMPLES];
+    long x_x[SAMPLES], x_y[SAMPLES], y_y[SAMPLES];
+  };
+
+  /** Solve for the optimal gradient D of equation (8) at the depth pointed by p.
+   * We should divide dx and dy by det, but instead, X1_minus_X and X2_minus_X are multiplied by det
+   * (which does not matter as we normalize the normals). The samples too far in depth are skipped
+   * with selects instead of branches
+   */
+  template<typename DepthDepth, typename ContainerDepth>
+  inline
+  void
+  linemodGradient(const DepthDepth* p, const LinemodNeighborhood& nb, ContainerDepth& dx, ContainerDepth& dy,
+                  long& det)
+  {
+    const ContainerDepth difference_threshold = 50;
+    long A[4];
+    A[0] = A[1] = A[2] = A[3] = 0;
+    ContainerDepth b[2];
+    b[0] = b[1] = 0;
+    for (int i = 0; i < LinemodNeighborhood::SAMPLES; ++i)
+    {
+      // We need to cast to ContainerDepth in case we have unsigned DepthDepth
+      ContainerDepth delta = ContainerDepth(p[nb.offsets[i]]) - ContainerDepth(p[0]);
+      const bool valid = !(std::abs(delta) > difference_threshold);
+      A[0] += valid ? nb.x_x[i] : 0;
+      A[1] += valid ? nb.x_y[i] : 0;
+      A[3] += valid ? nb.y_y[i] : 0;
+      b[0] += valid ? nb.x[i] * delta : ContainerDepth(0);
+      b[1] += valid ? nb.y[i] * delta : ContainerDepth(0);
+    }
+
+    det = A[0] * A[3] - A[1] * A[1];
+    dx = (A[3] * b[0] - A[1] * b[1]);
+    dy = (-A[1] * b[0] + A[0] * b[1]);
+  }
+
+  /** Vectorized linemodGradient for the pixels [x_begin, x_end) of a row, the gradients are written
+   * to dx, dy and det from index 0. Only the CV_16U and CV_32F depths are vectorized.
+   * @return the first pixel left to the scalar version
+   */
+  template<typename DepthDepth>
+  inline
+  int
+  linemodGradientsSSE2(const DepthDepth*, int x_begin, int, const LinemodNeighborhood&, float*, float*, float*)
+  {
+    return x_begin;
+  }
+
+#if CV_SSE2
+  inline
+  __m128
+  linemodLoad4(const float* p)
+  {
+    return _mm_loadu_ps(p);
+  }
+
+  inline
+  __m128
+  linemodLoad4(const unsigned short* p)
+  {
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)),
+                                              _mm_setzero_si128()));
+  }
+
+  /** The depth differences are computed in float: for CV_16U depth, they are integers far below 2^24,
+   * as are the sums and det, dx and dy, so the results are the same as in the integer scalar code.
+   * For CV_32F depth, every lane does the same operations in the same order as the scalar code
+   */
+  template<typename DepthDepth>
+  inline
+  int
+  linemodGradientsFloatSSE2(const DepthDepth* p_line, int x_begin, int x_end, const LinemodNeighborhood& nb,
+                            float* dx, float* dy, float* det)
+  {
+    const __m128 threshold = _mm_set1_ps(50.f);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    int x = x_begin;
+    for (; x <= x_end - 4; x += 4)
+    {
+      const DepthDepth* p = p_line + x;
+      const __m128 d = linemodLoad4(p);
+      __m128 A0 = _mm_setzero_ps(), A1 = _mm_setzero_ps(), A3 = _mm_setzero_ps();
+      __m128 b0 = _mm_setzero_ps(), b1 = _mm_setzero_ps();
+      for (int i = 0; i < LinemodNeighborhood::SAMPLES; ++i)
+      {
+        const __m128 delta = _mm_sub_ps(linemodLoad4(p + nb.offsets[i]), d);
+        // NaN differences are kept as in the scalar version
+        const __m128 valid = _mm_cmpngt_ps(_mm_and_ps(delta, abs_mask), threshold);
+        A0 = _mm_add_ps(A0, _mm_and_ps(valid, _mm_set1_ps(float(nb.x_x[i]))));
+        A1 = _mm_add_ps(A1, _mm_and_ps(valid, _mm_set1_ps(float(nb.x_y[i]))));
+        A3 = _mm_add_ps(A3, _mm_and_ps(valid, _mm_set1_ps(float(nb.y_y[i]))));
+        b0 = _mm_add_ps(b0, _mm_and_ps(valid, _mm_mul_ps(_mm_set1_ps(float(nb.x[i])), delta)));
+        b1 = _mm_add_ps(b1, _mm_and_ps(valid, _mm_mul_ps(_mm_set1_ps(float(nb.y[i])), delta)));
+      }
+      const int k = x - x_begin;
+      _mm_storeu_ps(det + k, _mm_sub_ps(_mm_mul_ps(A0, A3), _mm_mul_ps(A1, A1)));
+      _mm_storeu_ps(dx + k, _mm_sub_ps(_mm_mul_ps(A3, b0), _mm_mul_ps(A1, b1)));
+      _mm_storeu_ps(dy + k, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_setzero_ps(), A1), b0), _mm_mul_ps(A0, b1)));
+    }
+    return x;
+  }
+
+  inline
+  int
+  linemodGradientsSSE2(const unsigned short* p_line, int x_begin, int x_end, const LinemodNeighborhood& nb,
+                       float* dx, float* dy, float* det)
+  {
+    return linemodGradientsFloatSSE2(p_line, x_begin, x_end, nb, dx, dy, det);
+  }
+
+  inline
+  int
+  linemodGradientsSSE2(const float* p_line, int x_begin, int x_end, const LinemodNeighborhood& nb,
+                       float* dx, float* dy, float* det)
+  {
+    return linemodGradientsFloatSSE2(p_line, x_begin, x_end, nb, dx, dy, det);
+  }
+#endif
+
+  /** Compute the normal of pixel (x, y) of depth d from the gradients of linemodGradient
+   */
+  template<typename T, typename DepthDepth, typename ContainerDepth>
+  inline
+  void
+  linemodNormal(const cv::Matx<T, 3, 3> & K_inv, int x, int y, DepthDepth d, ContainerDepth dx, ContainerDepth dy,
+                long det, cv::Vec<T, 3> & normal)
+  {
+    // Compute the dot product
+    //Vec3T X = K_inv * Vec3T(x, y, 1) * depth(y, x);
+    //Vec3T X1 = K_inv * Vec3T(x + 1, y, 1) * (depth(y, x) + dx);
+    //Vec3T X2 = K_inv * Vec3T(x, y + 1, 1) * (depth(y, x) + dy);
+    //Vec3T nor = (X1 - X).cross(X2 - X);
+    cv::Vec<T, 3> X1_minus_X, X2_minus_X;
+    multiply_by_K_inv(K_inv, d * det + (x + 1) * dx, y * dx, dx, X1_minus_X);
+    multiply_by_K_inv(K_inv, x * dy, d * det + (y + 1) * dy, dy, X2_minus_X);
+    signNormal(X1_minus_X.cross(X2_minus_X), normal);
+  }
+
+  /** Compute the LINEMOD normals of a range of rows
+   */
+  template<typename T, typename DepthDepth, typename ContainerDepth>
+  struct LinemodBody: public cv::ParallelLoopBody
+  {
+    LinemodBody(const cv::Mat &depth, const cv::Matx<T, 3, 3> & K_inv, cv::Mat &normals)
+        :
+          depth_(depth),
+          K_inv_(K_inv),
+          neighborhood_(depth.step1()),
+          normals_(normals)
+    {
+    }
+
+    virtual void
+    operator()(const cv::Range& range) const
+    {
+      typedef cv::Vec<T, 3> Vec3T;
+      const int r = LinemodNeighborhood::RADIUS, x_begin = r, x_end = depth_.cols - r - 1;
+      if (x_end <= x_begin)
+        return;
+#if CV_SSE2
+      const bool haveSSE2 = cv::checkHardwareSupport(CV_CPU_SSE2);
+      cv::AutoBuffer<float> buffer(3 * (x_end - x_begin));
+      float *dx_buf = buffer, *dy_buf = dx_buf + (x_end - x_begin), *det_buf = dy_buf + (x_end - x_begin);
+#endif
+      for (int y = range.start; y < range.end; ++y)
+      {
+        const DepthDepth * p_line = depth_.ptr<DepthDepth>(y);
+        Vec3T *normal = normals_.ptr<Vec3T>(y);
+        int x = x_begin;
+#if CV_SSE2
+        if (haveSSE2)
+        {
+          const int x_vec = linemodGradientsSSE2(p_line, x_begin, x_end, neighborhood_, dx_buf, dy_buf, det_buf);
+          for (; x < x_vec; ++x)
+          {
+            const int k = x - x_begin;
+            linemodNormal(K_inv_, x, y, p_line[x], ContainerDepth(dx_buf[k]), ContainerDepth(dy_buf[k]),
+                          long(det_buf[k]), normal[x]);
+          }
+        }
+#endif
+        for (; x < x_end; ++x)
+        {
+          ContainerDepth dx, dy;
+          long det;
+          linemodGradient(p_line + x, neighborhood_, dx, dy, det);
+          linemodNormal(K_inv_, x, y, p_line[x], dx, dy, det, normal[x]);
+        }
+      }
+    }
+
+    const cv::Mat &depth_;
+    cv::Matx<T, 3, 3> K_inv_;
+    LinemodNeighborhood neighborhood_;
+    cv::Mat &normals_;
+  };
+
   /** Given a depth image, compute the normals as detailed in the LINEMOD paper
    * ``Gradient Response Maps for Real-Time Detection of Texture-Less Objects``
    * by S. Hinterstoisser, C. Cagniart, S. Ilic, P. Sturm, N. Navab, P. Fua, and V. Lepetit
@@ -400,26 +942,6 @@ namespace
     cv::Mat
     computeImpl(const cv::Mat_<DepthDepth> &depth, cv::Mat & normals) const
     {
-      const int r = 5; // used to be 7
-      const int sample_step = r;
-      const int square_size = ((2 * r / sample_step) + 1);
-      long offsets[square_size * square_size];
-      long offsets_x[square_size * square_size];
-      long offsets_y[square_size * square_size];
-      long offsets_x_x[square_size * square_size];
-      long offsets_x_y[square_size * square_size];
-      long offsets_y_y[square_size * square_size];
-      for (int j = -r, index = 0; j <= r; j += sample_step)
-        for (int i = -r; i <= r; i += sample_step, ++index)
-        {
-          offsets_x[index] = i;
-          offsets_y[index] = j;
-          offsets_x_x[index] = i*i;
-          offsets_x_y[index] = i*j;
-          offsets_y_y[index] = j*j;
-          offsets[index] = j * cols_ + i;
-        }
-
       // Define K_inv by hand, just for higher accuracy
       Mat33T K_inv = cv::Matx<T, 3, 3>::eye(), K;
       K_.copyTo(K);
@@ -429,58 +951,20 @@ namespace
       K_inv(1, 1) = 1 / K(1, 1);
       K_inv(1, 2) = -K(1, 2) / K(1, 1);
 
-      Vec3T X1_minus_X, X2_minus_X;
-
-      ContainerDepth difference_threshold = 50;
-      for (int y = r; y < rows_ - r - 1; ++y)
+      // The normals closer to the borders than the neighborhood radius are not computed, they are NaN
+      const cv::Scalar nan = cv::Scalar::all(std::numeric_limits<T>::quiet_NaN());
+      const int r = LinemodNeighborhood::RADIUS, y_end = rows_ - r - 1, x_end = cols_ - r - 1;
+      if (y_end <= r || x_end <= r)
       {
-        const DepthDepth * p_line = reinterpret_cast<const DepthDepth*>(depth.ptr(y, r));
-        Vec3T *normal = normals.ptr<Vec3T>(y, r);
-
-        for (int x = r; x < cols_ - r - 1; ++x)
-        {
-          DepthDepth d = p_line[0];
-
-          // accum
-          long A[4];
-          A[0] = A[1] = A[2] = A[3] = 0;
-          ContainerDepth b[2];
-          b[0] = b[1] = 0;
-          for (unsigned int i = 0; i < square_size * square_size; ++i) {
-            // We need to cast to ContainerDepth in case we have unsigned DepthDepth
-            ContainerDepth delta = ContainerDepth(p_line[offsets[i]]) - ContainerDepth(d);
-            if (std::abs(delta) > difference_threshold)
-               continue;
-
-             A[0] += offsets_x_x[i];
-             A[1] += offsets_x_y[i];
-             A[3] += offsets_y_y[i];
-             b[0] += offsets_x[i] * delta;
-             b[1] += offsets_y[i] * delta;
-          }
-
-          // solve for the optimal gradient D of equation (8)
-          long det = A[0] * A[3] - A[1] * A[1];
-          // We should divide the following two by det, but instead, we multiply
-          // X1_minus_X and X2_minus_X by det (which does not matter as we normalize the normals)
-          // Therefore, no division is done: this is only for speedup
-          ContainerDepth dx = (A[3] * b[0] - A[1] * b[1]);
-          ContainerDepth dy = (-A[1] * b[0] + A[0] * b[1]);
-
-          // Compute the dot product
-          //Vec3T X = K_inv * Vec3T(x, y, 1) * depth(y, x);
-          //Vec3T X1 = K_inv * Vec3T(x + 1, y, 1) * (depth(y, x) + dx);
-          //Vec3T X2 = K_inv * Vec3T(x, y + 1, 1) * (depth(y, x) + dy);
-          //Vec3T nor = (X1 - X).cross(X2 - X);
-          multiply_by_K_inv(K_inv, d * det + (x + 1) * dx, y * dx, dx, X1_minus_X);
-          multiply_by_K_inv(K_inv, x * dy, d * det + (y + 1) * dy, dy, X2_minus_X);
-          Vec3T nor = X1_minus_X.cross(X2_minus_X);
-          signNormal(nor, *normal);
-
-          ++p_line;
-          ++normal;
-        }
+        normals.setTo(nan);
+        return normals;
       }
+      normals.rowRange(0, r).setTo(nan);
+      normals.rowRange(y_end, rows_).setTo(nan);
+      normals(cv::Range(r, y_end), cv::Range(0, r)).setTo(nan);
+      normals(cv::Range(r, y_end), cv::Range(x_end, cols_)).setTo(nan);
+
+      cv::parallel_for_(cv::Range(r, y_end), LinemodBody<T, DepthDepth, ContainerDepth>(depth, K_inv, normals));
 
       return normals;
     }
@@ -518,6 +1002,8 @@ namespace
     virtual void
     cache()
     {
+      cacheRays();
+
       cv::Mat_<T> cos_theta, sin_theta, cos_phi, sin_phi;
       computeThetaPhi<T>(rows_, cols_, K_, cos_theta, sin_theta, cos_phi, sin_phi);
 
@@ -593,11 +1079,11 @@ namespace
      * @return
      */
     virtual void
-    compute(const cv::Mat& points3d, const cv::Mat &r, cv::Mat & normals) const
+    compute(const cv::Mat&, const cv::Mat &r, cv::Mat & normals) const
     {
+      // only the radius is used, the points can be empty when it comes from a depth image
       const cv::Mat_<T>& r_T(r);
-      const cv::Mat_<Vec3T> &points3d_T(points3d);
-      compute(points3d_T, r_T, normals);
+      compute(cv::Mat_<Vec3T>(), r_T, normals);
     }
 
     /** Compute the normals
@@ -671,6 +1157,375 @@ namespace
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+namespace
+{
+  /** Sums of the valid points of an image region: count, x, y, z, xx, xy, xz, yy, yz, zz
+   */
+  typedef cv::Vec<double, 10> PointSums;
+
+  /** Add a point to the sums
+   */
+  inline
+  void
+  addPoint(double px, double py, double pz, PointSums & s)
+  {
+    s[0] += 1;
+    s[1] += px;
+    s[2] += py;
+    s[3] += pz;
+    s[4] += px * px;
+    s[5] += px * py;
+    s[6] += px * pz;
+    s[7] += py * py;
+    s[8] += py * pz;
+    s[9] += pz * pz;
+  }
+
+  /** First pass of the integral image: the prefix sums of the points along the rows
+   */
+  template<typename T>
+  struct IntegralRowsBody: public cv::ParallelLoopBody
+  {
+    IntegralRowsBody(const cv::Mat &points3d, cv::Mat &integral)
+        :
+          points3d_(points3d),
+          integral_(integral)
+    {
+    }
+
+    virtual void
+    operator()(const cv::Range& range) const
+    {
+      typedef cv::Vec<T, 3> Vec3T;
+      for (int y = range.start; y < range.end; ++y)
+      {
+        const Vec3T * point = points3d_.ptr<Vec3T>(y);
+        PointSums * sums = integral_.ptr<PointSums>(y + 1);
+        sums[0] = PointSums();
+        for (int x = 0; x < points3d_.cols; ++x)
+        {
+          sums[x + 1] = sums[x];
+          if (!cvIsNaN(point[x][2]))
+            addPoint(point[x][0], point[x][1], point[x][2], sums[x + 1]);
+        }
+      }
+    }
+
+    const cv::Mat &points3d_;
+    cv::Mat &integral_;
+  };
+
+  /** Same as IntegralRowsBody but the points are built on the fly from a depth image and the rays of the pixels
+   */
+  template<typename DepthT>
+  struct IntegralDepthRowsBody: public cv::ParallelLoopBody
+  {
+    IntegralDepthRowsBody(const cv::Mat &depth, const cv::Mat &rays_x, const cv::Mat &rays_y, cv::Mat &integral)
+        :
+          depth_(depth),
+          rays_x_(rays_x),
+          rays_y_(rays_y),
+          integral_(integral)
+    {
+    }
+
+    virtual void
+    operator()(const cv::Range& range) const
+    {
+      const double * ray_x = rays_x_.ptr<double>(0);
+      for (int y = range.start; y < range.end; ++y)
+      {
+        const DepthT * depth = depth_.ptr<DepthT>(y);
+        const double ray_y = rays_y_.at<double>(y, 0);
+        PointSums * sums = integral_.ptr<PointSums>(y + 1);
+        sums[0] = PointSums();
+        for (int x = 0; x < depth_.cols; ++x)
+        {
+          sums[x + 1] = sums[x];
+          const double z = depthInMeters<double>(depth[x]);
+          if (!cvIsNaN(z))
+            addPoint(ray_x[x] * z, ray_y * z, z, sums[x + 1]);
+        }
+      }
+    }
+
+    const cv::Mat &depth_;
+    const cv::Mat &rays_x_, &rays_y_;
+    cv::Mat &integral_;
+  };
+
+  /** Second pass of the integral image: the sums along the columns, each thread takes a range of columns
+   */
+  struct IntegralColsBody: public cv::ParallelLoopBody
+  {
+    IntegralColsBody(cv::Mat &integral)
+        :
+          integral_(integral)
+    {
+    }
+
+    virtual void
+    operator()(const cv::Range& range) const
+    {
+      for (int y = 2; y < integral_.rows; ++y)
+      {
+        const PointSums * prev = integral_.ptr<PointSums>(y - 1);
+        PointSums * sums = integral_.ptr<PointSums>(y);
+        for (int x = range.start; x < range.end; ++x)
+          sums[x] += prev[x];
+      }
+    }
+
+    cv::Mat &integral_;
+  };
+
+  /** Compute the eigenvector of the smallest eigenvalue of a symmetric 3x3 matrix in closed form
+   * (the trigonometric solution of the characteristic equation, then the largest cross product
+   * of two rows of C - lambda * I)
+   * @return false if the matrix is isotropic and the eigenvector is not defined
+   */
+  inline
+  bool
+  smallestEigenVector(const cv::Matx33d & C_in, cv::Vec3d & vec)
+  {
+    double scale = 0;
+    for (int i = 0; i < 9; ++i)
+      scale = std::max(scale, std::abs(C_in.val[i]));
+    if (scale <= 0)
+      return false;
+    cv::Matx33d C = C_in * (1 / scale);
+
+    const double m = (C(0, 0) + C(1, 1) + C(2, 2)) / 3;
+    cv::Matx33d D = C - m * cv::Matx33d::eye();
+    const double p = (D(0, 0) * D(0, 0) + D(1, 1) * D(1, 1) + D(2, 2) * D(2, 2)
+                      + 2 * (D(0, 1) * D(0, 1) + D(0, 2) * D(0, 2) + D(1, 2) * D(1, 2))) / 6;
+    if (p < std::numeric_limits<double>::epsilon())
+      return false;
+    const double q = cv::determinant(D) / 2;
+    const double phi = std::acos(std::max(-1., std::min(1., q / (p * std::sqrt(p))))) / 3;
+    const double lambda = m + 2 * std::sqrt(p) * std::cos(phi + 2 * CV_PI / 3);
+
+    const cv::Vec3d r0(C(0, 0) - lambda, C(0, 1), C(0, 2));
+    const cv::Vec3d r1(C(1, 0), C(1, 1) - lambda, C(1, 2));
+    const cv::Vec3d r2(C(2, 0), C(2, 1), C(2, 2) - lambda);
+    const cv::Vec3d c01 = r0.cross(r1), c02 = r0.cross(r2), c12 = r1.cross(r2);
+    const double n01 = c01.dot(c01), n02 = c02.dot(c02), n12 = c12.dot(c12);
+    if (n01 >= n02 && n01 >= n12)
+      vec = c01;
+    else if (n02 >= n12)
+      vec = c02;
+    else
+      vec = c12;
+    return vec.dot(vec) > 0;
+  }
+
+  /** Third pass: the covariance of the points of the window around every pixel from the integral image,
+   * its smallest eigenvector is the normal
+   */
+  template<typename T>
+  struct IntegralNormalsBody: public cv::ParallelLoopBody
+  {
+    IntegralNormalsBody(const cv::Mat &integral, int window_size, cv::Mat &normals)
+        :
+          integral_(integral),
+          window_size_(window_size),
+          normals_(normals)
+    {
+    }
+
+    virtual void
+    operator()(const cv::Range& range) const
+    {
+      typedef cv::Vec<T, 3> Vec3T;
+      const int half = window_size_ / 2, rows = integral_.rows - 1, cols = integral_.cols - 1;
+      const T nan = std::numeric_limits<T>::quiet_NaN();
+      for (int y = range.start; y < range.end; ++y)
+      {
+        const int y0 = std::max(0, y - half), y1 = std::min(rows, y + half + 1);
+        const PointSums * sums0 = integral_.ptr<PointSums>(y0), *sums1 = integral_.ptr<PointSums>(y1);
+        const PointSums * row0 = integral_.ptr<PointSums>(y), *row1 = integral_.ptr<PointSums>(y + 1);
+        Vec3T * normal = normals_.ptr<Vec3T>(y);
+        for (int x = 0; x < cols; ++x)
+        {
+          normal[x] = Vec3T(nan, nan, nan);
+          // the pixel itself has a point if the count of its own cell is 1
+          if (row1[x + 1][0] - row1[x][0] - row0[x + 1][0] + row0[x][0] < 0.5)
+            continue;
+
+          const int x0 = std::max(0, x - half), x1 = std::min(cols, x + half + 1);
+          const PointSums s = sums1[x1] - sums1[x0] - sums0[x1] + sums0[x0];
+          // a plane needs 3 points
+          if (s[0] < 3)
+            continue;
+
+          const double count_inv = 1 / s[0];
+          const cv::Vec3d mean(s[1] * count_inv, s[2] * count_inv, s[3] * count_inv);
+          const cv::Matx33d C(s[4] * count_inv - mean[0] * mean[0], s[5] * count_inv - mean[0] * mean[1],
+                              s[6] * count_inv - mean[0] * mean[2], s[5] * count_inv - mean[0] * mean[1],
+                              s[7] * count_inv - mean[1] * mean[1], s[8] * count_inv - mean[1] * mean[2],
+                              s[6] * count_inv - mean[0] * mean[2], s[8] * count_inv - mean[1] * mean[2],
+                              s[9] * count_inv - mean[2] * mean[2]);
+          cv::Vec3d vec;
+          if (smallestEigenVector(C, vec))
+            signNormal<T>(T(vec[0]), T(vec[1]), T(vec[2]), normal[x]);
+        }
+      }
+    }
+
+    const cv::Mat &integral_;
+    int window_size_;
+    cv::Mat &normals_;
+  };
+
+  /** Given a set of 3d points in a depth image, compute the normals at each point as the smallest eigenvector
+   * of the covariance of the points in the window around it, as the COVARIANCE_MATRIX method of
+   * PCL's IntegralImageNormalEstimation. The sums of the points and of their products are read
+   * from an integral image, so the cost per point does not depend on the window size.
+   * The integral image is (rows + 1) x (cols + 1) x 10 doubles (about 25 MB for 640x480), so it is kept
+   * between the calls instead of being allocated by each of them.
+   */
+  template<typename T>
+  class INTEGRAL: public RgbdNormalsImpl
+  {
+  public:
+    INTEGRAL(int rows, int cols, int window_size, int depth, const cv::Mat &K,
+             cv::RgbdNormals::RGBD_NORMALS_METHOD method)
+        :
+          RgbdNormalsImpl(rows, cols, window_size, depth, K, method)
+    {
+    }
+
+    /** Compute cached data
+     */
+    virtual void
+    cache()
+    {
+      cacheRays();
+    }
+
+    /** Compute the normals
+     * @param points3d the 3d points or a depth image
+     * @param normals the normals
+     */
+    void
+    compute(const cv::Mat &points3d, cv::Mat & normals) const
+    {
+      // The implementation is shared by the RgbdNormals with the same parameters, which may compute normals
+      // concurrently: the one that doesn't get the kept integral image uses its own
+      if (!integral_mutex_.trylock())
+      {
+        cv::Mat integral;
+        compute(points3d, integral, normals);
+        return;
+      }
+
+      try
+      {
+        compute(points3d, integral_, normals);
+      }
+      catch (...)
+      {
+        integral_mutex_.unlock();
+        throw;
+      }
+      integral_mutex_.unlock();
+    }
+
+  private:
+    void
+    compute(const cv::Mat &points3d, cv::Mat &integral, cv::Mat & normals) const
+    {
+      // the integral image is accumulated in double, the point coordinates are far from the origin
+      integral.create(rows_ + 1, cols_ + 1, CV_64FC(10));
+      std::fill(integral.ptr<PointSums>(0), integral.ptr<PointSums>(0) + cols_ + 1, PointSums());
+
+      cv::Range rows(0, rows_);
+      if (points3d.channels() == 3)
+        cv::parallel_for_(rows, IntegralRowsBody<T>(points3d, integral));
+      else if (points3d.depth() == CV_16U)
+        cv::parallel_for_(rows, IntegralDepthRowsBody<unsigned short>(points3d, rays_x_, rays_y_, integral));
+      else if (points3d.depth() == CV_32F)
+        cv::parallel_for_(rows, IntegralDepthRowsBody<float>(points3d, rays_x_, rays_y_, integral));
+      else
+        cv::parallel_for_(rows, IntegralDepthRowsBody<double>(points3d, rays_x_, rays_y_, integral));
+      cv::parallel_for_(cv::Range(1, cols_ + 1), IntegralColsBody(integral));
+      cv::parallel_for_(rows, IntegralNormalsBody<T>(integral, window_size_, normals));
+    }
+
+    mutable cv::Mat integral_;
+    mutable cv::Mutex integral_mutex_;
+  };
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+  /** The normals implementations only hold the data cached for their parameters and are not modified when
+   * computing normals, so all the RgbdNormals of the process with the same rows, cols, depth, K, window size
+   * and method share one of them (e.g. the odometries and the capture servers working on the same camera).
+   * The entries are reference counted and deleted with their last user.
+   */
+  struct NormalsImplCacheEntry
+  {
+    RgbdNormalsImpl * impl;
+    int refcount;
+  };
+
+  /** The cache and its mutex are never destroyed, so that the RgbdNormals destroyed after the static objects
+   * of this file can still release their implementation
+   */
+  cv::Mutex &
+  normalsImplCacheMutex()
+  {
+    static cv::Mutex * mutex = new cv::Mutex;
+    return *mutex;
+  }
+
+  std::vector<NormalsImplCacheEntry> &
+  normalsImplCache()
+  {
+    static std::vector<NormalsImplCacheEntry> * cache = new std::vector<NormalsImplCacheEntry>;
+    return *cache;
+  }
+
+  /** The function-local statics are not thread safe to initialize before C++11, so they are initialized
+   * with the static objects of this file, before any thread can use them
+   */
+  struct NormalsImplCacheInitializer
+  {
+    NormalsImplCacheInitializer()
+    {
+      normalsImplCacheMutex();
+      normalsImplCache();
+    }
+  } normals_impl_cache_initializer;
+
+  /** Release an implementation obtained from the cache
+   */
+  void
+  releaseNormalsImpl(void *rgbd_normals_impl)
+  {
+    if (rgbd_normals_impl == 0)
+      return;
+    cv::AutoLock lock(normalsImplCacheMutex());
+    std::vector<NormalsImplCacheEntry> & cache = normalsImplCache();
+    for (size_t i = 0; i < cache.size(); ++i)
+    {
+      if (cache[i].impl != reinterpret_cast<RgbdNormalsImpl *>(rgbd_normals_impl))
+        continue;
+      if (--cache[i].refcount == 0)
+      {
+        delete cache[i].impl;
+        cache.erase(cache.begin() + i);
+      }
+      return;
+    }
+    // called from the destructor, so it can't throw: every implementation comes from the cache
+    CV_DbgAssert(false);
+  }
+}
+
 namespace cv
 {
   /** Default constructor of the Algorithm class that computes normals
@@ -689,44 +1544,11 @@ namespace cv
     CV_Assert(K_.cols == 3 && K_.rows == 3);
   }
 
-  void delete_normals_impl(void *rgbd_normals_impl_, int method_, int depth)
-  {
-    if (rgbd_normals_impl_ == 0)
-      return;
-    switch (method_)
-    {
-      case RgbdNormals::RGBD_NORMALS_METHOD_LINEMOD:
-      {
-        if (depth == CV_32F)
-          delete reinterpret_cast<const LINEMOD<float> *>(rgbd_normals_impl_);
-        else
-          delete reinterpret_cast<const LINEMOD<double> *>(rgbd_normals_impl_);
-        break;
-      }
-      case RgbdNormals::RGBD_NORMALS_METHOD_SRI:
-      {
-        if (depth == CV_32F)
-          delete reinterpret_cast<const SRI<float> *>(rgbd_normals_impl_);
-        else
-          delete reinterpret_cast<const SRI<double> *>(rgbd_normals_impl_);
-        break;
-      }
-      case (RgbdNormals::RGBD_NORMALS_METHOD_FALS):
-      {
-        if (depth == CV_32F)
-          delete reinterpret_cast<const FALS<float> *>(rgbd_normals_impl_);
-        else
-          delete reinterpret_cast<const FALS<double> *>(rgbd_normals_impl_);
-        break;
-      }
-    }
-  }
-
   /** Destructor
    */
   RgbdNormals::~RgbdNormals()
   {
-    delete_normals_impl(rgbd_normals_impl_, method_, depth_);
+    releaseNormalsImpl(rgbd_normals_impl_);
   }
 
   void
@@ -734,11 +1556,28 @@ namespace cv
                                        int method) const
   {
     CV_Assert(rows > 0 && cols > 0 && (depth == CV_32F || depth == CV_64F));
-    CV_Assert(window_size == 1 || window_size == 3 || window_size == 5 || window_size == 7);
+    // the cost of the integral image method does not depend on the window size, so any odd one is fine
+    if (method == RGBD_NORMALS_METHOD_INTEGRAL)
+      CV_Assert(window_size >= 3 && window_size % 2 == 1);
+    else
+      CV_Assert(window_size == 1 || window_size == 3 || window_size == 5 || window_size == 7);
     CV_Assert(K_.cols == 3 && K.rows == 3 && (K.depth() == CV_32F || K.depth() == CV_64F));
     CV_Assert(
         method == RGBD_NORMALS_METHOD_FALS || method == RGBD_NORMALS_METHOD_LINEMOD
-        || method == RGBD_NORMALS_METHOD_SRI);
+        || method == RGBD_NORMALS_METHOD_SRI || method == RGBD_NORMALS_METHOD_INTEGRAL);
+
+    // Share the cached data of another RgbdNormals with the same parameters if any. The lock is kept while
+    // caching a new implementation so that it is only computed once
+    cv::AutoLock lock(normalsImplCacheMutex());
+    std::vector<NormalsImplCacheEntry> & cache = normalsImplCache();
+    for (size_t i = 0; i < cache.size(); ++i)
+      if (cache[i].impl->validate(rows, cols, depth, K, window_size, method))
+      {
+        ++cache[i].refcount;
+        rgbd_normals_impl_ = cache[i].impl;
+        return;
+      }
+
     switch (method)
     {
       case (RGBD_NORMALS_METHOD_FALS):
@@ -765,9 +1604,29 @@ namespace cv
           rgbd_normals_impl_ = new SRI<double>(rows, cols, window_size, depth, K, RGBD_NORMALS_METHOD_SRI);
         break;
       }
+      case RGBD_NORMALS_METHOD_INTEGRAL:
+      {
+        if (depth == CV_32F)
+          rgbd_normals_impl_ = new INTEGRAL<float>(rows, cols, window_size, depth, K, RGBD_NORMALS_METHOD_INTEGRAL);
+        else
+          rgbd_normals_impl_ = new INTEGRAL<double>(rows, cols, window_size, depth, K, RGBD_NORMALS_METHOD_INTEGRAL);
+        break;
+      }
     }
 
     reinterpret_cast<RgbdNormalsImpl *>(rgbd_normals_impl_)->cache();
+
+    NormalsImplCacheEntry entry;
+    entry.impl = reinterpret_cast<RgbdNormalsImpl *>(rgbd_normals_impl_);
+    entry.refcount = 1;
+    cache.push_back(entry);
+  }
+
+  int
+  RgbdNormals::shared_impls_count()
+  {
+    cv::AutoLock lock(normalsImplCacheMutex());
+    return static_cast<int>(normalsImplCache().size());
   }
 
   /** Initializes some data that is cached for later computation
@@ -780,13 +1639,15 @@ namespace cv
       initialize_normals_impl(rows_, cols_, depth_, K_, window_size_, method_);
     else if (!reinterpret_cast<RgbdNormalsImpl *>(rgbd_normals_impl_)->validate(rows_, cols_, depth_, K_, window_size_,
                                                                                 method_)) {
-      delete_normals_impl(rgbd_normals_impl_, method_, depth_);
+      releaseNormalsImpl(rgbd_normals_impl_);
+      rgbd_normals_impl_ = 0;
       initialize_normals_impl(rows_, cols_, depth_, K_, window_size_, method_);
     }
   }
 
   /** Given a set of 3d points in a depth image, compute the normals at each point
-   * @param points3d_in depth a float depth image. Or it can be rows x cols x 3 is they are 3d points
+   * @param points3d_in depth a CV_16U depth image in millimeters or a CV_32F/CV_64F one in meters.
+   *        Or it can be rows x cols x 3 is they are 3d points
    * @param normals a rows x cols x 3 matrix
    */
   void
@@ -795,34 +1656,30 @@ namespace cv
     cv::Mat points3d_ori = points3d_in.getMat();
 
     CV_Assert(points3d_ori.dims == 2);
-    // Either we have 3d points or a depth image
-    switch (method_)
-    {
-      case (RGBD_NORMALS_METHOD_FALS):
-      {
-        CV_Assert(points3d_ori.channels() == 3);
-        CV_Assert(points3d_ori.depth() == CV_32F || points3d_ori.depth() == CV_64F);
-        break;
-      }
-      case RGBD_NORMALS_METHOD_LINEMOD:
-      {
-        CV_Assert(
-            ((points3d_ori.channels() == 3) && (points3d_ori.depth() == CV_32F || points3d_ori.depth() == CV_64F)) || ((points3d_ori.channels() == 1) && (points3d_ori.depth() == CV_16U || points3d_ori.depth() == CV_32F || points3d_ori.depth() == CV_64F)));
-        break;
-      }
-      case RGBD_NORMALS_METHOD_SRI:
-      {
-        CV_Assert( ((points3d_ori.channels() == 3) && (points3d_ori.depth() == CV_32F || points3d_ori.depth() == CV_64F)));
-        break;
-      }
-    }
+    // Either we have 3d points or a depth image, for all the methods
+    CV_Assert(
+        ((points3d_ori.channels() == 3) && (points3d_ori.depth() == CV_32F || points3d_ori.depth() == CV_64F)) || ((points3d_ori.channels() == 1) && (points3d_ori.depth() == CV_16U || points3d_ori.depth() == CV_32F || points3d_ori.depth() == CV_64F)));
+    const bool is_depth = points3d_ori.channels() == 1;
 
     // Initialize the pimpl
     initialize();
 
     // Precompute something for RGBD_NORMALS_METHOD_SRI and RGBD_NORMALS_METHOD_FALS
     cv::Mat points3d, radius;
-    if ((method_ == RGBD_NORMALS_METHOD_SRI) || (method_ == RGBD_NORMALS_METHOD_FALS))
+    if (method_ == RGBD_NORMALS_METHOD_INTEGRAL)
+    {
+      // a depth image is read as is, its points are built on the fly
+      if (points3d_ori.depth() == depth_ || is_depth)
+        points3d = points3d_ori;
+      else
+        points3d_ori.convertTo(points3d, depth_);
+    }
+    else if (((method_ == RGBD_NORMALS_METHOD_SRI) || (method_ == RGBD_NORMALS_METHOD_FALS)) && is_depth)
+    {
+      // Both methods only need the distance to the points, get it from the rays without the 3d points
+      reinterpret_cast<const RgbdNormalsImpl *>(rgbd_normals_impl_)->computeRadiusFromDepth(points3d_ori, radius);
+    }
+    else if ((method_ == RGBD_NORMALS_METHOD_SRI) || (method_ == RGBD_NORMALS_METHOD_FALS))
     {
       // Make the points have the right depth
       if (points3d_ori.depth() == depth_)
@@ -880,6 +1737,14 @@ namespace cv
           reinterpret_cast<const SRI<double> *>(rgbd_normals_impl_)->compute(points3d, radius, normals);
         break;
       }
+      case RGBD_NORMALS_METHOD_INTEGRAL:
+      {
+        if (depth_ == CV_32F)
+          reinterpret_cast<const INTEGRAL<float> *>(rgbd_normals_impl_)->compute(points3d, normals);
+        else
+          reinterpret_cast<const INTEGRAL<double> *>(rgbd_normals_impl_)->compute(points3d, normals);
+        break;
+      }
     }
   }
 }
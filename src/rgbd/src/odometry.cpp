@@ -34,6 +34,7 @@
  */
 
 #include "opencv2/core/core.hpp"
+#include "opencv2/core/internal.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/calib3d/calib3d.hpp"
 #include "opencv2/highgui/highgui.hpp"
@@ -41,6 +42,7 @@
 
 #include <iostream>
 #include <limits>
+#include <map>
 
 #if defined(HAVE_EIGEN) && EIGEN_WORLD_VERSION == 3
 #define HAVE_EIGEN3_HERE
@@ -76,7 +78,7 @@ void setDefaultMinGradientMagnitudes(Mat& minGradientMagnitudes)
 }
 
 static
-void buildPyramidCameraMatrix(const Mat& cameraMatrix, int levels, vector<Mat>& pyramidCameraMatrix)
+void buildPyramidCameraMatrix(const Mat& cameraMatrix, int levels, double pyramidScale, vector<Mat>& pyramidCameraMatrix)
 {
     pyramidCameraMatrix.resize(levels);
 
@@ -85,12 +87,38 @@ void buildPyramidCameraMatrix(const Mat& cameraMatrix, int levels, vector<Mat>&
 
     for(int i = 0; i < levels; i++)
     {
-        Mat levelCameraMatrix = i == 0 ? cameraMatrix_dbl : 0.5f * pyramidCameraMatrix[i-1];
+        Mat levelCameraMatrix = i == 0 ? cameraMatrix_dbl : (1. / pyramidScale) * pyramidCameraMatrix[i-1];
         levelCameraMatrix.at<double>(2,2) = 1.;
         pyramidCameraMatrix[i] = levelCameraMatrix;
     }
 }
 
+static inline
+void checkMaxDepthDiffs(const Mat& maxDepthDiffs, const Mat& iterCounts)
+{
+    if(maxDepthDiffs.empty())
+        return;
+    CV_Assert(maxDepthDiffs.type() == CV_32FC1);
+    CV_Assert(maxDepthDiffs.size() == iterCounts.size() || maxDepthDiffs.size() == iterCounts.t().size());
+}
+
+static inline
+void checkPyramidParams(double pyramidScale, int depthDownsampling)
+{
+    CV_Assert(pyramidScale > 1.);
+    CV_Assert(depthDownsampling == Odometry::DEPTH_DOWNSAMPLING_GAUSSIAN ||
+              depthDownsampling == Odometry::DEPTH_DOWNSAMPLING_NEAREST_VALID ||
+              depthDownsampling == Odometry::DEPTH_DOWNSAMPLING_MEDIAN);
+}
+
+static inline
+void checkRobustKernel(int robustKernel)
+{
+    CV_Assert(robustKernel == Odometry::ROBUST_KERNEL_SIGMA || robustKernel == Odometry::ROBUST_KERNEL_NONE ||
+              robustKernel == Odometry::ROBUST_KERNEL_HUBER || robustKernel == Odometry::ROBUST_KERNEL_TUKEY ||
+              robustKernel == Odometry::ROBUST_KERNEL_CAUCHY);
+}
+
 static inline
 void checkImage(const Mat& image)
 {
@@ -132,144 +160,283 @@ void checkNormals(const Mat& normals, const Size& depthSize)
         CV_Error(CV_StsBadSize, "Normals type has to be CV_32FC3.");
 }
 
-static
-void preparePyramidImage(const Mat& image, vector<Mat>& pyramidImage, size_t levelCount)
+static inline
+bool isLevelReady(const vector<Mat>& pyramid, size_t level)
 {
-    if(!pyramidImage.empty())
-    {
-        if(pyramidImage.size() < levelCount)
-            CV_Error(CV_StsBadSize, "Levels count of pyramidImage has to be equal or less than size of iterCounts.");
+    return level < pyramid.size() && !pyramid[level].empty();
+}
 
-        CV_Assert(pyramidImage[0].size() == image.size());
-        for(size_t i = 0; i < pyramidImage.size(); i++)
-            CV_Assert(pyramidImage[i].type() == image.type());
-    }
-    else
-        buildPyramid(image, pyramidImage, levelCount - 1);
+/* The pixel u of a pyramid level is sampled at u * pyramidScale of the previous level,
+ * as pyrDown does for the scale 2, so the camera matrix of the level is scaled by 1 / pyramidScale.
+ */
+static inline
+Size pyramidLevelSize(const Size& size, double pyramidScale)
+{
+    return Size(static_cast<int>((size.width - 1) / pyramidScale) + 1,
+                static_cast<int>((size.height - 1) / pyramidScale) + 1);
 }
 
 static
-void preparePyramidDepth(const Mat& depth, vector<Mat>& pyramidDepth, size_t levelCount)
+void pyrDownLevel(const Mat& src, Mat& dst, double pyramidScale)
 {
-    if(!pyramidDepth.empty())
+    if(pyramidScale == 2.)
     {
-        if(pyramidDepth.size() < levelCount)
-            CV_Error(CV_StsBadSize, "Levels count of pyramidDepth has to be equal or less than size of iterCounts.");
-
-        CV_Assert(pyramidDepth[0].size() == depth.size());
-        for(size_t i = 0; i < pyramidDepth.size(); i++)
-            CV_Assert(pyramidDepth[i].type() == depth.type());
+        pyrDown(src, dst);
+        return;
     }
-    else
-        buildPyramid(depth, pyramidDepth, levelCount - 1);
+
+    // the kernel of pyrDown is close to the Gaussian with sigma 1 for the scale 2
+    Mat blurred;
+    const double sigma = 0.5 * pyramidScale;
+    GaussianBlur(src, blurred, Size(), sigma, sigma, BORDER_REFLECT_101);
+    const Matx23d M(1. / pyramidScale, 0., 0.,
+                    0., 1. / pyramidScale, 0.);
+    warpAffine(blurred, dst, M, pyramidLevelSize(src.size(), pyramidScale), INTER_LINEAR, BORDER_REPLICATE);
 }
 
+/* The depth-aware downsampling takes the depth of a level pixel from the valid (positive) depths
+ * of the previous level in the window of the radius pyramidScale/2 around the sampled position,
+ * so the foreground and the background depths are not mixed on the edges as the Gaussian does.
+ */
 static
-void preparePyramidMask(const Mat& mask, const vector<Mat>& pyramidDepth, float minDepth, float maxDepth,
-                        const vector<Mat>& pyramidNormal,
-                        vector<Mat>& pyramidMask)
+void pyrDownDepthLevel(const Mat& src, Mat& dst, double pyramidScale, int depthDownsampling)
 {
-    minDepth = std::max(0.f, minDepth);
-
-    if(!pyramidMask.empty())
+    if(depthDownsampling == Odometry::DEPTH_DOWNSAMPLING_GAUSSIAN)
     {
-        if(pyramidMask.size() != pyramidDepth.size())
-            CV_Error(CV_StsBadSize, "Levels count of pyramidMask has to be equal to size of pyramidDepth.");
-
-        for(size_t i = 0; i < pyramidMask.size(); i++)
-        {
-            CV_Assert(pyramidMask[i].size() == pyramidDepth[i].size());
-            CV_Assert(pyramidMask[i].type() == CV_8UC1);
-        }
+        pyrDownLevel(src, dst, pyramidScale);
+        return;
     }
-    else
-    {
-        Mat validMask;
-        if(mask.empty())
-            validMask = Mat(pyramidDepth[0].size(), CV_8UC1, Scalar(255));
-        else
-            validMask = mask.clone();
 
-        buildPyramid(validMask, pyramidMask, pyramidDepth.size() - 1);
+    CV_Assert(src.type() == CV_32FC1);
 
-        for(size_t i = 0; i < pyramidMask.size(); i++)
+    const int radius = std::max(1, cvRound(0.5 * pyramidScale));
+    const Size dstSize = pyramidLevelSize(src.size(), pyramidScale);
+    Mat levelDepth(dstSize, CV_32FC1);
+    vector<float> values((2 * radius + 1) * (2 * radius + 1));
+    for(int v = 0; v < dstSize.height; v++)
+    {
+        const double sv = v * pyramidScale;
+        const int yBegin = std::max(0, cvRound(sv) - radius), yEnd = std::min(src.rows, cvRound(sv) + radius + 1);
+        float *depth_row = levelDepth.ptr<float>(v);
+        for(int u = 0; u < dstSize.width; u++)
         {
-            Mat levelDepth = pyramidDepth[i].clone();
-            patchNaNs(levelDepth, 0);
+            const double su = u * pyramidScale;
+            const int xBegin = std::max(0, cvRound(su) - radius), xEnd = std::min(src.cols, cvRound(su) + radius + 1);
 
-            Mat& levelMask = pyramidMask[i];
-            levelMask &= (levelDepth > minDepth) & (levelDepth < maxDepth);
-
-            if(!pyramidNormal.empty())
+            int count = 0;
+            float nearestDepth = std::numeric_limits<float>::quiet_NaN();
+            double nearestDist = DBL_MAX;
+            for(int y = yBegin; y < yEnd; y++)
             {
-                CV_Assert(pyramidNormal[i].type() == CV_32FC3);
-                CV_Assert(pyramidNormal[i].size() == pyramidDepth[i].size());
-                Mat levelNormal = pyramidNormal[i].clone();
-
-                Mat validNormalMask = levelNormal == levelNormal; // otherwise it's Nan
-                CV_Assert(validNormalMask.type() == CV_8UC3);
+                const float *src_row = src.ptr<float>(y);
+                for(int x = xBegin; x < xEnd; x++)
+                {
+                    const float d = src_row[x];
+                    if(!(d > 0))
+                        continue;
 
-                vector<Mat> channelMasks;
-                split(validNormalMask, channelMasks);
-                validNormalMask = channelMasks[0] & channelMasks[1] & channelMasks[2];
+                    if(depthDownsampling == Odometry::DEPTH_DOWNSAMPLING_MEDIAN)
+                        values[count++] = d;
+                    else
+                    {
+                        const double dist = (x - su) * (x - su) + (y - sv) * (y - sv);
+                        if(dist < nearestDist)
+                        {
+                            nearestDist = dist;
+                            nearestDepth = d;
+                        }
+                    }
+                }
+            }
 
-                levelMask &= validNormalMask;
+            if(depthDownsampling == Odometry::DEPTH_DOWNSAMPLING_MEDIAN)
+            {
+                if(count)
+                {
+                    std::nth_element(values.begin(), values.begin() + count / 2, values.begin() + count);
+                    depth_row[u] = values[count / 2];
+                }
+                else
+                    depth_row[u] = std::numeric_limits<float>::quiet_NaN();
             }
+            else
+                depth_row[u] = nearestDepth;
         }
     }
+    dst = levelDepth;
 }
 
+/* The frame pyramids are filled incrementally: an empty level (or a level missing at the end of the vector)
+ * means that it was not computed yet, so it's built from the previous level or from the frame data.
+ * Non-empty levels are checked and reused as they are.
+ */
 static
-void preparePyramidCloud(const vector<Mat>& pyramidDepth, const Mat& cameraMatrix, vector<Mat>& pyramidCloud)
+void preparePyramid(const Mat& src, vector<Mat>& pyramid, size_t levelCount, double pyramidScale,
+                    int depthDownsampling = Odometry::DEPTH_DOWNSAMPLING_GAUSSIAN)
 {
-    if(!pyramidCloud.empty())
-    {
-        if(pyramidCloud.size() != pyramidDepth.size())
-            CV_Error(CV_StsBadSize, "Incorrect size of pyramidCloud.");
+    if(pyramid.size() < levelCount)
+        pyramid.resize(levelCount);
+
+    if(!pyramid[0].empty())
+        CV_Assert(pyramid[0].size() == src.size());
 
-        for(size_t i = 0; i < pyramidDepth.size(); i++)
+    for(size_t i = 0; i < pyramid.size(); i++)
+    {
+        Mat& level = pyramid[i];
+        if(level.empty())
+        {
+            if(i == 0)
+                level = src;
+            else
+                pyrDownDepthLevel(pyramid[i-1], level, pyramidScale, depthDownsampling);
+        }
+        else
         {
-            CV_Assert(pyramidCloud[i].size() == pyramidDepth[i].size());
-            CV_Assert(pyramidCloud[i].type() == CV_32FC3);
+            CV_Assert(level.type() == src.type());
+            CV_Assert(i == 0 || level.size() == pyramidLevelSize(pyramid[i-1].size(), pyramidScale));
         }
     }
-    else
-    {
-        vector<Mat> pyramidCameraMatrix;
-        buildPyramidCameraMatrix(cameraMatrix, pyramidDepth.size(), pyramidCameraMatrix);
+}
+
+/* Resizes the pyramid computed from basePyramid level by level and checks its already computed levels.
+ */
+static
+void resizePyramid(vector<Mat>& pyramid, const vector<Mat>& basePyramid, int type, const char* sizeErrorMessage)
+{
+    if(pyramid.size() > basePyramid.size())
+        CV_Error(CV_StsBadSize, sizeErrorMessage);
+    pyramid.resize(basePyramid.size());
 
-        pyramidCloud.resize(pyramidDepth.size());
-        for(size_t i = 0; i < pyramidDepth.size(); i++)
+    for(size_t i = 0; i < pyramid.size(); i++)
+    {
+        if(!pyramid[i].empty())
         {
-            Mat cloud;
-            depthTo3d(pyramidDepth[i], pyramidCameraMatrix[i], cloud);
-            pyramidCloud[i] = cloud;
+            CV_Assert(pyramid[i].size() == basePyramid[i].size());
+            CV_Assert(pyramid[i].type() == type);
         }
     }
 }
 
 static
-void preparePyramidSobel(const vector<Mat>& pyramidImage, int dx, int dy, vector<Mat>& pyramidSobel)
+void preparePyramidImage(const Mat& image, vector<Mat>& pyramidImage, size_t levelCount, double pyramidScale)
+{
+    preparePyramid(image, pyramidImage, levelCount, pyramidScale);
+}
+
+static
+void preparePyramidDepth(const Mat& depth, vector<Mat>& pyramidDepth, size_t levelCount, double pyramidScale,
+                         int depthDownsampling)
+{
+    preparePyramid(depth, pyramidDepth, levelCount, pyramidScale, depthDownsampling);
+}
+
+/* The input mask is downsampled level by level before the depth (and normals) filtering,
+ * it's done up to the last not computed level of pyramidMask.
+ */
+static
+void preparePyramidValidMask(const Mat& mask, const vector<Mat>& pyramidDepth, const vector<Mat>& pyramidMask,
+                             double pyramidScale, vector<Mat>& pyramidValidMask)
 {
-    if(!pyramidSobel.empty())
+    int lastEmptyLevel = -1;
+    for(size_t i = 0; i < pyramidMask.size(); i++)
     {
-        if(pyramidSobel.size() != pyramidImage.size())
-            CV_Error(CV_StsBadSize, "Incorrect size of pyramidSobel.");
+        if(pyramidMask[i].empty())
+            lastEmptyLevel = static_cast<int>(i);
+    }
 
-        for(size_t i = 0; i < pyramidSobel.size(); i++)
-        {
-            CV_Assert(pyramidSobel[i].size() == pyramidImage[i].size());
-            CV_Assert(pyramidSobel[i].type() == CV_16SC1);
-        }
+    pyramidValidMask.resize(lastEmptyLevel + 1);
+    for(int i = 0; i <= lastEmptyLevel; i++)
+    {
+        if(i == 0)
+            pyramidValidMask[0] = mask.empty() ? Mat(pyramidDepth[0].size(), CV_8UC1, Scalar(255)) : mask;
+        else
+            pyrDownLevel(pyramidValidMask[i-1], pyramidValidMask[i], pyramidScale);
     }
-    else
+}
+
+static
+void prepareMaskLevel(const Mat& validMask, const Mat& depth, float minDepth, float maxDepth, const Mat& normals,
+                      Mat& mask)
+{
+    if(!mask.empty())
+        return;
+
+    minDepth = std::max(0.f, minDepth);
+
+    Mat levelDepth = depth.clone();
+    patchNaNs(levelDepth, 0);
+
+    Mat levelMask = validMask & (levelDepth > minDepth) & (levelDepth < maxDepth);
+
+    if(!normals.empty())
     {
-        pyramidSobel.resize(pyramidImage.size());
-        for(size_t i = 0; i < pyramidImage.size(); i++)
-        {
-            Sobel(pyramidImage[i], pyramidSobel[i], CV_16S, dx, dy, sobelSize);
-        }
+        CV_Assert(normals.type() == CV_32FC3);
+        CV_Assert(normals.size() == depth.size());
+        Mat levelNormal = normals.clone();
+
+        Mat validNormalMask = levelNormal == levelNormal; // otherwise it's Nan
+        CV_Assert(validNormalMask.type() == CV_8UC3);
+
+        vector<Mat> channelMasks;
+        split(validNormalMask, channelMasks);
+        validNormalMask = channelMasks[0] & channelMasks[1] & channelMasks[2];
+
+        levelMask &= validNormalMask;
     }
+
+    mask = levelMask;
+}
+
+static
+void preparePyramidMask(const Mat& mask, const vector<Mat>& pyramidDepth, float minDepth, float maxDepth,
+                        const vector<Mat>& pyramidNormal, double pyramidScale,
+                        vector<Mat>& pyramidMask)
+{
+    resizePyramid(pyramidMask, pyramidDepth, CV_8UC1,
+                  "Levels count of pyramidMask has to be equal or less than size of pyramidDepth.");
+
+    vector<Mat> pyramidValidMask;
+    preparePyramidValidMask(mask, pyramidDepth, pyramidMask, pyramidScale, pyramidValidMask);
+
+    for(size_t i = 0; i < pyramidValidMask.size(); i++)
+        prepareMaskLevel(pyramidValidMask[i], pyramidDepth[i], minDepth, maxDepth,
+                         pyramidNormal.empty() ? Mat() : pyramidNormal[i], pyramidMask[i]);
+}
+
+static
+void prepareCloudLevel(const Mat& depth, const Mat& cameraMatrix, Mat& cloud)
+{
+    if(cloud.empty())
+        depthTo3d(depth, cameraMatrix, cloud);
+}
+
+static
+void preparePyramidCloud(const vector<Mat>& pyramidDepth, const Mat& cameraMatrix, double pyramidScale,
+                         vector<Mat>& pyramidCloud)
+{
+    resizePyramid(pyramidCloud, pyramidDepth, CV_32FC3, "Incorrect size of pyramidCloud.");
+
+    vector<Mat> pyramidCameraMatrix;
+    buildPyramidCameraMatrix(cameraMatrix, pyramidDepth.size(), pyramidScale, pyramidCameraMatrix);
+
+    for(size_t i = 0; i < pyramidDepth.size(); i++)
+        prepareCloudLevel(pyramidDepth[i], pyramidCameraMatrix[i], pyramidCloud[i]);
+}
+
+static
+void prepareSobelLevel(const Mat& image, int dx, int dy, Mat& sobel)
+{
+    if(sobel.empty())
+        Sobel(image, sobel, CV_16S, dx, dy, sobelSize);
+}
+
+static
+void preparePyramidSobel(const vector<Mat>& pyramidImage, int dx, int dy, vector<Mat>& pyramidSobel)
+{
+    resizePyramid(pyramidSobel, pyramidImage, CV_16SC1, "Incorrect size of pyramidSobel.");
+
+    for(size_t i = 0; i < pyramidImage.size(); i++)
+        prepareSobelLevel(pyramidImage[i], dx, dy, pyramidSobel[i]);
 }
 
 static
@@ -299,138 +466,280 @@ void randomSubsetOfMask(Mat& mask, float part)
     }
 }
 
+static
+void prepareTexturedMaskLevel(const Mat& dIdx, const Mat& dIdy, float minGradMagnitude, const Mat& mask,
+                              double maxPointsPart, Mat& texturedMask)
+{
+    if(!texturedMask.empty())
+        return;
+
+    const float sobelScale2_inv = 1.f / (sobelScale * sobelScale);
+    const float minScaledGradMagnitude2 = minGradMagnitude * minGradMagnitude * sobelScale2_inv;
+
+    Mat levelTexturedMask(dIdx.size(), CV_8UC1, Scalar(0));
+
+    for(int y = 0; y < dIdx.rows; y++)
+    {
+        const short *dIdx_row = dIdx.ptr<short>(y);
+        const short *dIdy_row = dIdy.ptr<short>(y);
+        uchar *texturedMask_row = levelTexturedMask.ptr<uchar>(y);
+        for(int x = 0; x < dIdx.cols; x++)
+        {
+            float magnitude2 = static_cast<float>(dIdx_row[x] * dIdx_row[x] + dIdy_row[x] * dIdy_row[x]);
+            if(magnitude2 >= minScaledGradMagnitude2)
+                texturedMask_row[x] = 255;
+        }
+    }
+    texturedMask = levelTexturedMask & mask;
+
+    randomSubsetOfMask(texturedMask, maxPointsPart);
+}
+
 static
 void preparePyramidTexturedMask(const vector<Mat>& pyramid_dI_dx, const vector<Mat>& pyramid_dI_dy,
                                 const vector<float>& minGradMagnitudes, const vector<Mat>& pyramidMask, double maxPointsPart,
                                 vector<Mat>& pyramidTexturedMask)
 {
-    if(!pyramidTexturedMask.empty())
+    resizePyramid(pyramidTexturedMask, pyramid_dI_dx, CV_8UC1, "Incorrect size of pyramidTexturedMask.");
+
+    for(size_t i = 0; i < pyramidTexturedMask.size(); i++)
+        prepareTexturedMaskLevel(pyramid_dI_dx[i], pyramid_dI_dy[i], minGradMagnitudes[i], pyramidMask[i],
+                                 maxPointsPart, pyramidTexturedMask[i]);
+}
+
+/* The textured pixels of a level in raster order as the column of (u, v, depth). A level without
+ * textured pixels stays empty and is just rescanned on the next call.
+ */
+static
+void prepareTexturedSamplesLevel(const Mat& texturedMask, const Mat& depth, Mat& samples)
+{
+    if(!samples.empty())
     {
-        if(pyramidTexturedMask.size() != pyramid_dI_dx.size())
-            CV_Error(CV_StsBadSize, "Incorrect size of pyramidTexturedMask.");
+        CV_Assert(samples.type() == CV_32FC3 && samples.cols == 1);
+        return;
+    }
+
+    const int samplesCount = countNonZero(texturedMask);
+    if(samplesCount == 0)
+        return;
 
-        for(size_t i = 0; i < pyramidTexturedMask.size(); i++)
+    samples.create(samplesCount, 1, CV_32FC3);
+    Vec3f* samples_ptr = samples.ptr<Vec3f>();
+    for(int v = 0, i = 0; v < texturedMask.rows; v++)
+    {
+        const uchar* texturedMask_row = texturedMask.ptr<uchar>(v);
+        const float* depth_row = depth.ptr<float>(v);
+        for(int u = 0; u < texturedMask.cols; u++)
         {
-            CV_Assert(pyramidTexturedMask[i].size() == pyramid_dI_dx[i].size());
-            CV_Assert(pyramidTexturedMask[i].type() == CV_8UC1);
+            if(texturedMask_row[u])
+                samples_ptr[i++] = Vec3f(static_cast<float>(u), static_cast<float>(v), depth_row[u]);
         }
     }
-    else
+}
+
+static
+void preparePyramidTexturedSamples(const vector<Mat>& pyramidTexturedMask, const vector<Mat>& pyramidDepth,
+                                   vector<Mat>& pyramidTexturedSamples)
+{
+    if(pyramidTexturedSamples.size() > pyramidTexturedMask.size())
+        CV_Error(CV_StsBadSize, "Incorrect size of pyramidTexturedSamples.");
+    pyramidTexturedSamples.resize(pyramidTexturedMask.size());
+
+    for(size_t i = 0; i < pyramidTexturedSamples.size(); i++)
+        prepareTexturedSamplesLevel(pyramidTexturedMask[i], pyramidDepth[i], pyramidTexturedSamples[i]);
+}
+
+static
+void preparePyramidNormals(const Mat& normals, const vector<Mat>& pyramidDepth, double pyramidScale,
+                           vector<Mat>& pyramidNormals)
+{
+    resizePyramid(pyramidNormals, pyramidDepth, CV_32FC3, "Incorrect size of pyramidNormals.");
+
+    int lastEmptyLevel = -1;
+    for(size_t i = 0; i < pyramidNormals.size(); i++)
+    {
+        if(pyramidNormals[i].empty())
+            lastEmptyLevel = static_cast<int>(i);
+    }
+
+    // the levels are downsampled from the previous not renormalized ones
+    Mat levelNormals;
+    for(int i = 0; i <= lastEmptyLevel; i++)
     {
-        const float sobelScale2_inv = 1.f / (sobelScale * sobelScale);
-        pyramidTexturedMask.resize(pyramid_dI_dx.size());
-        for(size_t i = 0; i < pyramidTexturedMask.size(); i++)
+        if(i == 0)
         {
-            const float minScaledGradMagnitude2 = minGradMagnitudes[i] * minGradMagnitudes[i] * sobelScale2_inv;
-            const Mat& dIdx = pyramid_dI_dx[i];
-            const Mat& dIdy = pyramid_dI_dy[i];
+            levelNormals = normals;
+            if(pyramidNormals[0].empty())
+                pyramidNormals[0] = normals;
+            continue;
+        }
 
-            Mat texturedMask(dIdx.size(), CV_8UC1, Scalar(0));
+        Mat downNormals;
+        pyrDownLevel(levelNormals, downNormals, pyramidScale);
+        levelNormals = downNormals;
 
-            for(int y = 0; y < dIdx.rows; y++)
+        if(!pyramidNormals[i].empty())
+            continue;
+
+        // renormalize normals
+        Mat currNormals(levelNormals.size(), CV_32FC3);
+        for(int y = 0; y < currNormals.rows; y++)
+        {
+            const Point3f* src_row = levelNormals.ptr<Point3f>(y);
+            Point3f* normals_row = currNormals.ptr<Point3f>(y);
+            for(int x = 0; x < currNormals.cols; x++)
             {
-                const short *dIdx_row = dIdx.ptr<short>(y);
-                const short *dIdy_row = dIdy.ptr<short>(y);
-                uchar *texturedMask_row = texturedMask.ptr<uchar>(y);
-                for(int x = 0; x < dIdx.cols; x++)
-                {
-                    float magnitude2 = static_cast<float>(dIdx_row[x] * dIdx_row[x] + dIdy_row[x] * dIdy_row[x]);
-                    if(magnitude2 >= minScaledGradMagnitude2)
-                        texturedMask_row[x] = 255;
-                }
+                double nrm = norm(src_row[x]);
+                normals_row[x] = src_row[x] * (1./nrm);
             }
-            pyramidTexturedMask[i] = texturedMask & pyramidMask[i];
-
-            randomSubsetOfMask(pyramidTexturedMask[i], maxPointsPart);
         }
+        pyramidNormals[i] = currNormals;
     }
 }
 
 static
-void preparePyramidNormals(const Mat& normals, const vector<Mat>& pyramidDepth, vector<Mat>& pyramidNormals)
+void prepareNormalsMaskLevel(const Mat& normals, const Mat& mask, double maxPointsPart, Mat& normalsMask)
 {
-    if(!pyramidNormals.empty())
-    {
-        if(pyramidNormals.size() != pyramidDepth.size())
-            CV_Error(CV_StsBadSize, "Incorrect size of pyramidNormals.");
+    if(!normalsMask.empty())
+        return;
 
-        for(size_t i = 0; i < pyramidNormals.size(); i++)
-        {
-            CV_Assert(pyramidNormals[i].size() == pyramidDepth[i].size());
-            CV_Assert(pyramidNormals[i].type() == CV_32FC3);
-        }
-    }
-    else
+    normalsMask = mask.clone();
+    for(int y = 0; y < normalsMask.rows; y++)
     {
-        buildPyramid(normals, pyramidNormals, pyramidDepth.size() - 1);
-        // renormalize normals
-        for(size_t i = 1; i < pyramidNormals.size(); i++)
+        const Vec3f *normals_row = normals.ptr<Vec3f>(y);
+        uchar *normalsMask_row = normalsMask.ptr<uchar>(y);
+        for(int x = 0; x < normalsMask.cols; x++)
         {
-            Mat& currNormals = pyramidNormals[i];
-            for(int y = 0; y < currNormals.rows; y++)
+            Vec3f n = normals_row[x];
+            if(cvIsNaN(n[0]))
             {
-                Point3f* normals_row = currNormals.ptr<Point3f>(y);
-                for(int x = 0; x < currNormals.cols; x++)
-                {
-                    double nrm = norm(normals_row[x]);
-                    normals_row[x] *= 1./nrm;
-                }
+                CV_DbgAssert(cvIsNaN(n[1]) && cvIsNaN(n[2]));
+                normalsMask_row[x] = 0;
             }
         }
     }
+    randomSubsetOfMask(normalsMask, maxPointsPart);
 }
 
 static
 void preparePyramidNormalsMask(const vector<Mat>& pyramidNormals, const vector<Mat>& pyramidMask, double maxPointsPart,
                                vector<Mat>& pyramidNormalsMask)
 {
-    if(!pyramidNormalsMask.empty())
-    {
-        if(pyramidNormalsMask.size() != pyramidMask.size())
-            CV_Error(CV_StsBadSize, "Incorrect size of pyramidNormalsMask.");
+    resizePyramid(pyramidNormalsMask, pyramidMask, CV_8UC1, "Incorrect size of pyramidNormalsMask.");
 
-        for(size_t i = 0; i < pyramidNormalsMask.size(); i++)
-        {
-            CV_Assert(pyramidNormalsMask[i].size() == pyramidMask[i].size());
-            CV_Assert(pyramidNormalsMask[i].type() == pyramidMask[i].type());
-        }
-    }
-    else
+    for(size_t i = 0; i < pyramidNormalsMask.size(); i++)
+        prepareNormalsMaskLevel(pyramidNormals[i], pyramidMask[i], maxPointsPart, pyramidNormalsMask[i]);
+}
+
+/* The frame cache of RgbdICPOdometry is prepared as a graph of tasks. The tasks of one stage depend only on
+ * the results of the previous stages (at most on the same level of another pyramid), so they run in parallel:
+ * 1) the image and depth pyramids;
+ * 2) the cloud levels, the normals (with the cloud level 0) and their pyramid, the downsampled input mask,
+ *    the Sobel levels;
+ * 3) the mask levels;
+ * 4) the textured and the normals mask levels.
+ * Each task writes only its own level of the pyramids resized in advance, so the result is the same
+ * as the sequential one.
+ */
+struct FrameCacheTask
+{
+    enum
     {
-        pyramidNormalsMask.resize(pyramidMask.size());
+        IMAGE_PYRAMID, DEPTH_PYRAMID, CLOUD, NORMALS, VALID_MASK_PYRAMID, MASK, SOBEL_DX, SOBEL_DY,
+        TEXTURED_MASK, NORMALS_MASK
+    };
+
+    FrameCacheTask(int _type, int _level = 0) : type(_type), level(_level)
+    {}
+
+    int type;
+    int level;
+};
 
-        for(size_t i = 0; i < pyramidNormalsMask.size(); i++)
+struct FrameCacheBody : public ParallelLoopBody
+{
+    FrameCacheBody(const vector<FrameCacheTask>& _tasks, OdometryFrame& _frame, size_t _levelCount,
+                   const vector<Mat>& _pyramidCameraMatrix, vector<Mat>& _pyramidValidMask,
+                   float _minDepth, float _maxDepth, const vector<float>& _minGradientMagnitudes, double _maxPointsPart,
+                   double _pyramidScale, int _depthDownsampling, const Ptr<RgbdNormals>& _normalsComputer) :
+        tasks(_tasks), frame(_frame), levelCount(_levelCount),
+        pyramidCameraMatrix(_pyramidCameraMatrix), pyramidValidMask(_pyramidValidMask),
+        minDepth(_minDepth), maxDepth(_maxDepth), minGradientMagnitudes(_minGradientMagnitudes),
+        maxPointsPart(_maxPointsPart), pyramidScale(_pyramidScale), depthDownsampling(_depthDownsampling),
+        normalsComputer(_normalsComputer)
+    {}
+
+    void operator()(const Range& range) const
+    {
+        for(int taskIndex = range.start; taskIndex < range.end; taskIndex++)
         {
-            pyramidNormalsMask[i] = pyramidMask[i].clone();
-            Mat& normalsMask = pyramidNormalsMask[i];
-            for(int y = 0; y < normalsMask.rows; y++)
+            const int i = tasks[taskIndex].level;
+            switch(tasks[taskIndex].type)
             {
-                const Vec3f *normals_row = pyramidNormals[i].ptr<Vec3f>(y);
-                uchar *normalsMask_row = pyramidNormalsMask[i].ptr<uchar>(y);
-                for(int x = 0; x < normalsMask.cols; x++)
+            case FrameCacheTask::IMAGE_PYRAMID:
+                preparePyramidImage(frame.image, frame.pyramidImage, levelCount, pyramidScale);
+                break;
+            case FrameCacheTask::DEPTH_PYRAMID:
+                preparePyramidDepth(frame.depth, frame.pyramidDepth, levelCount, pyramidScale, depthDownsampling);
+                break;
+            case FrameCacheTask::CLOUD:
+                prepareCloudLevel(frame.pyramidDepth[i], pyramidCameraMatrix[i], frame.pyramidCloud[i]);
+                break;
+            case FrameCacheTask::NORMALS:
+                if(frame.normals.empty())
                 {
-                    Vec3f n = normals_row[x];
-                    if(cvIsNaN(n[0]))
-                    {
-                        CV_DbgAssert(cvIsNaN(n[1]) && cvIsNaN(n[2]));
-                        normalsMask_row[x] = 0;
-                    }
+                    prepareCloudLevel(frame.pyramidDepth[0], pyramidCameraMatrix[0], frame.pyramidCloud[0]);
+                    (*normalsComputer)(frame.pyramidCloud[0], frame.normals);
                 }
+                checkNormals(frame.normals, frame.depth.size());
+                preparePyramidNormals(frame.normals, frame.pyramidDepth, pyramidScale, frame.pyramidNormals);
+                break;
+            case FrameCacheTask::VALID_MASK_PYRAMID:
+                preparePyramidValidMask(frame.mask, frame.pyramidDepth, frame.pyramidMask, pyramidScale, pyramidValidMask);
+                break;
+            case FrameCacheTask::MASK:
+                prepareMaskLevel(pyramidValidMask[i], frame.pyramidDepth[i], minDepth, maxDepth,
+                                 frame.pyramidNormals.empty() ? Mat() : frame.pyramidNormals[i], frame.pyramidMask[i]);
+                break;
+            case FrameCacheTask::SOBEL_DX:
+                prepareSobelLevel(frame.pyramidImage[i], 1, 0, frame.pyramid_dI_dx[i]);
+                break;
+            case FrameCacheTask::SOBEL_DY:
+                prepareSobelLevel(frame.pyramidImage[i], 0, 1, frame.pyramid_dI_dy[i]);
+                break;
+            case FrameCacheTask::TEXTURED_MASK:
+                prepareTexturedMaskLevel(frame.pyramid_dI_dx[i], frame.pyramid_dI_dy[i], minGradientMagnitudes[i],
+                                         frame.pyramidMask[i], maxPointsPart, frame.pyramidTexturedMask[i]);
+                break;
+            case FrameCacheTask::NORMALS_MASK:
+                prepareNormalsMaskLevel(frame.pyramidNormals[i], frame.pyramidMask[i], maxPointsPart,
+                                        frame.pyramidNormalsMask[i]);
+                break;
+            default:
+                CV_Error(CV_StsBadArg, "Unknown frame cache task.");
             }
-            randomSubsetOfMask(normalsMask, maxPointsPart);
         }
     }
-}
+
+    const vector<FrameCacheTask>& tasks;
+    OdometryFrame& frame;
+    size_t levelCount;
+    const vector<Mat>& pyramidCameraMatrix;
+    vector<Mat>& pyramidValidMask;
+    float minDepth, maxDepth;
+    const vector<float>& minGradientMagnitudes;
+    double maxPointsPart;
+    double pyramidScale;
+    int depthDownsampling;
+    const Ptr<RgbdNormals>& normalsComputer;
+};
 
 ///////////////////////////////////////////////////////////////////////////////////////
 
 static
-void computeProjectiveMatrix(const Mat& ksi, Mat& Rt)
+void computeProjectiveMatrix(const double* ksi_ptr, Matx44d& Rt)
 {
-    CV_Assert(ksi.size() == Size(1,6) && ksi.type() == CV_64FC1);
-
 #ifdef HAVE_EIGEN3_HERE
-    const double* ksi_ptr = ksi.ptr<const double>();
     Eigen::Matrix<double,4,4> twist, g;
     twist << 0.,          -ksi_ptr[2], ksi_ptr[1],  ksi_ptr[3],
              ksi_ptr[2],  0.,          -ksi_ptr[0], ksi_ptr[4],
@@ -438,134 +747,614 @@ void computeProjectiveMatrix(const Mat& ksi, Mat& Rt)
              0.,          0.,          0.,          0.;
     g = twist.exp();
 
-    eigen2cv(g, Rt);
+    for(int y = 0; y < 4; y++)
+        for(int x = 0; x < 4; x++)
+            Rt(y,x) = g(y,x);
 #else
     // TODO: check computeProjectiveMatrix when there is not eigen library, 
     //       because it gives less accurate pose of the camera
-    Rt = Mat::eye(4, 4, CV_64FC1);
-
-    Mat R = Rt(Rect(0,0,3,3));
-    Mat rvec = ksi.rowRange(0,3);
+    Rt = Matx44d::eye();
 
-    Rodrigues(rvec, R);
+    Matx33d R;
+    Rodrigues(Matx31d(ksi_ptr[0], ksi_ptr[1], ksi_ptr[2]), R);
+    for(int y = 0; y < 3; y++)
+        for(int x = 0; x < 3; x++)
+            Rt(y,x) = R(y,x);
 
-    Rt.at<double>(0,3) = ksi.at<double>(3);
-    Rt.at<double>(1,3) = ksi.at<double>(4);
-    Rt.at<double>(2,3) = ksi.at<double>(5);
+    Rt(0,3) = ksi_ptr[3];
+    Rt(1,3) = ksi_ptr[4];
+    Rt(2,3) = ksi_ptr[5];
 #endif
 }
 
-static
-void computeCorresps(const Mat& K, const Mat& K_inv, const Mat& Rt,
-                     const Mat& depth0, const Mat& validMask0,
-                     const Mat& depth1, const Mat& selectMask1, float maxDepthDiff,
-                     Mat& _corresps)
+/*
+ * Inverse of the rigid body motion: [R^t | -R^t*t].
+ */
+static inline
+Matx44d invertRigidTransform(const Matx44d& Rt)
 {
-    CV_Assert(K.type() == CV_64FC1);
-    CV_Assert(K_inv.type() == CV_64FC1);
-    CV_Assert(Rt.type() == CV_64FC1);
+    Matx44d Rt_inv = Matx44d::eye();
+    for(int y = 0; y < 3; y++)
+    {
+        for(int x = 0; x < 3; x++)
+            Rt_inv(y,x) = Rt(x,y);
+        Rt_inv(y,3) = -(Rt(0,y) * Rt(0,3) + Rt(1,y) * Rt(1,3) + Rt(2,y) * Rt(2,3));
+    }
+    return Rt_inv;
+}
 
-    Mat corresps(depth1.size(), CV_16SC2, Scalar::all(-1));
-    
-    Rect r(0, 0, depth1.cols, depth1.rows);
-    Mat Kt = Rt(Rect(3,0,1,3)).clone();
-    Kt = K * Kt;
-    const double * Kt_ptr = Kt.ptr<const double>();
+/*
+ * Gate of the correspondences by the depth difference. The allowed difference grows with the depth of the
+ * source point z as the sensor noise does: maxDepthDiff + a*z^2 + b*z (like sensor_error_a/b/c of RgbdPlane).
+ * It's the constant maxDepthDiff if a and b are zeros.
+ */
+struct DepthDiffGate
+{
+    DepthDiffGate(float _maxDepthDiff, float _a = 0.f, float _b = 0.f)
+        : maxDepthDiff(_maxDepthDiff), a(_a), b(_b)
+    {}
 
-    AutoBuffer<float> buf(3 * (depth1.cols + depth1.rows));
-    float *KRK_inv0_u1 = buf;
-    float *KRK_inv1_v1_plus_KRK_inv2 = KRK_inv0_u1 + depth1.cols;
-    float *KRK_inv3_u1 = KRK_inv1_v1_plus_KRK_inv2 + depth1.rows;
-    float *KRK_inv4_v1_plus_KRK_inv5 = KRK_inv3_u1 + depth1.cols;
-    float *KRK_inv6_u1 = KRK_inv4_v1_plus_KRK_inv5 + depth1.rows;
-    float *KRK_inv7_v1_plus_KRK_inv8 = KRK_inv6_u1 + depth1.cols;
+    inline float threshold(float z) const
     {
-        Mat R = Rt(Rect(0,0,3,3)).clone();
+        return maxDepthDiff + (a * z + b) * z;
+    }
 
-        Mat KRK_inv = K * R * K_inv;
-        const double * KRK_inv_ptr = KRK_inv.ptr<const double>();
-        for(int u1 = 0; u1 < depth1.cols; u1++)
-        {
-            KRK_inv0_u1[u1] = KRK_inv_ptr[0] * u1;
-            KRK_inv3_u1[u1] = KRK_inv_ptr[3] * u1;
-            KRK_inv6_u1[u1] = KRK_inv_ptr[6] * u1;
-        }
-        
-        for(int v1 = 0; v1 < depth1.rows; v1++)
-        {
-            KRK_inv1_v1_plus_KRK_inv2[v1] = KRK_inv_ptr[1] * v1 + KRK_inv_ptr[2];
-            KRK_inv4_v1_plus_KRK_inv5[v1] = KRK_inv_ptr[4] * v1 + KRK_inv_ptr[5];
-            KRK_inv7_v1_plus_KRK_inv8[v1] = KRK_inv_ptr[7] * v1 + KRK_inv_ptr[8];
-        }
+    inline bool operator()(float transformed_d1, float d0) const
+    {
+        return std::abs(transformed_d1 - d0) <= threshold(d0);
     }
 
-    int correspCount = 0;
-    for(int v1 = 0; v1 < depth1.rows; v1++)
+    float maxDepthDiff, a, b;
+};
+
+// Height (in target rows) of the stripes the z-buffer is resolved in.
+// The result does not depend on it.
+const int correspsStripeHeight = 16;
+
+/*
+ * First pass of computeCorresps(): every selected pixel of depth1 is reprojected to the frame of depth0
+ * and checked against depth0/validMask0. The linear index of the target pixel (or -1) and the reprojected
+ * depth are saved per source pixel, together with the range of the target rows hit by each source row.
+ * The SSE2 branch repeats the float/double arithmetic of the scalar one exactly, so the results are the same.
+ */
+struct CorrespsProjector : public ParallelLoopBody
+{
+    CorrespsProjector(const Mat& _depth0, const Mat& _validMask0,
+                      const Mat& _depth1, const Mat& _selectMask1, const DepthDiffGate& _depthDiffGate,
+                      const float* _tables, const double* _Kt,
+                      Mat& _projIndices, Mat& _projDepths, int* _minV0, int* _maxV0)
+        : depth0(_depth0), validMask0(_validMask0), depth1(_depth1), selectMask1(_selectMask1),
+          depthDiffGate(_depthDiffGate), tables(_tables), Kt(_Kt),
+          projIndices(_projIndices), projDepths(_projDepths), minV0(_minV0), maxV0(_maxV0)
     {
-        const float *depth1_row = depth1.ptr<float>(v1);
-        const uchar *mask1_row = selectMask1.ptr<uchar>(v1);
-        for(int u1 = 0; u1 < depth1.cols; u1++)
+#if CV_SSE2
+        haveSSE2 = checkHardwareSupport(CV_CPU_SSE2);
+#endif
+    }
+
+    virtual void operator()(const Range& range) const
+    {
+        const int rows = depth1.rows, cols = depth1.cols;
+        const float *KRK_inv0_u1 = tables;
+        const float *KRK_inv1_v1_plus_KRK_inv2 = KRK_inv0_u1 + cols;
+        const float *KRK_inv3_u1 = KRK_inv1_v1_plus_KRK_inv2 + rows;
+        const float *KRK_inv4_v1_plus_KRK_inv5 = KRK_inv3_u1 + cols;
+        const float *KRK_inv6_u1 = KRK_inv4_v1_plus_KRK_inv5 + rows;
+        const float *KRK_inv7_v1_plus_KRK_inv8 = KRK_inv6_u1 + cols;
+
+        for(int v1 = range.start; v1 < range.end; v1++)
         {
-            float d1 = depth1_row[u1];
-            if(mask1_row[u1])
+            const float *depth1_row = depth1.ptr<float>(v1);
+            const uchar *mask1_row = selectMask1.ptr<uchar>(v1);
+            int *indices_row = projIndices.ptr<int>(v1);
+            float *depths_row = projDepths.ptr<float>(v1);
+
+            int minV = rows, maxV = -1;
+            int u1 = 0;
+#if CV_SSE2
+            if(haveSSE2)
             {
-                CV_DbgAssert(!cvIsNaN(d1));
-                float transformed_d1 = static_cast<float>(d1 * (KRK_inv6_u1[u1] + KRK_inv7_v1_plus_KRK_inv8[v1]) + 
-                                                          Kt_ptr[2]);
-                if(transformed_d1 > 0)
+                const __m128 krk1 = _mm_set1_ps(KRK_inv1_v1_plus_KRK_inv2[v1]),
+                             krk4 = _mm_set1_ps(KRK_inv4_v1_plus_KRK_inv5[v1]),
+                             krk7 = _mm_set1_ps(KRK_inv7_v1_plus_KRK_inv8[v1]),
+                             one = _mm_set1_ps(1.f);
+                const __m128d kt0 = _mm_set1_pd(Kt[0]), kt1 = _mm_set1_pd(Kt[1]), kt2 = _mm_set1_pd(Kt[2]);
+                float CV_DECL_ALIGNED(16) tds[4];
+                int CV_DECL_ALIGNED(16) us[4], vs[4];
+                for(; u1 <= cols - 4; u1 += 4)
                 {
-                    float transformed_d1_inv = 1.f / transformed_d1;
-                    int u0 = cvRound(transformed_d1_inv * (d1 * (KRK_inv0_u1[u1] + KRK_inv1_v1_plus_KRK_inv2[v1]) + 
-                                                           Kt_ptr[0]));
-                    int v0 = cvRound(transformed_d1_inv * (d1 * (KRK_inv3_u1[u1] + KRK_inv4_v1_plus_KRK_inv5[v1]) + 
-                                                           Kt_ptr[1]));
-                    
-                    if(r.contains(Point(u0,v0)))
+                    if(!(mask1_row[u1] | mask1_row[u1+1] | mask1_row[u1+2] | mask1_row[u1+3]))
                     {
-                        float d0 = depth0.at<float>(v0,u0);
-                        if(validMask0.at<uchar>(v0, u0) && std::abs(transformed_d1 - d0) <= maxDepthDiff)
-                        {
-                            CV_DbgAssert(!cvIsNaN(d0));
-                            Vec2s& c = corresps.at<Vec2s>(v0,u0);
-                            if(c[0] != -1)
-                            {
-                                int exist_u1 = c[0], exist_v1 = c[1];
-
-                                float exist_d1 = (float)(depth1.at<float>(exist_v1,exist_u1) * 
-                                    (KRK_inv6_u1[exist_u1] + KRK_inv7_v1_plus_KRK_inv8[exist_v1]) + Kt_ptr[2]);
-
-                                if(transformed_d1 > exist_d1)
-                                    continue;
-                            }
-                            else
-                                correspCount++;
-
-                            c = Vec2s(u1,v1);
+                        indices_row[u1] = indices_row[u1+1] = indices_row[u1+2] = indices_row[u1+3] = -1;
+                        continue;
+                    }
+
+                    __m128 d1 = _mm_loadu_ps(depth1_row + u1);
+
+                    // float products, double offsets, as in the scalar branch
+                    __m128 pz = _mm_mul_ps(d1, _mm_add_ps(_mm_loadu_ps(KRK_inv6_u1 + u1), krk7));
+                    __m128 td = _mm_movelh_ps(_mm_cvtpd_ps(_mm_add_pd(_mm_cvtps_pd(pz), kt2)),
+                                              _mm_cvtpd_ps(_mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(pz, pz)), kt2)));
+                    __m128 tdInv = _mm_div_ps(one, td);
+                    __m128d tdInv_lo = _mm_cvtps_pd(tdInv), tdInv_hi = _mm_cvtps_pd(_mm_movehl_ps(tdInv, tdInv));
+
+                    __m128 pu = _mm_mul_ps(d1, _mm_add_ps(_mm_loadu_ps(KRK_inv0_u1 + u1), krk1));
+                    __m128 pv = _mm_mul_ps(d1, _mm_add_ps(_mm_loadu_ps(KRK_inv3_u1 + u1), krk4));
+
+                    __m128i u0 = _mm_unpacklo_epi64(
+                        _mm_cvtpd_epi32(_mm_mul_pd(tdInv_lo, _mm_add_pd(_mm_cvtps_pd(pu), kt0))),
+                        _mm_cvtpd_epi32(_mm_mul_pd(tdInv_hi, _mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(pu, pu)), kt0))));
+                    __m128i v0 = _mm_unpacklo_epi64(
+                        _mm_cvtpd_epi32(_mm_mul_pd(tdInv_lo, _mm_add_pd(_mm_cvtps_pd(pv), kt1))),
+                        _mm_cvtpd_epi32(_mm_mul_pd(tdInv_hi, _mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(pv, pv)), kt1))));
+
+                    _mm_store_ps(tds, td);
+                    _mm_store_si128((__m128i*)us, u0);
+                    _mm_store_si128((__m128i*)vs, v0);
+
+                    for(int k = 0; k < 4; k++)
+                        checkCorresp(mask1_row[u1+k], tds[k], us[k], vs[k],
+                                     indices_row[u1+k], depths_row[u1+k], minV, maxV);
+                }
+            }
+#endif
+            for(; u1 < cols; u1++)
+            {
+                if(!mask1_row[u1])
+                {
+                    indices_row[u1] = -1;
+                    continue;
+                }
+
+                float d1 = depth1_row[u1];
+                CV_DbgAssert(!cvIsNaN(d1));
+                float transformed_d1 = static_cast<float>(d1 * (KRK_inv6_u1[u1] + KRK_inv7_v1_plus_KRK_inv8[v1]) +
+                                                          Kt[2]);
+                int u0 = -1, v0 = -1;
+                if(transformed_d1 > 0)
+                {
+                    float transformed_d1_inv = 1.f / transformed_d1;
+                    u0 = cvRound(transformed_d1_inv * (d1 * (KRK_inv0_u1[u1] + KRK_inv1_v1_plus_KRK_inv2[v1]) +
+                                                       Kt[0]));
+                    v0 = cvRound(transformed_d1_inv * (d1 * (KRK_inv3_u1[u1] + KRK_inv4_v1_plus_KRK_inv5[v1]) +
+                                                       Kt[1]));
+                }
+                checkCorresp(1, transformed_d1, u0, v0, indices_row[u1], depths_row[u1], minV, maxV);
+            }
+
+            minV0[v1] = minV;
+            maxV0[v1] = maxV;
+        }
+    }
+
+    inline void checkCorresp(uchar selected, float transformed_d1, int u0, int v0,
+                             int& index, float& depth, int& minV, int& maxV) const
+    {
+        index = -1;
+        if(!selected || !(transformed_d1 > 0) ||
+           (unsigned)u0 >= (unsigned)depth1.cols || (unsigned)v0 >= (unsigned)depth1.rows)
+            return;
+
+        float d0 = depth0.at<float>(v0,u0);
+        if(validMask0.at<uchar>(v0,u0) && depthDiffGate(transformed_d1, d0))
+        {
+            CV_DbgAssert(!cvIsNaN(d0));
+            index = v0 * depth1.cols + u0;
+            depth = transformed_d1;
+            minV = std::min(minV, v0);
+            maxV = std::max(maxV, v0);
+        }
+    }
+
+    const Mat& depth0;
+    const Mat& validMask0;
+    const Mat& depth1;
+    const Mat& selectMask1;
+    DepthDiffGate depthDiffGate;
+    const float* tables;
+    const double* Kt;
+    Mat& projIndices;
+    Mat& projDepths;
+    int* minV0;
+    int* maxV0;
+#if CV_SSE2
+    bool haveSSE2;
+#endif
+};
+
+/*
+ * Second pass of computeCorresps(): each stripe of target rows is owned by one thread, which visits
+ * the source pixels projected into it in raster order. The nearest source point wins and on equal depths
+ * the later one does, which is exactly what the sequential z-buffer did.
+ * The merged odometry resolves the RGB-D and ICP correspondences from one projection, then every term
+ * has its own z-buffer and only takes the source pixels of its select mask.
+ */
+struct CorrespsResolver : public ParallelLoopBody
+{
+    enum { MAX_TERMS = 2 };
+
+    CorrespsResolver(const Mat& _projIndices, const Mat& _projDepths, const int* _minV0, const int* _maxV0,
+                     Mat& corresps, Mat& zBuffer, int* stripeCounts)
+        : projIndices(_projIndices), projDepths(_projDepths), minV0(_minV0), maxV0(_maxV0), termsCount(0)
+    {
+        addTerm(0, corresps, zBuffer, stripeCounts);
+    }
+
+    CorrespsResolver(const Mat& _projIndices, const Mat& _projDepths, const int* _minV0, const int* _maxV0)
+        : projIndices(_projIndices), projDepths(_projDepths), minV0(_minV0), maxV0(_maxV0), termsCount(0)
+    {}
+
+    void addTerm(const Mat* selectMask, Mat& corresps, Mat& zBuffer, int* stripeCounts)
+    {
+        CV_Assert(termsCount < MAX_TERMS);
+        selectMasks[termsCount] = selectMask;
+        correspsImages[termsCount] = &corresps;
+        zBuffers[termsCount] = &zBuffer;
+        termStripeCounts[termsCount] = stripeCounts;
+        termsCount++;
+    }
+
+    virtual void operator()(const Range& range) const
+    {
+        const int rows = projIndices.rows, cols = projIndices.cols;
+        for(int s = range.start; s < range.end; s++)
+        {
+            const int vBegin = s * correspsStripeHeight,
+                      vEnd = std::min(rows, vBegin + correspsStripeHeight);
+            const int indexBegin = vBegin * cols, indexEnd = vEnd * cols;
+
+            int counts[MAX_TERMS] = {0};
+            for(int v1 = 0; v1 < rows; v1++)
+            {
+                if(maxV0[v1] < vBegin || minV0[v1] >= vEnd)
+                    continue;
+
+                const int *indices_row = projIndices.ptr<int>(v1);
+                const float *depths_row = projDepths.ptr<float>(v1);
+                for(int u1 = 0; u1 < cols; u1++)
+                {
+                    int index = indices_row[u1];
+                    if(index < indexBegin || index >= indexEnd)
+                        continue;
+
+                    for(int t = 0; t < termsCount; t++)
+                    {
+                        if(selectMasks[t] && !selectMasks[t]->at<uchar>(v1,u1))
+                            continue;
+
+                        Vec2s& c = correspsImages[t]->ptr<Vec2s>()[index];
+                        float& z = zBuffers[t]->ptr<float>()[index];
+                        if(c[0] != -1)
+                        {
+                            if(depths_row[u1] > z)
+                                continue;
                         }
+                        else
+                            counts[t]++;
+
+                        c = Vec2s(u1,v1);
+                        z = depths_row[u1];
                     }
                 }
             }
+            for(int t = 0; t < termsCount; t++)
+                termStripeCounts[t][s] = counts[t];
         }
     }
 
-    _corresps.create(correspCount, 1, CV_32SC4);
-    Vec4i * corresps_ptr = _corresps.ptr<Vec4i>();
-    for(int v0 = 0, i = 0; v0 < corresps.rows; v0++)
+    const Mat& projIndices;
+    const Mat& projDepths;
+    const int* minV0;
+    const int* maxV0;
+    int termsCount;
+    const Mat* selectMasks[MAX_TERMS];
+    Mat* correspsImages[MAX_TERMS];
+    Mat* zBuffers[MAX_TERMS];
+    int* termStripeCounts[MAX_TERMS];
+};
+
+/*
+ * Last pass of computeCorresps(): the stripes write their correspondences to the output list
+ * starting from the prefix sums of the stripe counts, so the list keeps the target raster order.
+ */
+struct CorrespsCompactor : public ParallelLoopBody
+{
+    CorrespsCompactor(const Mat& _corresps, const int* _stripeOffsets, Mat& _list)
+        : corresps(_corresps), stripeOffsets(_stripeOffsets), list(_list)
+    {}
+
+    virtual void operator()(const Range& range) const
     {
-        const Vec2s* corresps_row = corresps.ptr<Vec2s>(v0);
-        for(int u0 = 0; u0 < corresps.cols; u0++)
+        Vec4i * list_ptr = list.ptr<Vec4i>();
+        for(int s = range.start; s < range.end; s++)
         {
-            const Vec2s& c = corresps_row[u0];
-            if(c[0] != -1)
-                corresps_ptr[i++] = Vec4i(u0,v0,c[0],c[1]);
+            const int vBegin = s * correspsStripeHeight,
+                      vEnd = std::min(corresps.rows, vBegin + correspsStripeHeight);
+            for(int v0 = vBegin, i = stripeOffsets[s]; v0 < vEnd; v0++)
+            {
+                const Vec2s* corresps_row = corresps.ptr<Vec2s>(v0);
+                for(int u0 = 0; u0 < corresps.cols; u0++)
+                {
+                    const Vec2s& c = corresps_row[u0];
+                    if(c[0] != -1)
+                        list_ptr[i++] = Vec4i(u0,v0,c[0],c[1]);
+                }
+            }
         }
     }
+
+    const Mat& corresps;
+    const int* stripeOffsets;
+    Mat& list;
+};
+
+static
+void projectCorresps(const Matx33d& K, const Matx33d& K_inv, const Matx44d& Rt,
+                     const Mat& depth0, const Mat& validMask0,
+                     const Mat& depth1, const Mat& selectMask1, const DepthDiffGate& depthDiffGate,
+                     OdometryWorkspace::Level& buffers)
+{
+    const Vec3d Kt = K * Vec3d(Rt(0,3), Rt(1,3), Rt(2,3));
+
+    float *KRK_inv0_u1 = buffers.projTables.ptr<float>();
+    float *KRK_inv1_v1_plus_KRK_inv2 = KRK_inv0_u1 + depth1.cols;
+    float *KRK_inv3_u1 = KRK_inv1_v1_plus_KRK_inv2 + depth1.rows;
+    float *KRK_inv4_v1_plus_KRK_inv5 = KRK_inv3_u1 + depth1.cols;
+    float *KRK_inv6_u1 = KRK_inv4_v1_plus_KRK_inv5 + depth1.rows;
+    float *KRK_inv7_v1_plus_KRK_inv8 = KRK_inv6_u1 + depth1.cols;
+    {
+        const Matx33d KRK_inv = K * Rt.get_minor<3,3>(0,0) * K_inv;
+        const double * KRK_inv_ptr = KRK_inv.val;
+        for(int u1 = 0; u1 < depth1.cols; u1++)
+        {
+            KRK_inv0_u1[u1] = KRK_inv_ptr[0] * u1;
+            KRK_inv3_u1[u1] = KRK_inv_ptr[3] * u1;
+            KRK_inv6_u1[u1] = KRK_inv_ptr[6] * u1;
+        }
+        
+        for(int v1 = 0; v1 < depth1.rows; v1++)
+        {
+            KRK_inv1_v1_plus_KRK_inv2[v1] = KRK_inv_ptr[1] * v1 + KRK_inv_ptr[2];
+            KRK_inv4_v1_plus_KRK_inv5[v1] = KRK_inv_ptr[4] * v1 + KRK_inv_ptr[5];
+            KRK_inv7_v1_plus_KRK_inv8[v1] = KRK_inv_ptr[7] * v1 + KRK_inv_ptr[8];
+        }
+    }
+
+    int *minV0 = buffers.projRowRanges.ptr<int>(), *maxV0 = minV0 + depth1.rows;
+    parallel_for_(Range(0, depth1.rows),
+                  CorrespsProjector(depth0, validMask0, depth1, selectMask1, depthDiffGate,
+                                    buffers.projTables.ptr<float>(), Kt.val,
+                                    buffers.projIndices, buffers.projDepths, minV0, maxV0));
 }
 
+/*
+ * Correspondences of one term as the list of (u0,v0,u1,v1) in the target raster order. The list is a header
+ * of the term buffer of the workspace level, so it stays valid until the next call for this term.
+ */
+static
+void computeCorresps(const Matx33d& K, const Matx33d& K_inv, const Matx44d& Rt,
+                     const Mat& depth0, const Mat& validMask0,
+                     const Mat& depth1, const Mat& selectMask1, const DepthDiffGate& depthDiffGate,
+                     OdometryWorkspace::Level& buffers, int term, Mat& _corresps)
+{
+    projectCorresps(K, K_inv, Rt, depth0, validMask0, depth1, selectMask1, depthDiffGate, buffers);
+
+    const int *minV0 = buffers.projRowRanges.ptr<int>(), *maxV0 = minV0 + depth1.rows;
+    Mat& corresps = buffers.corresps[term];
+    corresps = Scalar::all(-1);
+
+    const int stripesCount = (depth1.rows + correspsStripeHeight - 1) / correspsStripeHeight;
+    int* stripeCounts = buffers.stripeCounts.ptr<int>();
+    parallel_for_(Range(0, stripesCount),
+                  CorrespsResolver(buffers.projIndices, buffers.projDepths, minV0, maxV0,
+                                   corresps, buffers.zBuffers[term], stripeCounts));
+
+    // stripeCounts becomes the stripe offsets in the output list
+    int correspCount = 0;
+    for(int s = 0; s < stripesCount; s++)
+    {
+        int count = stripeCounts[s];
+        stripeCounts[s] = correspCount;
+        correspCount += count;
+    }
+
+    _corresps = buffers.correspsLists[term].rowRange(0, correspCount);
+    if(correspCount > 0)
+        parallel_for_(Range(0, stripesCount), CorrespsCompactor(corresps, stripeCounts, _corresps));
+}
+
+/*
+ * Projection of the sparse odometry: the samples of depth1 are split into stripesCount chunks, each chunk saves
+ * the target index (or -1) of its samples to the flat projIndices and counts the valid ones.
+ * There is no z-buffer here, several samples may share a target pixel like in the sparse direct methods.
+ */
+struct SparseCorrespsProjector : public ParallelLoopBody
+{
+    SparseCorrespsProjector(const Mat& _depth0, const Mat& _validMask0, const Mat& _samples1, const DepthDiffGate& _depthDiffGate,
+                            const Matx33d& _KRK_inv, const Vec3d& _Kt, int _chunkSize, int* _projIndices, int* _chunkCounts)
+        : depth0(_depth0), validMask0(_validMask0), samples1(_samples1), depthDiffGate(_depthDiffGate),
+          KRK_inv(_KRK_inv), Kt(_Kt), chunkSize(_chunkSize), projIndices(_projIndices), chunkCounts(_chunkCounts)
+    {}
+
+    virtual void operator()(const Range& range) const
+    {
+        const Vec3f* samples1_ptr = samples1.ptr<Vec3f>();
+        const double* KRK_inv_ptr = KRK_inv.val;
+        for(int c = range.start; c < range.end; c++)
+        {
+            const int iBegin = c * chunkSize, iEnd = std::min(samples1.rows, iBegin + chunkSize);
+            int count = 0;
+            for(int i = iBegin; i < iEnd; i++)
+            {
+                const Vec3f& s = samples1_ptr[i];
+                const double d1 = s[2];
+                projIndices[i] = -1;
+
+                float transformed_d1 = static_cast<float>(d1 * (KRK_inv_ptr[6] * s[0] + KRK_inv_ptr[7] * s[1] + KRK_inv_ptr[8]) + Kt[2]);
+                if(!(transformed_d1 > 0))
+                    continue;
+
+                float transformed_d1_inv = 1.f / transformed_d1;
+                int u0 = cvRound(transformed_d1_inv * (d1 * (KRK_inv_ptr[0] * s[0] + KRK_inv_ptr[1] * s[1] + KRK_inv_ptr[2]) + Kt[0]));
+                int v0 = cvRound(transformed_d1_inv * (d1 * (KRK_inv_ptr[3] * s[0] + KRK_inv_ptr[4] * s[1] + KRK_inv_ptr[5]) + Kt[1]));
+                if((unsigned)u0 >= (unsigned)depth0.cols || (unsigned)v0 >= (unsigned)depth0.rows)
+                    continue;
+
+                float d0 = depth0.at<float>(v0,u0);
+                if(validMask0.at<uchar>(v0,u0) && depthDiffGate(transformed_d1, d0))
+                {
+                    projIndices[i] = v0 * depth0.cols + u0;
+                    count++;
+                }
+            }
+            chunkCounts[c] = count;
+        }
+    }
+
+    const Mat& depth0;
+    const Mat& validMask0;
+    const Mat& samples1;
+    DepthDiffGate depthDiffGate;
+    Matx33d KRK_inv;
+    Vec3d Kt;
+    int chunkSize;
+    int* projIndices;
+    int* chunkCounts;
+};
+
+struct SparseCorrespsCompactor : public ParallelLoopBody
+{
+    SparseCorrespsCompactor(const Mat& _samples1, int _cols0, int _chunkSize, const int* _projIndices,
+                            const int* _chunkOffsets, Mat& _list)
+        : samples1(_samples1), cols0(_cols0), chunkSize(_chunkSize), projIndices(_projIndices),
+          chunkOffsets(_chunkOffsets), list(_list)
+    {}
+
+    virtual void operator()(const Range& range) const
+    {
+        const Vec3f* samples1_ptr = samples1.ptr<Vec3f>();
+        Vec4i * list_ptr = list.ptr<Vec4i>();
+        for(int c = range.start; c < range.end; c++)
+        {
+            const int iBegin = c * chunkSize, iEnd = std::min(samples1.rows, iBegin + chunkSize);
+            for(int i = iBegin, j = chunkOffsets[c]; i < iEnd; i++)
+            {
+                const int index = projIndices[i];
+                if(index >= 0)
+                    list_ptr[j++] = Vec4i(index % cols0, index / cols0,
+                                          cvRound(samples1_ptr[i][0]), cvRound(samples1_ptr[i][1]));
+            }
+        }
+    }
+
+    const Mat& samples1;
+    int cols0;
+    int chunkSize;
+    const int* projIndices;
+    const int* chunkOffsets;
+    Mat& list;
+};
+
+/* Projects the samples of depth1 to the frame of depth0. The chunk counts are saved to buffers.stripeCounts,
+ * the target indices of the samples to buffers.projIndices. Returns the count of the valid samples.
+ */
+static
+int projectSparseCorresps(const Matx33d& K, const Matx33d& K_inv, const Matx44d& Rt,
+                          const Mat& depth0, const Mat& validMask0, const Mat& samples1, const DepthDiffGate& depthDiffGate,
+                          OdometryWorkspace::Level& buffers, int& chunksCount, int& chunkSize)
+{
+    CV_Assert(samples1.rows <= (int)buffers.projIndices.total());
+
+    const Matx33d KRK_inv = K * Rt.get_minor<3,3>(0,0) * K_inv;
+    const Vec3d Kt = K * Vec3d(Rt(0,3), Rt(1,3), Rt(2,3));
+
+    // the chunks reuse the stripe counts of the dense search
+    chunksCount = std::min(samples1.rows, buffers.stripeCounts.cols / 2);
+    chunkSize = (samples1.rows + chunksCount - 1) / chunksCount;
+    int* chunkCounts = buffers.stripeCounts.ptr<int>();
+    parallel_for_(Range(0, chunksCount),
+                  SparseCorrespsProjector(depth0, validMask0, samples1, depthDiffGate, KRK_inv, Kt,
+                                          chunkSize, buffers.projIndices.ptr<int>(), chunkCounts));
+
+    int correspCount = 0;
+    for(int c = 0; c < chunksCount; c++)
+        correspCount += chunkCounts[c];
+    return correspCount;
+}
+
+/*
+ * Correspondences of one term for the given samples of depth1 (see prepareTexturedSamplesLevel()) as the list
+ * of (u0,v0,u1,v1) in the samples order, so the work is proportional to the samples count and not to the image size.
+ */
+static
+void computeSparseCorresps(const Matx33d& K, const Matx33d& K_inv, const Matx44d& Rt,
+                           const Mat& depth0, const Mat& validMask0, const Mat& samples1, const DepthDiffGate& depthDiffGate,
+                           OdometryWorkspace::Level& buffers, int term, Mat& _corresps)
+{
+    if(samples1.empty())
+    {
+        _corresps = buffers.correspsLists[term].rowRange(0, 0);
+        return;
+    }
+
+    int chunksCount = 0, chunkSize = 0;
+    const int correspCount = projectSparseCorresps(K, K_inv, Rt, depth0, validMask0, samples1, depthDiffGate,
+                                                   buffers, chunksCount, chunkSize);
+
+    // chunkCounts becomes the chunk offsets in the output list
+    int* chunkCounts = buffers.stripeCounts.ptr<int>();
+    for(int c = 0, offset = 0; c < chunksCount; c++)
+    {
+        int count = chunkCounts[c];
+        chunkCounts[c] = offset;
+        offset += count;
+    }
+
+    _corresps = buffers.correspsLists[term].rowRange(0, correspCount);
+    if(correspCount > 0)
+        parallel_for_(Range(0, chunksCount),
+                      SparseCorrespsCompactor(samples1, depth0.cols, chunkSize, buffers.projIndices.ptr<int>(),
+                                              chunkCounts, _corresps));
+}
+
+/*
+ * Correspondences of both terms of the merged odometry from one projection of depth1. They are saved to
+ * the CV_16SC2 images buffers.corresps[] with (u1,v1) at (u0,v0) or -1, as used by calcMergedLsmMatrices().
+ */
+static
+void computeMergedCorresps(const Matx33d& K, const Matx33d& K_inv, const Matx44d& Rt,
+                           const Mat& depth0, const Mat& validMask0,
+                           const Mat& depth1, const Mat& texturedMask1, const Mat& normalsMask1,
+                           const DepthDiffGate& depthDiffGate, OdometryWorkspace::Level& buffers,
+                           int& correspsRgbdCount, int& correspsICPCount)
+{
+    projectCorresps(K, K_inv, Rt, depth0, validMask0, depth1, buffers.selectMask, depthDiffGate, buffers);
+
+    const int *minV0 = buffers.projRowRanges.ptr<int>(), *maxV0 = minV0 + depth1.rows;
+    buffers.corresps[0] = Scalar::all(-1);
+    buffers.corresps[1] = Scalar::all(-1);
+
+    const int stripesCount = (depth1.rows + correspsStripeHeight - 1) / correspsStripeHeight;
+    int* stripeCounts = buffers.stripeCounts.ptr<int>();
+
+    CorrespsResolver resolver(buffers.projIndices, buffers.projDepths, minV0, maxV0);
+    resolver.addTerm(&texturedMask1, buffers.corresps[0], buffers.zBuffers[0], stripeCounts);
+    resolver.addTerm(&normalsMask1, buffers.corresps[1], buffers.zBuffers[1], stripeCounts + stripesCount);
+    parallel_for_(Range(0, stripesCount), resolver);
+
+    correspsRgbdCount = correspsICPCount = 0;
+    for(int s = 0; s < stripesCount; s++)
+    {
+        correspsRgbdCount += stripeCounts[s];
+        correspsICPCount += stripeCounts[stripesCount + s];
+    }
+}
+
+template<typename T>
 static inline
-void calcRgbdEquationCoeffs(double* C, double dIdx, double dIdy, const Point3f& p3d, double fx, double fy)
+void calcRgbdEquationCoeffs(T* C, T dIdx, T dIdy, const Point3f& p3d, T fx, T fy)
 {
-    double invz  = 1. / p3d.z,
+    T invz  = T(1) / p3d.z,
            v0 = dIdx * fx * invz,
            v1 = dIdy * fy * invz,
            v2 = -(v0 * p3d.x + v1 * p3d.y) * invz;
@@ -578,10 +1367,11 @@ void calcRgbdEquationCoeffs(double* C, double dIdx, double dIdy, const Point3f&
     C[5] = v2;
 }
 
+template<typename T>
 static inline
-void calcRgbdEquationCoeffsRotation(double* C, double dIdx, double dIdy, const Point3f& p3d, double fx, double fy)
+void calcRgbdEquationCoeffsRotation(T* C, T dIdx, T dIdy, const Point3f& p3d, T fx, T fy)
 {
-    double invz  = 1. / p3d.z,
+    T invz  = T(1) / p3d.z,
            v0 = dIdx * fx * invz,
            v1 = dIdy * fy * invz,
            v2 = -(v0 * p3d.x + v1 * p3d.y) * invz;
@@ -590,10 +1380,11 @@ void calcRgbdEquationCoeffsRotation(double* C, double dIdx, double dIdy, const P
     C[2] = -p3d.y * v0 + p3d.x * v1;
 }
 
+template<typename T>
 static inline
-void calcRgbdEquationCoeffsTranslation(double* C, double dIdx, double dIdy, const Point3f& p3d, double fx, double fy)
+void calcRgbdEquationCoeffsTranslation(T* C, T dIdx, T dIdy, const Point3f& p3d, T fx, T fy)
 {
-    double invz  = 1. / p3d.z,
+    T invz  = T(1) / p3d.z,
            v0 = dIdx * fx * invz,
            v1 = dIdy * fy * invz,
            v2 = -(v0 * p3d.x + v1 * p3d.y) * invz;
@@ -602,11 +1393,9 @@ void calcRgbdEquationCoeffsTranslation(double* C, double dIdx, double dIdy, cons
     C[2] = v2;
 }
 
-typedef
-void (*CalcRgbdEquationCoeffsPtr)(double*, double, double, const Point3f&, double, double);
-
+template<typename T>
 static inline
-void calcICPEquationCoeffs(double* C, const Point3f& p0, const Vec3f& n1)
+void calcICPEquationCoeffs(T* C, const Point3f& p0, const Vec3f& n1)
 {
     C[0] = -p0.z * n1[1] + p0.y * n1[2];
     C[1] =  p0.z * n1[0] - p0.x * n1[2];
@@ -616,169 +1405,1119 @@ void calcICPEquationCoeffs(double* C, const Point3f& p0, const Vec3f& n1)
     C[5] = n1[2];
 }
 
+template<typename T>
 static inline
-void calcICPEquationCoeffsRotation(double* C, const Point3f& p0, const Vec3f& n1)
+void calcICPEquationCoeffsRotation(T* C, const Point3f& p0, const Vec3f& n1)
 {
     C[0] = -p0.z * n1[1] + p0.y * n1[2];
     C[1] =  p0.z * n1[0] - p0.x * n1[2];
     C[2] = -p0.y * n1[0] + p0.x * n1[1];
 }
 
+template<typename T>
 static inline
-void calcICPEquationCoeffsTranslation(double* C, const Point3f& /*p0*/, const Vec3f& n1)
+void calcICPEquationCoeffsTranslation(T* C, const Point3f& /*p0*/, const Vec3f& n1)
 {
     C[0] = n1[0];
     C[1] = n1[1];
     C[2] = n1[2];
 }
 
-typedef
-void (*CalcICPEquationCoeffsPtr)(double*, const Point3f&, const Vec3f&);
+static inline
+Point3f transformPoint(const Point3f& p0, const double* Rt_ptr)
+{
+    Point3f tp0;
+    tp0.x = p0.x * Rt_ptr[0] + p0.y * Rt_ptr[1] + p0.z * Rt_ptr[2] + Rt_ptr[3];
+    tp0.y = p0.x * Rt_ptr[4] + p0.y * Rt_ptr[5] + p0.z * Rt_ptr[6] + Rt_ptr[7];
+    tp0.z = p0.x * Rt_ptr[8] + p0.y * Rt_ptr[9] + p0.z * Rt_ptr[10] + Rt_ptr[11];
+    return tp0;
+}
+
+static inline
+float calcRgbdDiff(const Mat& image0, const Mat& image1, int u0, int v0, int u1, int v1)
+{
+    return static_cast<float>(static_cast<int>(image0.at<uchar>(v0,u0)) -
+                              static_cast<int>(image1.at<uchar>(v1,u1)));
+}
 
-static 
-void calcRgbdLsmMatrices(const Mat& image0, const Mat& cloud0, const Mat& Rt,
+static inline
+float calcICPDiff(const Point3f& tp0, const Mat& cloud1, const Mat& normals1, int u1, int v1)
+{
+    const Vec3f& n1 = normals1.at<Vec3f>(v1, u1);
+    Point3f v = cloud1.at<Point3f>(v1,u1) - tp0;
+    return n1[0] * v.x + n1[1] * v.y + n1[2] * v.z;
+}
+
+/*
+ * Compile-time selection of the equation coefficients for the given transformation type,
+ * so that the LSM kernels below get them inlined. They are computed in the accumulation type T.
+ */
+template<int transformType>
+struct EquationCoeffs;
+
+template<>
+struct EquationCoeffs<Odometry::RIGID_BODY_MOTION>
+{
+    enum { dim = 6 };
+
+    template<typename T> static inline
+    void rgbd(T* C, double dIdx, double dIdy, const Point3f& p3d, double fx, double fy)
+    {
+        calcRgbdEquationCoeffs(C, static_cast<T>(dIdx), static_cast<T>(dIdy), p3d,
+                               static_cast<T>(fx), static_cast<T>(fy));
+    }
+
+    template<typename T> static inline
+    void icp(T* C, const Point3f& p0, const Vec3f& n1)
+    {
+        calcICPEquationCoeffs(C, p0, n1);
+    }
+};
+
+template<>
+struct EquationCoeffs<Odometry::ROTATION>
+{
+    enum { dim = 3 };
+
+    template<typename T> static inline
+    void rgbd(T* C, double dIdx, double dIdy, const Point3f& p3d, double fx, double fy)
+    {
+        calcRgbdEquationCoeffsRotation(C, static_cast<T>(dIdx), static_cast<T>(dIdy), p3d,
+                                       static_cast<T>(fx), static_cast<T>(fy));
+    }
+
+    template<typename T> static inline
+    void icp(T* C, const Point3f& p0, const Vec3f& n1)
+    {
+        calcICPEquationCoeffsRotation(C, p0, n1);
+    }
+};
+
+template<>
+struct EquationCoeffs<Odometry::TRANSLATION>
+{
+    enum { dim = 3 };
+
+    template<typename T> static inline
+    void rgbd(T* C, double dIdx, double dIdy, const Point3f& p3d, double fx, double fy)
+    {
+        calcRgbdEquationCoeffsTranslation(C, static_cast<T>(dIdx), static_cast<T>(dIdy), p3d,
+                                          static_cast<T>(fx), static_cast<T>(fy));
+    }
+
+    template<typename T> static inline
+    void icp(T* C, const Point3f& p0, const Vec3f& n1)
+    {
+        calcICPEquationCoeffsTranslation(C, p0, n1);
+    }
+};
+
+// Number of correspondences reduced by one task of the LSM accumulation. Partial sums are merged
+// in the block order, so the result does not depend on the number of threads.
+const int lsmBlockSize = 1024;
+
+/*
+ * Partial sums of one block: the upper triangle of AtA (row-major) followed by AtB. The LSM kernels accumulate
+ * a block in their type T (double or float) and save it as double, so the blocks are always merged in double.
+ */
+template<int dim>
+struct LsmSums
+{
+    enum { upperSize = dim * (dim + 1) / 2, size = upperSize + dim };
+
+    template<typename T> static inline
+    void add(T* sums, const T* A, double w, float diff)
+    {
+        for(int y = 0, i = 0; y < dim; y++)
+        {
+            for(int x = y; x < dim; x++, i++)
+                sums[i] += A[y] * A[x];
+
+            sums[upperSize + y] += A[y] * static_cast<T>(w) * static_cast<T>(diff);
+        }
+    }
+
+    /** Adds the merged partial sums to AtA and AtB (both of dim size). */
+    static
+    void merge(const double* blockSums, int blocksCount, Mat& AtA, Mat& AtB)
+    {
+        double sums[size] = {0};
+        for(int b = 0; b < blocksCount; b++)
+        {
+            const double* block = blockSums + b * size;
+            for(int i = 0; i < size; i++)
+                sums[i] += block[i];
+        }
+
+        CV_Assert(AtA.size() == Size(dim, dim) && AtA.type() == CV_64FC1);
+        CV_Assert(AtB.size() == Size(1, dim) && AtB.type() == CV_64FC1);
+        for(int y = 0, i = 0; y < dim; y++)
+        {
+            for(int x = y; x < dim; x++, i++)
+            {
+                AtA.at<double>(y,x) += sums[i];
+                if(x != y)
+                    AtA.at<double>(x,y) += sums[i];
+            }
+
+            AtB.at<double>(y) += sums[upperSize + y];
+        }
+    }
+};
+
+/*
+ * Multiplier of the equation of a correspondence for the given robust kernel, so that the weight of the residual
+ * in the normal equations is its square (the weight of the iteratively reweighted least squares).
+ * The thresholds of the M-estimators are the classical 95% efficiency constants in the units of the RMS residual.
+ */
+static inline
+double calcRobustWeight(int robustKernel, double sigma, float diff)
+{
+    const double absDiff = std::abs(diff);
+    switch(robustKernel)
+    {
+    case Odometry::ROBUST_KERNEL_NONE:
+        return 1.;
+    case Odometry::ROBUST_KERNEL_HUBER:
+    {
+        const double k = 1.345 * sigma;
+        return absDiff > k && k > DBL_EPSILON ? std::sqrt(k / absDiff) : 1.;
+    }
+    case Odometry::ROBUST_KERNEL_TUKEY:
+    {
+        const double k = 4.685 * sigma;
+        if(k <= DBL_EPSILON)
+            return 1.;
+        const double r = absDiff / k;
+        return r < 1. ? 1. - r * r : 0.;
+    }
+    case Odometry::ROBUST_KERNEL_CAUCHY:
+    {
+        const double k = 2.3849 * sigma;
+        if(k <= DBL_EPSILON)
+            return 1.;
+        const double r = absDiff / k;
+        return 1. / std::sqrt(1. + r * r);
+    }
+    default:
+    {
+        double w = sigma + absDiff;
+        return w > DBL_EPSILON ? 1./w : 1.;
+    }
+    }
+}
+
+static inline
+double mergeBlockSigmas(const double* blockSigmas, int blocksCount, int correspsCount)
+{
+    double sigma = 0;
+    for(int b = 0; b < blocksCount; b++)
+        sigma += blockSigmas[b];
+    return std::sqrt(sigma/correspsCount);
+}
+
+struct RgbdDiffsBody : public ParallelLoopBody
+{
+    RgbdDiffsBody(const Mat& _image0, const Mat& _image1, const Mat& _corresps,
+                  float* _diffs, double* _blockSigmas)
+        : image0(_image0), image1(_image1), corresps(_corresps), diffs(_diffs), blockSigmas(_blockSigmas)
+    {}
+
+    virtual void operator()(const Range& range) const
+    {
+        const Vec4i* corresps_ptr = corresps.ptr<Vec4i>();
+        for(int b = range.start; b < range.end; b++)
+        {
+            const int end = std::min(corresps.rows, (b + 1) * lsmBlockSize);
+            double sigma = 0;
+            for(int correspIndex = b * lsmBlockSize; correspIndex < end; correspIndex++)
+            {
+                const Vec4i& c = corresps_ptr[correspIndex];
+                int u0 = c[0], v0 = c[1];
+                int u1 = c[2], v1 = c[3];
+
+                diffs[correspIndex] = calcRgbdDiff(image0, image1, u0, v0, u1, v1);
+                sigma += diffs[correspIndex] * diffs[correspIndex];
+            }
+            blockSigmas[b] = sigma;
+        }
+    }
+
+    const Mat& image0;
+    const Mat& image1;
+    const Mat& corresps;
+    float* diffs;
+    double* blockSigmas;
+};
+
+/*
+ * Subpixel variant of RgbdDiffsBody. The target pixel of every correspondence is projected to the source
+ * image again without rounding, and the source intensity and point are sampled bilinearly at that position.
+ * The point falls back to the nearest one if a neighbour is invalid or lies across a depth discontinuity
+ * (farther than the correspondence gate).
+ * The transformed source points are stored for RgbdLsmBody.
+ */
+struct RgbdBilinearDiffsBody : public ParallelLoopBody
+{
+    RgbdBilinearDiffsBody(const Mat& _image0, const Mat& _cloud0, const Mat& _depth0, const Mat& _validMask0,
+                          const Mat& _image1, const Mat& _depth1, const Mat& _corresps,
+                          const Matx33d& _KRK_inv, const Vec3d& _Kt, const double* _Rt_ptr, const DepthDiffGate& _depthDiffGate,
+                          float* _diffs, Point3f* _tps0, double* _blockSigmas)
+        : image0(_image0), cloud0(_cloud0), depth0(_depth0), validMask0(_validMask0),
+          image1(_image1), depth1(_depth1), corresps(_corresps), KRK_inv(_KRK_inv), Kt(_Kt), Rt_ptr(_Rt_ptr),
+          depthDiffGate(_depthDiffGate), diffs(_diffs), tps0(_tps0), blockSigmas(_blockSigmas)
+    {}
+
+    virtual void operator()(const Range& range) const
+    {
+        const Vec4i* corresps_ptr = corresps.ptr<Vec4i>();
+        const double* KRK_inv_ptr = KRK_inv.val;
+        for(int b = range.start; b < range.end; b++)
+        {
+            const int end = std::min(corresps.rows, (b + 1) * lsmBlockSize);
+            double sigma = 0;
+            for(int correspIndex = b * lsmBlockSize; correspIndex < end; correspIndex++)
+            {
+                const Vec4i& c = corresps_ptr[correspIndex];
+                int u0 = c[0], v0 = c[1];
+                int u1 = c[2], v1 = c[3];
+
+                double d1 = depth1.at<float>(v1,u1);
+                double transformed_d1_inv = 1. / (d1 * (KRK_inv_ptr[6] * u1 + KRK_inv_ptr[7] * v1 + KRK_inv_ptr[8]) + Kt[2]);
+                float x0 = static_cast<float>(transformed_d1_inv *
+                                              (d1 * (KRK_inv_ptr[0] * u1 + KRK_inv_ptr[1] * v1 + KRK_inv_ptr[2]) + Kt[0]));
+                float y0 = static_cast<float>(transformed_d1_inv *
+                                              (d1 * (KRK_inv_ptr[3] * u1 + KRK_inv_ptr[4] * v1 + KRK_inv_ptr[5]) + Kt[1]));
+
+                float intensity0;
+                Point3f p0;
+                sample(x0, y0, u0, v0, intensity0, p0);
+
+                tps0[correspIndex] = transformPoint(p0, Rt_ptr);
+                diffs[correspIndex] = intensity0 - static_cast<float>(image1.at<uchar>(v1,u1));
+                sigma += diffs[correspIndex] * diffs[correspIndex];
+            }
+            blockSigmas[b] = sigma;
+        }
+    }
+
+    inline void sample(float x0, float y0, int u0, int v0, float& intensity0, Point3f& p0) const
+    {
+        const int ix = cvFloor(x0), iy = cvFloor(y0);
+        if((unsigned)ix >= (unsigned)(image0.cols - 1) || (unsigned)iy >= (unsigned)(image0.rows - 1))
+        {
+            intensity0 = static_cast<float>(image0.at<uchar>(v0,u0));
+            p0 = cloud0.at<Point3f>(v0,u0);
+            return;
+        }
+
+        const float ax = x0 - ix, ay = y0 - iy;
+        const float w00 = (1.f - ax) * (1.f - ay), w01 = ax * (1.f - ay),
+                    w10 = (1.f - ax) * ay, w11 = ax * ay;
+
+        const uchar *I0 = image0.ptr<uchar>(iy) + ix, *I1 = image0.ptr<uchar>(iy + 1) + ix;
+        intensity0 = w00 * I0[0] + w01 * I0[1] + w10 * I1[0] + w11 * I1[1];
+
+        const uchar *m0 = validMask0.ptr<uchar>(iy) + ix, *m1 = validMask0.ptr<uchar>(iy + 1) + ix;
+        const float *d0 = depth0.ptr<float>(iy) + ix, *d1 = depth0.ptr<float>(iy + 1) + ix;
+        const float nearestDepth = depth0.at<float>(v0,u0);
+        const float maxDepthDiff = depthDiffGate.threshold(nearestDepth);
+        if(m0[0] && m0[1] && m1[0] && m1[1] &&
+           std::abs(d0[0] - nearestDepth) <= maxDepthDiff && std::abs(d0[1] - nearestDepth) <= maxDepthDiff &&
+           std::abs(d1[0] - nearestDepth) <= maxDepthDiff && std::abs(d1[1] - nearestDepth) <= maxDepthDiff)
+        {
+            const Point3f *P0 = cloud0.ptr<Point3f>(iy) + ix, *P1 = cloud0.ptr<Point3f>(iy + 1) + ix;
+            p0 = P0[0] * w00 + P0[1] * w01 + P1[0] * w10 + P1[1] * w11;
+        }
+        else
+            p0 = cloud0.at<Point3f>(v0,u0);
+    }
+
+    const Mat& image0;
+    const Mat& cloud0;
+    const Mat& depth0;
+    const Mat& validMask0;
+    const Mat& image1;
+    const Mat& depth1;
+    const Mat& corresps;
+    Matx33d KRK_inv;
+    Vec3d Kt;
+    const double* Rt_ptr;
+    DepthDiffGate depthDiffGate;
+    float* diffs;
+    Point3f* tps0;
+    double* blockSigmas;
+};
+
+template<int transformType, typename T>
+struct RgbdLsmBody : public ParallelLoopBody
+{
+    typedef EquationCoeffs<transformType> Coeffs;
+    typedef LsmSums<Coeffs::dim> Sums;
+
+    RgbdLsmBody(const Mat& _cloud0, const double* _Rt_ptr, const Mat& _dI_dx1, const Mat& _dI_dy1,
+                const Mat& _corresps, double _fx, double _fy, double _sobelScale,
+                double _sigma, int _robustKernel, const float* _diffs, const Point3f* _tps0, double* _blockSums)
+        : cloud0(_cloud0), Rt_ptr(_Rt_ptr), dI_dx1(_dI_dx1), dI_dy1(_dI_dy1), corresps(_corresps),
+          fx(_fx), fy(_fy), sobelScale(_sobelScale), sigma(_sigma), robustKernel(_robustKernel),
+          diffs(_diffs), tps0(_tps0), blockSums(_blockSums)
+    {}
+
+    virtual void operator()(const Range& range) const
+    {
+        const Vec4i* corresps_ptr = corresps.ptr<Vec4i>();
+        T A_ptr[Coeffs::dim];
+        T sums[Sums::size];
+        for(int b = range.start; b < range.end; b++)
+        {
+            std::fill(sums, sums + Sums::size, T(0));
+
+            const int end = std::min(corresps.rows, (b + 1) * lsmBlockSize);
+            for(int correspIndex = b * lsmBlockSize; correspIndex < end; correspIndex++)
+            {
+                const Vec4i& c = corresps_ptr[correspIndex];
+                int u0 = c[0], v0 = c[1];
+                int u1 = c[2], v1 = c[3];
+
+                double w = calcRobustWeight(robustKernel, sigma, diffs[correspIndex]);
+
+                double w_sobelScale = w * sobelScale;
+
+                Point3f tp0 = tps0 ? tps0[correspIndex] : transformPoint(cloud0.at<Point3f>(v0,u0), Rt_ptr);
+
+                Coeffs::rgbd(A_ptr,
+                             w_sobelScale * dI_dx1.at<short int>(v1,u1),
+                             w_sobelScale * dI_dy1.at<short int>(v1,u1),
+                             tp0, fx, fy);
+
+                Sums::add(sums, A_ptr, w, diffs[correspIndex]);
+            }
+            std::copy(sums, sums + Sums::size, blockSums + b * Sums::size);
+        }
+    }
+
+    const Mat& cloud0;
+    const double* Rt_ptr;
+    const Mat& dI_dx1;
+    const Mat& dI_dy1;
+    const Mat& corresps;
+    double fx, fy, sobelScale, sigma;
+    int robustKernel;
+    const float* diffs;
+    const Point3f* tps0;
+    double* blockSums;
+};
+
+/*
+ * Projection data of the bilinear sampling of the RGB-D term, it maps the target pixels to the source image.
+ */
+struct RgbdSubpixelSampling
+{
+    RgbdSubpixelSampling(const Matx33d& K, const Matx33d& K_inv, const Matx44d& Rt,
+                         const Mat& _depth0, const Mat& _validMask0, const Mat& _depth1, const DepthDiffGate& _depthDiffGate)
+        : KRK_inv(K * Rt.get_minor<3,3>(0,0) * K_inv), Kt(K * Vec3d(Rt(0,3), Rt(1,3), Rt(2,3))),
+          depth0(_depth0), validMask0(_validMask0), depth1(_depth1), depthDiffGate(_depthDiffGate)
+    {}
+
+    Matx33d KRK_inv;
+    Vec3d Kt;
+    const Mat& depth0;
+    const Mat& validMask0;
+    const Mat& depth1;
+    DepthDiffGate depthDiffGate;
+};
+
+struct ICPDiffsBody : public ParallelLoopBody
+{
+    ICPDiffsBody(const Mat& _cloud0, const double* _Rt_ptr, const Mat& _cloud1, const Mat& _normals1,
+                 const Mat& _corresps, float* _diffs, Point3f* _tps0, double* _blockSigmas)
+        : cloud0(_cloud0), Rt_ptr(_Rt_ptr), cloud1(_cloud1), normals1(_normals1), corresps(_corresps),
+          diffs(_diffs), tps0(_tps0), blockSigmas(_blockSigmas)
+    {}
+
+    virtual void operator()(const Range& range) const
+    {
+        const Vec4i* corresps_ptr = corresps.ptr<Vec4i>();
+        for(int b = range.start; b < range.end; b++)
+        {
+            const int end = std::min(corresps.rows, (b + 1) * lsmBlockSize);
+            double sigma = 0;
+            for(int correspIndex = b * lsmBlockSize; correspIndex < end; correspIndex++)
+            {
+                const Vec4i& c = corresps_ptr[correspIndex];
+                int u0 = c[0], v0 = c[1];
+                int u1 = c[2], v1 = c[3];
+
+                Point3f tp0 = transformPoint(cloud0.at<Point3f>(v0,u0), Rt_ptr);
+
+                tps0[correspIndex] = tp0;
+                diffs[correspIndex] = calcICPDiff(tp0, cloud1, normals1, u1, v1);
+                sigma += diffs[correspIndex] * diffs[correspIndex];
+            }
+            blockSigmas[b] = sigma;
+        }
+    }
+
+    const Mat& cloud0;
+    const double* Rt_ptr;
+    const Mat& cloud1;
+    const Mat& normals1;
+    const Mat& corresps;
+    float* diffs;
+    Point3f* tps0;
+    double* blockSigmas;
+};
+
+template<int transformType, typename T>
+struct ICPLsmBody : public ParallelLoopBody
+{
+    typedef EquationCoeffs<transformType> Coeffs;
+    typedef LsmSums<Coeffs::dim> Sums;
+
+    ICPLsmBody(const Mat& _normals1, const Mat& _corresps, double _sigma, int _robustKernel,
+               const float* _diffs, const Point3f* _tps0, double* _blockSums)
+        : normals1(_normals1), corresps(_corresps), sigma(_sigma), robustKernel(_robustKernel),
+          diffs(_diffs), tps0(_tps0), blockSums(_blockSums)
+    {}
+
+    virtual void operator()(const Range& range) const
+    {
+        const Vec4i* corresps_ptr = corresps.ptr<Vec4i>();
+        T A_ptr[Coeffs::dim];
+        T sums[Sums::size];
+        for(int b = range.start; b < range.end; b++)
+        {
+            std::fill(sums, sums + Sums::size, T(0));
+
+            const int end = std::min(corresps.rows, (b + 1) * lsmBlockSize);
+            for(int correspIndex = b * lsmBlockSize; correspIndex < end; correspIndex++)
+            {
+                const Vec4i& c = corresps_ptr[correspIndex];
+                int u1 = c[2], v1 = c[3];
+
+                double w = calcRobustWeight(robustKernel, sigma, diffs[correspIndex]);
+
+                Coeffs::icp(A_ptr, tps0[correspIndex], normals1.at<Vec3f>(v1, u1) * w);
+
+                Sums::add(sums, A_ptr, w, diffs[correspIndex]);
+            }
+            std::copy(sums, sums + Sums::size, blockSums + b * Sums::size);
+        }
+    }
+
+    const Mat& normals1;
+    const Mat& corresps;
+    double sigma;
+    int robustKernel;
+    const float* diffs;
+    const Point3f* tps0;
+    double* blockSums;
+};
+
+template<int transformType>
+static
+double calcRgbdLsmMatricesImpl(const Mat& image0, const Mat& cloud0, const Matx44d& Rt,
+                             const Mat& image1, const Mat& dI_dx1, const Mat& dI_dy1,
+                             const Mat& corresps, double fx, double fy, double sobelScale,
+                             int robustKernel, bool floatAccumulation, const RgbdSubpixelSampling* subpixel,
+                             OdometryWorkspace::Level& buffers, Mat& AtA, Mat& AtB)
+{
+    typedef LsmSums<EquationCoeffs<transformType>::dim> Sums;
+
+    const int correspsCount = corresps.rows;
+    const int blocksCount = (correspsCount + lsmBlockSize - 1) / lsmBlockSize;
+
+    const double * Rt_ptr = Rt.val;
+
+    float* diffs = buffers.diffs.ptr<float>();
+    double* blockSums = buffers.blockSums.ptr<double>();
+    Point3f* transformedPoints0 = 0;
+
+    // blockSums holds the per block sigmas at first
+    if(subpixel)
+    {
+        transformedPoints0 = buffers.transformedPoints.ptr<Point3f>();
+        parallel_for_(Range(0, blocksCount),
+                      RgbdBilinearDiffsBody(image0, cloud0, subpixel->depth0, subpixel->validMask0,
+                                            image1, subpixel->depth1, corresps, subpixel->KRK_inv, subpixel->Kt,
+                                            Rt_ptr, subpixel->depthDiffGate, diffs, transformedPoints0, blockSums));
+    }
+    else
+        parallel_for_(Range(0, blocksCount), RgbdDiffsBody(image0, image1, corresps, diffs, blockSums));
+    double sigma = mergeBlockSigmas(blockSums, blocksCount, correspsCount);
+
+    if(floatAccumulation)
+        parallel_for_(Range(0, blocksCount),
+                      RgbdLsmBody<transformType, float>(cloud0, Rt_ptr, dI_dx1, dI_dy1, corresps, fx, fy, sobelScale,
+                                                        sigma, robustKernel, diffs, transformedPoints0, blockSums));
+    else
+        parallel_for_(Range(0, blocksCount),
+                      RgbdLsmBody<transformType, double>(cloud0, Rt_ptr, dI_dx1, dI_dy1, corresps, fx, fy, sobelScale,
+                                                         sigma, robustKernel, diffs, transformedPoints0, blockSums));
+    Sums::merge(blockSums, blocksCount, AtA, AtB);
+
+    return sigma;
+}
+
+/* Adds the RGB-D term to the normal equations and returns its RMS residual before the update.
+ * The source image and cloud are sampled bilinearly if subpixel is not null.
+ */
+static
+double calcRgbdLsmMatrices(const Mat& image0, const Mat& cloud0, const Matx44d& Rt,
                const Mat& image1, const Mat& dI_dx1, const Mat& dI_dy1,
                const Mat& corresps, double fx, double fy, double sobelScale,
-               Mat& AtA, Mat& AtB, CalcRgbdEquationCoeffsPtr func, int transformDim)
+               int robustKernel, bool floatAccumulation, const RgbdSubpixelSampling* subpixel,
+               OdometryWorkspace::Level& buffers, Mat& AtA, Mat& AtB, int transformType)
 {
-    AtA = Mat(transformDim, transformDim, CV_64FC1, Scalar(0));
-    AtB = Mat(transformDim, 1, CV_64FC1, Scalar(0));
-    double* AtB_ptr = AtB.ptr<double>();
+    switch(transformType)
+    {
+    case Odometry::RIGID_BODY_MOTION:
+        return calcRgbdLsmMatricesImpl<Odometry::RIGID_BODY_MOTION>(image0, cloud0, Rt, image1, dI_dx1, dI_dy1,
+                                                                    corresps, fx, fy, sobelScale, robustKernel, floatAccumulation,
+                                                                    subpixel, buffers, AtA, AtB);
+    case Odometry::ROTATION:
+        return calcRgbdLsmMatricesImpl<Odometry::ROTATION>(image0, cloud0, Rt, image1, dI_dx1, dI_dy1,
+                                                           corresps, fx, fy, sobelScale, robustKernel, floatAccumulation,
+                                                                    subpixel, buffers, AtA, AtB);
+    case Odometry::TRANSLATION:
+        return calcRgbdLsmMatricesImpl<Odometry::TRANSLATION>(image0, cloud0, Rt, image1, dI_dx1, dI_dy1,
+                                                              corresps, fx, fy, sobelScale, robustKernel, floatAccumulation,
+                                                                    subpixel, buffers, AtA, AtB);
+    default:
+        CV_Error(CV_StsBadArg, "Incorrect transformation type");
+    }
+    return 0;
+}
+
+template<int transformType>
+static
+double calcICPLsmMatricesImpl(const Mat& cloud0, const Matx44d& Rt,
+                            const Mat& cloud1, const Mat& normals1,
+                            const Mat& corresps, int robustKernel, bool floatAccumulation,
+                            OdometryWorkspace::Level& buffers, Mat& AtA, Mat& AtB)
+{
+    typedef LsmSums<EquationCoeffs<transformType>::dim> Sums;
 
     const int correspsCount = corresps.rows;
+    const int blocksCount = (correspsCount + lsmBlockSize - 1) / lsmBlockSize;
 
-    CV_Assert(Rt.type() == CV_64FC1);
-    const double * Rt_ptr = Rt.ptr<const double>();
+    const double * Rt_ptr = Rt.val;
 
-    AutoBuffer<float> diffs(correspsCount);
-    float* diffs_ptr = diffs;
+    float* diffs = buffers.diffs.ptr<float>();
+    Point3f* transformedPoints0 = buffers.transformedPoints.ptr<Point3f>();
+    double* blockSums = buffers.blockSums.ptr<double>();
 
-    const Vec4i* corresps_ptr = corresps.ptr<Vec4i>();
+    // blockSums holds the per block sigmas at first
+    parallel_for_(Range(0, blocksCount),
+                  ICPDiffsBody(cloud0, Rt_ptr, cloud1, normals1, corresps, diffs, transformedPoints0, blockSums));
+    double sigma = mergeBlockSigmas(blockSums, blocksCount, correspsCount);
 
-    double sigma = 0;
-    for(int correspIndex = 0; correspIndex < corresps.rows; correspIndex++)
+    if(floatAccumulation)
+        parallel_for_(Range(0, blocksCount),
+                      ICPLsmBody<transformType, float>(normals1, corresps, sigma, robustKernel, diffs,
+                                                       transformedPoints0, blockSums));
+    else
+        parallel_for_(Range(0, blocksCount),
+                      ICPLsmBody<transformType, double>(normals1, corresps, sigma, robustKernel, diffs,
+                                                        transformedPoints0, blockSums));
+    Sums::merge(blockSums, blocksCount, AtA, AtB);
+
+    return sigma;
+}
+
+/* Adds the ICP term to the normal equations and returns its RMS residual before the update.
+ */
+static
+double calcICPLsmMatrices(const Mat& cloud0, const Matx44d& Rt,
+                          const Mat& cloud1, const Mat& normals1,
+                          const Mat& corresps, int robustKernel, bool floatAccumulation,
+                          OdometryWorkspace::Level& buffers, Mat& AtA, Mat& AtB, int transformType)
+{
+    switch(transformType)
     {
-         const Vec4i& c = corresps_ptr[correspIndex];
-         int u0 = c[0], v0 = c[1];
-         int u1 = c[2], v1 = c[3];
-              
-         diffs_ptr[correspIndex] = static_cast<float>(static_cast<int>(image0.at<uchar>(v0,u0)) - 
-                                                      static_cast<int>(image1.at<uchar>(v1,u1)));
-         sigma += diffs_ptr[correspIndex] * diffs_ptr[correspIndex];
+    case Odometry::RIGID_BODY_MOTION:
+        return calcICPLsmMatricesImpl<Odometry::RIGID_BODY_MOTION>(cloud0, Rt, cloud1, normals1, corresps,
+                                                                   robustKernel, floatAccumulation, buffers, AtA, AtB);
+    case Odometry::ROTATION:
+        return calcICPLsmMatricesImpl<Odometry::ROTATION>(cloud0, Rt, cloud1, normals1, corresps,
+                                                                   robustKernel, floatAccumulation, buffers, AtA, AtB);
+    case Odometry::TRANSLATION:
+        return calcICPLsmMatricesImpl<Odometry::TRANSLATION>(cloud0, Rt, cloud1, normals1, corresps,
+                                                                   robustKernel, floatAccumulation, buffers, AtA, AtB);
+    default:
+        CV_Error(CV_StsBadArg, "Incorrect transformation type");
     }
-    sigma = std::sqrt(sigma/correspsCount);
+    return 0;
+}
+
+/*
+ * Inverse compositional RGB-D term. The Jacobian of a sample is taken at its own point of the dstFrame, so it
+ * does not depend on the current transformation, and without reweighting the Hessian of the level is constant.
+ * The solution is applied as the one of the forward term (exp(ksi) * Rt), that's the inverse composition
+ * for the warp of the samples by the inverse of Rt.
+ */
+template<int transformType>
+struct RgbdICJacobiansBody : public ParallelLoopBody
+{
+    typedef EquationCoeffs<transformType> Coeffs;
+    typedef LsmSums<Coeffs::dim> Sums;
 
-    vector<double> A_buf(transformDim);
-    double* A_ptr = &A_buf[0];
+    RgbdICJacobiansBody(const Mat& _samples1, const Mat& _dI_dx1, const Mat& _dI_dy1, const Matx33d& _K_inv,
+                        double _fx, double _fy, double _sobelScale, Mat& _jacobians, double* _blockSums)
+        : samples1(_samples1), dI_dx1(_dI_dx1), dI_dy1(_dI_dy1), K_inv(_K_inv),
+          fx(_fx), fy(_fy), sobelScale(_sobelScale), jacobians(_jacobians), blockSums(_blockSums)
+    {}
 
-    for(int correspIndex = 0; correspIndex < corresps.rows; correspIndex++)
+    virtual void operator()(const Range& range) const
     {
-         const Vec4i& c = corresps_ptr[correspIndex];
-         int u0 = c[0], v0 = c[1];
-         int u1 = c[2], v1 = c[3];
+        const Vec3f* samples1_ptr = samples1.ptr<Vec3f>();
+        for(int b = range.start; b < range.end; b++)
+        {
+            double* sums = blockSums + b * Sums::size;
+            std::fill(sums, sums + Sums::size, 0.);
 
-         double w = sigma + std::abs(diffs_ptr[correspIndex]);
-         w = w > DBL_EPSILON ? 1./w : 1.;
+            const int end = std::min(samples1.rows, (b + 1) * lsmBlockSize);
+            for(int i = b * lsmBlockSize; i < end; i++)
+            {
+                const Vec3f& s = samples1_ptr[i];
+                int u1 = cvRound(s[0]), v1 = cvRound(s[1]);
+                Vec3d p1 = K_inv * Vec3d(s[0], s[1], 1.) * static_cast<double>(s[2]);
+
+                double* J = jacobians.ptr<double>(i);
+                Coeffs::rgbd(J,
+                             sobelScale * dI_dx1.at<short int>(v1,u1),
+                             sobelScale * dI_dy1.at<short int>(v1,u1),
+                             Point3f(static_cast<float>(p1[0]), static_cast<float>(p1[1]), static_cast<float>(p1[2])),
+                             fx, fy);
+
+                // only the Hessian part of the sums
+                Sums::add(sums, J, 0., 0.f);
+            }
+        }
+    }
 
-         double w_sobelScale = w * sobelScale;
+    const Mat& samples1;
+    const Mat& dI_dx1;
+    const Mat& dI_dy1;
+    Matx33d K_inv;
+    double fx, fy, sobelScale;
+    Mat& jacobians;
+    double* blockSums;
+};
 
-         const Point3f& p0 = cloud0.at<Point3f>(v0,u0);
-         Point3f tp0;
-         tp0.x = p0.x * Rt_ptr[0] + p0.y * Rt_ptr[1] + p0.z * Rt_ptr[2] + Rt_ptr[3];
-         tp0.y = p0.x * Rt_ptr[4] + p0.y * Rt_ptr[5] + p0.z * Rt_ptr[6] + Rt_ptr[7];
-         tp0.z = p0.x * Rt_ptr[8] + p0.y * Rt_ptr[9] + p0.z * Rt_ptr[10] + Rt_ptr[11];
+struct RgbdICDiffsBody : public ParallelLoopBody
+{
+    RgbdICDiffsBody(const Mat& _image0, const Mat& _image1, const Mat& _samples1, const int* _projIndices,
+                    float* _diffs, double* _blockSigmas)
+        : image0(_image0), image1(_image1), samples1(_samples1), projIndices(_projIndices),
+          diffs(_diffs), blockSigmas(_blockSigmas)
+    {}
 
-         func(A_ptr,
-              w_sobelScale * dI_dx1.at<short int>(v1,u1),
-              w_sobelScale * dI_dy1.at<short int>(v1,u1),
-              tp0, fx, fy);
+    virtual void operator()(const Range& range) const
+    {
+        const Vec3f* samples1_ptr = samples1.ptr<Vec3f>();
+        for(int b = range.start; b < range.end; b++)
+        {
+            const int end = std::min(samples1.rows, (b + 1) * lsmBlockSize);
+            double sigma = 0;
+            for(int i = b * lsmBlockSize; i < end; i++)
+            {
+                const int index = projIndices[i];
+                if(index < 0)
+                    continue;
 
-        for(int y = 0; y < transformDim; y++)
+                diffs[i] = calcRgbdDiff(image0, image1, index % image0.cols, index / image0.cols,
+                                        cvRound(samples1_ptr[i][0]), cvRound(samples1_ptr[i][1]));
+                sigma += diffs[i] * diffs[i];
+            }
+            blockSigmas[b] = sigma;
+        }
+    }
+
+    const Mat& image0;
+    const Mat& image1;
+    const Mat& samples1;
+    const int* projIndices;
+    float* diffs;
+    double* blockSigmas;
+};
+
+/*
+ * Residual pass of the inverse compositional term. The valid samples add their residuals to AtB. If most of
+ * the samples are valid, the invalid ones are summed to be subtracted from the Hessian of the level,
+ * otherwise the Hessian is summed from the valid ones.
+ */
+template<int dim>
+struct RgbdICLsmBody : public ParallelLoopBody
+{
+    typedef LsmSums<dim> Sums;
+
+    RgbdICLsmBody(const Mat& _jacobians, int _samplesCount, const int* _projIndices, const float* _diffs,
+                  bool _sumInvalidHessian, double* _blockSums)
+        : jacobians(_jacobians), samplesCount(_samplesCount), projIndices(_projIndices), diffs(_diffs),
+          sumInvalidHessian(_sumInvalidHessian), blockSums(_blockSums)
+    {}
+
+    virtual void operator()(const Range& range) const
+    {
+        for(int b = range.start; b < range.end; b++)
         {
-            double* AtA_ptr = AtA.ptr<double>(y);
-            for(int x = y; x < transformDim; x++)
-                AtA_ptr[x] += A_ptr[y] * A_ptr[x];
+            double* sums = blockSums + b * Sums::size;
+            std::fill(sums, sums + Sums::size, 0.);
 
-            AtB_ptr[y] += A_ptr[y] * w * diffs_ptr[correspIndex];
+            const int end = std::min(samplesCount, (b + 1) * lsmBlockSize);
+            for(int i = b * lsmBlockSize; i < end; i++)
+            {
+                const double* J = jacobians.ptr<double>(i);
+                const bool isValid = projIndices[i] >= 0;
+                if(isValid)
+                {
+                    for(int y = 0; y < dim; y++)
+                        sums[Sums::upperSize + y] += J[y] * diffs[i];
+                }
+
+                if(isValid != sumInvalidHessian)
+                {
+                    for(int y = 0, k = 0; y < dim; y++)
+                        for(int x = y; x < dim; x++, k++)
+                            sums[k] += J[y] * J[x];
+                }
+            }
         }
-    }		
-    
-    for(int y = 0; y < transformDim; y++)
-        for(int x = y+1; x < transformDim; x++)
-            AtA.at<double>(x,y) = AtA.at<double>(y,x);
+    }
+
+    const Mat& jacobians;
+    int samplesCount;
+    const int* projIndices;
+    const float* diffs;
+    bool sumInvalidHessian;
+    double* blockSums;
+};
+
+template<int transformType>
+static
+void prepareRgbdICLevelImpl(const Mat& samples1, const Mat& dI_dx1, const Mat& dI_dy1, const Matx33d& K_inv,
+                            double fx, double fy, double sobelScale, OdometryWorkspace::Level& buffers)
+{
+    typedef LsmSums<EquationCoeffs<transformType>::dim> Sums;
+    const int dim = EquationCoeffs<transformType>::dim;
+
+    // allocated once for all the pixels of the level and any transformation type
+    if(buffers.jacobians.rows < samples1.rows)
+        buffers.jacobians.create((int)buffers.projIndices.total(), 6, CV_64FC1);
+
+    const int blocksCount = (samples1.rows + lsmBlockSize - 1) / lsmBlockSize;
+    double* blockSums = buffers.blockSums.ptr<double>();
+    parallel_for_(Range(0, blocksCount),
+                  RgbdICJacobiansBody<transformType>(samples1, dI_dx1, dI_dy1, K_inv, fx, fy, sobelScale,
+                                                     buffers.jacobians, blockSums));
+
+    buffers.hessian.create(dim, dim, CV_64FC1);
+    buffers.hessian = Scalar(0);
+    Matx<double,dim,1> B;
+    Mat B_header(dim, 1, CV_64FC1, B.val);
+    Sums::merge(blockSums, blocksCount, buffers.hessian, B_header);
 }
 
+/* Computes the Jacobians of the samples and the Hessian of the inverse compositional term for a level.
+ */
 static
-void calcICPLsmMatrices(const Mat& cloud0, const Mat& Rt,
-                        const Mat& cloud1, const Mat& normals1,
-                        const Mat& corresps,
-                        Mat& AtA, Mat& AtB, CalcICPEquationCoeffsPtr func, int transformDim)
+void prepareRgbdICLevel(const Mat& samples1, const Mat& dI_dx1, const Mat& dI_dy1, const Matx33d& K_inv,
+                        double fx, double fy, double sobelScale, OdometryWorkspace::Level& buffers, int transformType)
 {
-    AtA = Mat(transformDim, transformDim, CV_64FC1, Scalar(0));
-    AtB = Mat(transformDim, 1, CV_64FC1, Scalar(0));
-    double* AtB_ptr = AtB.ptr<double>();
+    switch(transformType)
+    {
+    case Odometry::RIGID_BODY_MOTION:
+        prepareRgbdICLevelImpl<Odometry::RIGID_BODY_MOTION>(samples1, dI_dx1, dI_dy1, K_inv, fx, fy, sobelScale, buffers);
+        break;
+    case Odometry::ROTATION:
+        prepareRgbdICLevelImpl<Odometry::ROTATION>(samples1, dI_dx1, dI_dy1, K_inv, fx, fy, sobelScale, buffers);
+        break;
+    case Odometry::TRANSLATION:
+        prepareRgbdICLevelImpl<Odometry::TRANSLATION>(samples1, dI_dx1, dI_dy1, K_inv, fx, fy, sobelScale, buffers);
+        break;
+    default:
+        CV_Error(CV_StsBadArg, "Incorrect transformation type");
+    }
+}
 
-    const int correspsCount = corresps.rows;
+template<int dim>
+static
+double calcRgbdICLsmMatricesImpl(const Mat& image0, const Mat& image1, const Mat& samples1, int correspsCount,
+                                 OdometryWorkspace::Level& buffers, Mat& AtA, Mat& AtB)
+{
+    typedef LsmSums<dim> Sums;
 
-    CV_Assert(Rt.type() == CV_64FC1);
-    const double * Rt_ptr = Rt.ptr<const double>();
+    const int blocksCount = (samples1.rows + lsmBlockSize - 1) / lsmBlockSize;
+    const int* projIndices = buffers.projIndices.ptr<int>();
+    float* diffs = buffers.diffs.ptr<float>();
+    double* blockSums = buffers.blockSums.ptr<double>();
 
-    AutoBuffer<float> diffs(correspsCount);
-    float * diffs_ptr = diffs;
+    // blockSums holds the per block sigmas at first
+    parallel_for_(Range(0, blocksCount), RgbdICDiffsBody(image0, image1, samples1, projIndices, diffs, blockSums));
+    double sigma = mergeBlockSigmas(blockSums, blocksCount, correspsCount);
 
-    AutoBuffer<Point3f> transformedPoints0(correspsCount);
-    Point3f * tps0_ptr = transformedPoints0;
+    const bool sumInvalidHessian = 2 * correspsCount > samples1.rows;
+    parallel_for_(Range(0, blocksCount),
+                  RgbdICLsmBody<dim>(buffers.jacobians, samples1.rows, projIndices, diffs, sumInvalidHessian, blockSums));
 
-    const Vec4i* corresps_ptr = corresps.ptr<Vec4i>();
+    Matx<double,dim,dim> H;
+    Matx<double,dim,1> B;
+    Mat H_header(dim, dim, CV_64FC1, H.val), B_header(dim, 1, CV_64FC1, B.val);
+    Sums::merge(blockSums, blocksCount, H_header, B_header);
 
-    double sigma = 0;
-    for(int correspIndex = 0; correspIndex < corresps.rows; correspIndex++)
+    if(sumInvalidHessian)
     {
-        const Vec4i& c = corresps_ptr[correspIndex];
-        int u0 = c[0], v0 = c[1];
-        int u1 = c[2], v1 = c[3];
+        add(AtA, buffers.hessian, AtA);
+        subtract(AtA, H_header, AtA);
+    }
+    else
+        add(AtA, H_header, AtA);
+    add(AtB, B_header, AtB);
+
+    return sigma;
+}
+
+/* Adds the inverse compositional RGB-D term to the normal equations for the samples projected by
+ * projectSparseCorresps() and returns its RMS residual before the update.
+ */
+static
+double calcRgbdICLsmMatrices(const Mat& image0, const Mat& image1, const Mat& samples1, int correspsCount,
+                             OdometryWorkspace::Level& buffers, Mat& AtA, Mat& AtB, int transformType)
+{
+    if(transformType == Odometry::RIGID_BODY_MOTION)
+        return calcRgbdICLsmMatricesImpl<6>(image0, image1, samples1, correspsCount, buffers, AtA, AtB);
+    return calcRgbdICLsmMatricesImpl<3>(image0, image1, samples1, correspsCount, buffers, AtA, AtB);
+}
+
+/*
+ * Sigma pass of the merged odometry: sums of the squared RGB-D and ICP residuals per stripe of target rows.
+ */
+struct MergedDiffsBody : public ParallelLoopBody
+{
+    MergedDiffsBody(const Mat& _image0, const Mat& _cloud0, const double* _Rt_ptr,
+                    const Mat& _image1, const Mat& _cloud1, const Mat& _normals1,
+                    const Mat& _correspsRgbd, const Mat& _correspsICP, double* _stripeSigmas)
+        : image0(_image0), cloud0(_cloud0), Rt_ptr(_Rt_ptr), image1(_image1), cloud1(_cloud1), normals1(_normals1),
+          correspsRgbd(_correspsRgbd), correspsICP(_correspsICP), stripeSigmas(_stripeSigmas)
+    {}
+
+    virtual void operator()(const Range& range) const
+    {
+        for(int s = range.start; s < range.end; s++)
+        {
+            const int vBegin = s * correspsStripeHeight,
+                      vEnd = std::min(correspsRgbd.rows, vBegin + correspsStripeHeight);
+            double sigmaRgbd = 0, sigmaICP = 0;
+            for(int v0 = vBegin; v0 < vEnd; v0++)
+            {
+                const Vec2s* rgbd_row = correspsRgbd.ptr<Vec2s>(v0);
+                const Vec2s* icp_row = correspsICP.ptr<Vec2s>(v0);
+                for(int u0 = 0; u0 < correspsRgbd.cols; u0++)
+                {
+                    const Vec2s& cr = rgbd_row[u0];
+                    if(cr[0] != -1)
+                    {
+                        float diff = calcRgbdDiff(image0, image1, u0, v0, cr[0], cr[1]);
+                        sigmaRgbd += diff * diff;
+                    }
+                    const Vec2s& ci = icp_row[u0];
+                    if(ci[0] != -1)
+                    {
+                        Point3f tp0 = transformPoint(cloud0.at<Point3f>(v0,u0), Rt_ptr);
+                        float diff = calcICPDiff(tp0, cloud1, normals1, ci[0], ci[1]);
+                        sigmaICP += diff * diff;
+                    }
+                }
+            }
+            stripeSigmas[2*s] = sigmaRgbd;
+            stripeSigmas[2*s+1] = sigmaICP;
+        }
+    }
+
+    const Mat& image0;
+    const Mat& cloud0;
+    const double* Rt_ptr;
+    const Mat& image1;
+    const Mat& cloud1;
+    const Mat& normals1;
+    const Mat& correspsRgbd;
+    const Mat& correspsICP;
+    double* stripeSigmas;
+};
+
+/*
+ * Fused accumulation of the merged odometry: both correspondence images are traversed together,
+ * the source point is transformed once per target pixel and the RGB-D and ICP equations go straight
+ * to the same normal equations, without the correspondence lists and the per-correspondence buffers.
+ */
+template<int transformType, typename T>
+struct MergedLsmBody : public ParallelLoopBody
+{
+    typedef EquationCoeffs<transformType> Coeffs;
+    typedef LsmSums<Coeffs::dim> Sums;
+
+    MergedLsmBody(const Mat& _image0, const Mat& _cloud0, const double* _Rt_ptr,
+                  const Mat& _image1, const Mat& _dI_dx1, const Mat& _dI_dy1, const Mat& _cloud1, const Mat& _normals1,
+                  const Mat& _correspsRgbd, const Mat& _correspsICP, bool _useRgbd, bool _useICP,
+                  double _fx, double _fy, double _sobelScale, double _sigmaRgbd, double _sigmaICP, int _robustKernel,
+                  double* _blockSums)
+        : image0(_image0), cloud0(_cloud0), Rt_ptr(_Rt_ptr), image1(_image1), dI_dx1(_dI_dx1), dI_dy1(_dI_dy1),
+          cloud1(_cloud1), normals1(_normals1), correspsRgbd(_correspsRgbd), correspsICP(_correspsICP),
+          useRgbd(_useRgbd), useICP(_useICP), fx(_fx), fy(_fy), sobelScale(_sobelScale),
+          sigmaRgbd(_sigmaRgbd), sigmaICP(_sigmaICP), robustKernel(_robustKernel), blockSums(_blockSums)
+    {}
+
+    virtual void operator()(const Range& range) const
+    {
+        T A_ptr[Coeffs::dim];
+        T sums[Sums::size];
+        for(int s = range.start; s < range.end; s++)
+        {
+            std::fill(sums, sums + Sums::size, T(0));
+
+            const int vBegin = s * correspsStripeHeight,
+                      vEnd = std::min(correspsRgbd.rows, vBegin + correspsStripeHeight);
+            for(int v0 = vBegin; v0 < vEnd; v0++)
+            {
+                const Vec2s* rgbd_row = correspsRgbd.ptr<Vec2s>(v0);
+                const Vec2s* icp_row = correspsICP.ptr<Vec2s>(v0);
+                for(int u0 = 0; u0 < correspsRgbd.cols; u0++)
+                {
+                    const Vec2s& cr = rgbd_row[u0];
+                    const Vec2s& ci = icp_row[u0];
+                    const bool hasRgbd = useRgbd && cr[0] != -1,
+                               hasICP = useICP && ci[0] != -1;
+                    if(!hasRgbd && !hasICP)
+                        continue;
 
-        const Point3f& p0 = cloud0.at<Point3f>(v0,u0);
-        Point3f tp0;
-        tp0.x = p0.x * Rt_ptr[0] + p0.y * Rt_ptr[1] + p0.z * Rt_ptr[2] + Rt_ptr[3];
-        tp0.y = p0.x * Rt_ptr[4] + p0.y * Rt_ptr[5] + p0.z * Rt_ptr[6] + Rt_ptr[7];
-        tp0.z = p0.x * Rt_ptr[8] + p0.y * Rt_ptr[9] + p0.z * Rt_ptr[10] + Rt_ptr[11];
+                    Point3f tp0 = transformPoint(cloud0.at<Point3f>(v0,u0), Rt_ptr);
 
-        Vec3f n1 = normals1.at<Vec3f>(v1, u1);
-        Point3f v = cloud1.at<Point3f>(v1,u1) - tp0;
+                    if(hasRgbd)
+                    {
+                        int u1 = cr[0], v1 = cr[1];
+                        float diff = calcRgbdDiff(image0, image1, u0, v0, u1, v1);
+                        double w = calcRobustWeight(robustKernel, sigmaRgbd, diff);
+
+                        double w_sobelScale = w * sobelScale;
+                        Coeffs::rgbd(A_ptr,
+                                     w_sobelScale * dI_dx1.at<short int>(v1,u1),
+                                     w_sobelScale * dI_dy1.at<short int>(v1,u1),
+                                     tp0, fx, fy);
+                        Sums::add(sums, A_ptr, w, diff);
+                    }
+                    if(hasICP)
+                    {
+                        int u1 = ci[0], v1 = ci[1];
+                        float diff = calcICPDiff(tp0, cloud1, normals1, u1, v1);
+                        double w = calcRobustWeight(robustKernel, sigmaICP, diff);
 
-        tps0_ptr[correspIndex] = tp0;
-        diffs_ptr[correspIndex] = n1[0] * v.x + n1[1] * v.y + n1[2] * v.z;
-        sigma += diffs_ptr[correspIndex] * diffs_ptr[correspIndex];
+                        Coeffs::icp(A_ptr, tp0, normals1.at<Vec3f>(v1, u1) * w);
+                        Sums::add(sums, A_ptr, w, diff);
+                    }
+                }
+            }
+            std::copy(sums, sums + Sums::size, blockSums + s * Sums::size);
+        }
     }
 
-    sigma = std::sqrt(sigma/correspsCount);
+    const Mat& image0;
+    const Mat& cloud0;
+    const double* Rt_ptr;
+    const Mat& image1;
+    const Mat& dI_dx1;
+    const Mat& dI_dy1;
+    const Mat& cloud1;
+    const Mat& normals1;
+    const Mat& correspsRgbd;
+    const Mat& correspsICP;
+    bool useRgbd, useICP;
+    double fx, fy, sobelScale, sigmaRgbd, sigmaICP;
+    int robustKernel;
+    double* blockSums;
+};
 
-    vector<double> A_buf(transformDim);
-    double* A_ptr = &A_buf[0];
-    for(int correspIndex = 0; correspIndex < corresps.rows; correspIndex++)
+template<int transformType>
+static
+void calcMergedLsmMatricesImpl(const Mat& image0, const Mat& cloud0, const Matx44d& Rt,
+                               const Mat& image1, const Mat& dI_dx1, const Mat& dI_dy1,
+                               const Mat& cloud1, const Mat& normals1,
+                               OdometryWorkspace::Level& buffers, int correspsRgbdCount, int correspsICPCount,
+                               bool useRgbd, bool useICP, double fx, double fy, double sobelScale,
+                               int robustKernel, bool floatAccumulation,
+                               Mat& AtA, Mat& AtB, double& sigmaRgbd, double& sigmaICP)
+{
+    typedef LsmSums<EquationCoeffs<transformType>::dim> Sums;
+
+    const double * Rt_ptr = Rt.val;
+    const Mat& correspsRgbd = buffers.corresps[0];
+    const Mat& correspsICP = buffers.corresps[1];
+
+    const int stripesCount = (correspsRgbd.rows + correspsStripeHeight - 1) / correspsStripeHeight;
+    double* blockSums = buffers.blockSums.ptr<double>();
+
+    // blockSums holds the per stripe sigmas of both terms at first
+    parallel_for_(Range(0, stripesCount),
+                  MergedDiffsBody(image0, cloud0, Rt_ptr, image1, cloud1, normals1,
+                                  correspsRgbd, correspsICP, blockSums));
+    sigmaRgbd = 0;
+    sigmaICP = 0;
+    for(int s = 0; s < stripesCount; s++)
     {
-        const Vec4i& c = corresps_ptr[correspIndex];
-        int u1 = c[2], v1 = c[3];
-
-        double w = sigma + std::abs(diffs_ptr[correspIndex]);
-        w = w > DBL_EPSILON ? 1./w : 1.;
-
-        func(A_ptr, tps0_ptr[correspIndex], normals1.at<Vec3f>(v1, u1) * w);
-
-        for(int y = 0; y < transformDim; y++)
-        {
-            double* AtA_ptr = AtA.ptr<double>(y);
-            for(int x = y; x < transformDim; x++)
-                AtA_ptr[x] += A_ptr[y] * A_ptr[x];
-
-            AtB_ptr[y] += A_ptr[y] * w * diffs_ptr[correspIndex];
-        }
+        sigmaRgbd += blockSums[2*s];
+        sigmaICP += blockSums[2*s+1];
     }
+    sigmaRgbd = correspsRgbdCount > 0 ? std::sqrt(sigmaRgbd/correspsRgbdCount) : 0;
+    sigmaICP = correspsICPCount > 0 ? std::sqrt(sigmaICP/correspsICPCount) : 0;
+
+    if(floatAccumulation)
+        parallel_for_(Range(0, stripesCount),
+                      MergedLsmBody<transformType, float>(image0, cloud0, Rt_ptr, image1, dI_dx1, dI_dy1, cloud1, normals1,
+                                                          correspsRgbd, correspsICP, useRgbd, useICP,
+                                                          fx, fy, sobelScale, sigmaRgbd, sigmaICP, robustKernel, blockSums));
+    else
+        parallel_for_(Range(0, stripesCount),
+                      MergedLsmBody<transformType, double>(image0, cloud0, Rt_ptr, image1, dI_dx1, dI_dy1, cloud1, normals1,
+                                                           correspsRgbd, correspsICP, useRgbd, useICP,
+                                                           fx, fy, sobelScale, sigmaRgbd, sigmaICP, robustKernel, blockSums));
+    Sums::merge(blockSums, stripesCount, AtA, AtB);
+}
 
-    for(int y = 0; y < transformDim; y++)
-        for(int x = y+1; x < transformDim; x++)
-            AtA.at<double>(x,y) = AtA.at<double>(y,x);
+/* Adds the used terms to the normal equations, sigmaRgbd and sigmaICP are set to the RMS residuals of the terms
+ * before the update.
+ */
+static
+void calcMergedLsmMatrices(const Mat& image0, const Mat& cloud0, const Matx44d& Rt,
+                           const Mat& image1, const Mat& dI_dx1, const Mat& dI_dy1,
+                           const Mat& cloud1, const Mat& normals1,
+                           OdometryWorkspace::Level& buffers, int correspsRgbdCount, int correspsICPCount,
+                           bool useRgbd, bool useICP, double fx, double fy, double sobelScale,
+                           int robustKernel, bool floatAccumulation,
+                           Mat& AtA, Mat& AtB, double& sigmaRgbd, double& sigmaICP, int transformType)
+{
+    switch(transformType)
+    {
+    case Odometry::RIGID_BODY_MOTION:
+        calcMergedLsmMatricesImpl<Odometry::RIGID_BODY_MOTION>(image0, cloud0, Rt, image1, dI_dx1, dI_dy1, cloud1, normals1,
+                                                               buffers, correspsRgbdCount, correspsICPCount,
+                                                               useRgbd, useICP, fx, fy, sobelScale, robustKernel, floatAccumulation, AtA, AtB,
+                                                      sigmaRgbd, sigmaICP);
+        break;
+    case Odometry::ROTATION:
+        calcMergedLsmMatricesImpl<Odometry::ROTATION>(image0, cloud0, Rt, image1, dI_dx1, dI_dy1, cloud1, normals1,
+                                                      buffers, correspsRgbdCount, correspsICPCount,
+                                                      useRgbd, useICP, fx, fy, sobelScale, robustKernel, floatAccumulation, AtA, AtB,
+                                                      sigmaRgbd, sigmaICP);
+        break;
+    case Odometry::TRANSLATION:
+        calcMergedLsmMatricesImpl<Odometry::TRANSLATION>(image0, cloud0, Rt, image1, dI_dx1, dI_dy1, cloud1, normals1,
+                                                         buffers, correspsRgbdCount, correspsICPCount,
+                                                         useRgbd, useICP, fx, fy, sobelScale, robustKernel, floatAccumulation, AtA, AtB,
+                                                      sigmaRgbd, sigmaICP);
+        break;
+    default:
+        CV_Error(CV_StsBadArg, "Incorrect transformation type");
+    }
 }
 
 static
@@ -795,46 +2534,125 @@ bool solveSystem(const Mat& AtA, const Mat& AtB, double detThreshold, Mat& x)
 }
 
 static 
-bool testDeltaTransformation(const Mat& deltaRt, double maxTranslation, double maxRotation)
+bool testDeltaTransformation(const Matx44d& deltaRt, double maxTranslation, double maxRotation)
 {
-    double translation = norm(deltaRt(Rect(3, 0, 1, 3)));
+    double translation = norm(Vec3d(deltaRt(0,3), deltaRt(1,3), deltaRt(2,3)));
     
-    Mat rvec;
-    Rodrigues(deltaRt(Rect(0,0,3,3)), rvec);
+    Matx31d rvec;
+    Rodrigues(deltaRt.get_minor<3,3>(0,0), rvec);
     
     double rotation = norm(rvec) * 180. / CV_PI;
     
     return translation <= maxTranslation && rotation <= maxRotation;
 }
 
+static
+void updateResultRt(const Mat& ksi, int transformType, Matx44d& resultRt)
+{
+    const double* ksi_ptr = ksi.ptr<const double>();
+    double ksi6[6] = {0};
+    if(transformType == Odometry::ROTATION)
+        std::copy(ksi_ptr, ksi_ptr + 3, ksi6);
+    else if(transformType == Odometry::TRANSLATION)
+        std::copy(ksi_ptr, ksi_ptr + 3, ksi6 + 3);
+    else
+        std::copy(ksi_ptr, ksi_ptr + 6, ksi6);
+
+    Matx44d currRt;
+    computeProjectiveMatrix(ksi6, currRt);
+    resultRt = currRt * resultRt;
+}
+
+/*
+ * The information matrix is the Hessian of the residuals normalized by their RMS. The default robust kernel
+ * normalizes them by its weights already. Otherwise the Hessian is divided by the squared RMS of the term,
+ * which is possible only if there is one term.
+ */
+static
+void calcInformationMatrix(const Mat& hessian, int method, int robustKernel, bool inverseCompositional,
+                           double sigmaRgbd, double sigmaICP, Mat& information)
+{
+    information.release();
+    if(hessian.empty())
+        return;
+
+    if(robustKernel == Odometry::ROBUST_KERNEL_SIGMA && !inverseCompositional)
+        hessian.copyTo(information);
+    else if(method == RGBD_ODOMETRY && sigmaRgbd > DBL_EPSILON)
+        information = hessian / (sigmaRgbd * sigmaRgbd);
+    else if(method == ICP_ODOMETRY && sigmaICP > DBL_EPSILON)
+        information = hessian / (sigmaICP * sigmaICP);
+}
+
+/*
+ * Updates the camera matrix pyramid of the workspace if the camera matrix or the levels count differ
+ * from the cached ones, and allocates the level buffers for the frame size.
+ */
+static
+void prepareWorkspace(const Mat& cameraMatrix, const Mat& iterCounts, double pyramidScale, const Size& frameSize,
+                      OdometryWorkspace& workspace)
+{
+    CV_Assert(cameraMatrix.size() == Size(3,3) && cameraMatrix.channels() == 1);
+    CV_Assert(iterCounts.channels() == 1 && (iterCounts.rows == 1 || iterCounts.cols == 1));
+
+    const int levelCount = (int)iterCounts.total();
+    workspace.iterCounts.resize(levelCount);
+    Mat iterCountsHeader(iterCounts.size(), CV_32SC1, &workspace.iterCounts[0]);
+    iterCounts.convertTo(iterCountsHeader, CV_32S);
+
+    Matx33d K;
+    Mat K_header(3, 3, CV_64FC1, K.val);
+    cameraMatrix.convertTo(K_header, CV_64F);
+
+    if((int)workspace.pyramidCameraMatrix.size() != levelCount || K != workspace.cameraMatrix ||
+       pyramidScale != workspace.pyramidScale)
+    {
+        workspace.cameraMatrix = K;
+        workspace.pyramidScale = pyramidScale;
+        workspace.pyramidCameraMatrix.resize(levelCount);
+        workspace.pyramidCameraMatrixInv.resize(levelCount);
+        for(int i = 0; i < levelCount; i++)
+        {
+            Matx33d levelCameraMatrix = i == 0 ? K : workspace.pyramidCameraMatrix[i-1] * (1. / pyramidScale);
+            levelCameraMatrix(2,2) = 1.;
+            workspace.pyramidCameraMatrix[i] = levelCameraMatrix;
+            workspace.pyramidCameraMatrixInv[i] = levelCameraMatrix.inv(DECOMP_SVD);
+        }
+    }
+
+    workspace.create(frameSize, levelCount, pyramidScale);
+}
+
+/* The residual (of one term) is computed before the update, so its change between two successive iterations
+ * shows the gain of the previous update.
+ */
+static inline
+bool isResidualChangeSmall(double prevSigma, double sigma, double minResidualChange)
+{
+    return std::abs(prevSigma - sigma) <= minResidualChange * prevSigma;
+}
+
 static
 bool RGBDICPOdometryImpl(Mat& Rt, const Mat& initRt,
                          const Ptr<OdometryFrame>& srcFrame,
                          const Ptr<OdometryFrame>& dstFrame,
                          const cv::Mat& cameraMatrix,
-                         float maxDepthDiff, const vector<int>& iterCounts,
-                         double maxTranslation, double maxRotation,
-                         int method, int transfromType)
+                         float maxDepthDiff, const Mat& maxDepthDiffs, double sensorErrorA, double sensorErrorB,
+                         const Mat& iterCounts, double pyramidScale, double maxTranslation, double maxRotation,
+                         double minKsiNorm, double minResidualChange,
+                         int method, bool sparse, bool inverseCompositional, bool bilinearSampling,
+                         int transfromType, int robustKernel, bool floatAccumulation,
+                         OdometryWorkspace& workspace, OdometryStats* stats)
 {
     int transformDim = -1;
-    CalcRgbdEquationCoeffsPtr rgbdEquationFuncPtr = 0;
-    CalcICPEquationCoeffsPtr icpEquationFuncPtr = 0;
     switch(transfromType)
     {
     case Odometry::RIGID_BODY_MOTION:
         transformDim = 6;
-        rgbdEquationFuncPtr = calcRgbdEquationCoeffs;
-        icpEquationFuncPtr = calcICPEquationCoeffs;
         break;
     case Odometry::ROTATION:
-        transformDim = 3;
-        rgbdEquationFuncPtr = calcRgbdEquationCoeffsRotation;
-        icpEquationFuncPtr = calcICPEquationCoeffsRotation;
-        break;
     case Odometry::TRANSLATION:
         transformDim = 3;
-        rgbdEquationFuncPtr = calcRgbdEquationCoeffsTranslation;
-        icpEquationFuncPtr = calcICPEquationCoeffsTranslation;
         break;
     default:
         CV_Error(CV_StsBadArg, "Incorrect transformation type");
@@ -843,101 +2661,212 @@ bool RGBDICPOdometryImpl(Mat& Rt, const Mat& initRt,
     const int minOverdetermScale = 20;
     const int minCorrespsCount = minOverdetermScale * transformDim;
 
-    vector<Mat> pyramidCameraMatrix;
-    buildPyramidCameraMatrix(cameraMatrix, iterCounts.size(), pyramidCameraMatrix);
+    prepareWorkspace(cameraMatrix, iterCounts, pyramidScale, srcFrame->pyramidDepth[0].size(), workspace);
+
+    const Matx44d initRt_ = initRt.empty() ? Matx44d::eye() : Matx44d(initRt);
+    Matx44d resultRt = initRt_;
+
+    Mat& AtA = workspace.AtA;
+    Mat& AtB = workspace.AtB;
+    Mat& ksi = workspace.ksi;
+    AtA.create(transformDim, transformDim, CV_64FC1);
+    AtB.create(transformDim, 1, CV_64FC1);
 
-    Mat resultRt = initRt.empty() ? Mat::eye(4,4,CV_64FC1) : initRt.clone();
-    Mat currRt, ksi;
+    if(stats)
+        stats->reset((int)workspace.iterCounts.size());
+    // RMS residuals of the iteration whose normal equations are saved to the stats
+    double hessianSigmaRgbd = 0, hessianSigmaICP = 0;
 
     bool isOk = false;
-    for(int level = iterCounts.size() - 1; level >= 0; level--)
+    for(int level = (int)workspace.iterCounts.size() - 1; level >= 0; level--)
     {
-        const Mat& levelCameraMatrix = pyramidCameraMatrix[level];
-        const Mat& levelCameraMatrix_inv = levelCameraMatrix.inv(DECOMP_SVD);
+        const Matx33d& levelCameraMatrix = workspace.pyramidCameraMatrix[level];
+        const Matx33d& levelCameraMatrix_inv = workspace.pyramidCameraMatrixInv[level];
         const Mat& srcLevelDepth = srcFrame->pyramidDepth[level];
         const Mat& dstLevelDepth = dstFrame->pyramidDepth[level];
+        OdometryWorkspace::Level& buffers = workspace.levels[level];
 
-        const double fx = levelCameraMatrix.at<double>(0,0);
-        const double fy = levelCameraMatrix.at<double>(1,1);
+        // The correspondences gate of the level, maxDepthDiffs is the optional schedule of its constant part
+        const DepthDiffGate depthDiffGate(maxDepthDiffs.empty() ? maxDepthDiff : maxDepthDiffs.at<float>(level),
+                                          static_cast<float>(sensorErrorA), static_cast<float>(sensorErrorB));
+
+        const double fx = levelCameraMatrix(0,0);
+        const double fy = levelCameraMatrix(1,1);
         const double determinantThreshold = 1e-6;
 
-        Mat AtA_rgbd, AtB_rgbd, AtA_icp, AtB_icp;
         Mat corresps_rgbd, corresps_icp;
 
+        // The merged odometry projects the union of both select masks once per iteration
+        if(method == MERGED_ODOMETRY)
+            bitwise_or(dstFrame->pyramidTexturedMask[level], dstFrame->pyramidNormalsMask[level], buffers.selectMask);
+
+        // The inverse compositional RGB-D term has constant Jacobians on the level
+        if((method & RGBD_ODOMETRY) && inverseCompositional)
+            prepareRgbdICLevel(dstFrame->pyramidTexturedSamples[level], dstFrame->pyramid_dI_dx[level],
+                               dstFrame->pyramid_dI_dy[level], levelCameraMatrix_inv, fx, fy, sobelScale,
+                               buffers, transfromType);
+
+        // RMS residuals of the terms on the previous iteration
+        double prevSigmaRgbd = 0, prevSigmaICP = 0;
+
         // Run transformation search on current level iteratively.
-        for(int iter = 0; iter < iterCounts[level]; iter ++)
+        for(int iter = 0; iter < workspace.iterCounts[level]; iter ++)
         {
-            Mat resultRt_inv = resultRt.inv(DECOMP_SVD);
+            const Matx44d resultRt_inv = invertRigidTransform(resultRt);
 
-            if(method & RGBD_ODOMETRY)
-                computeCorresps(levelCameraMatrix, levelCameraMatrix_inv, resultRt_inv,
-                                srcLevelDepth, srcFrame->pyramidMask[level], dstLevelDepth, dstFrame->pyramidTexturedMask[level],
-                                maxDepthDiff, corresps_rgbd);
+            // The ticks are counted for the stats only
+            int64 correspsTicks = 0, solveTicks = 0;
+            if(stats)
+                correspsTicks = getTickCount();
 
-            if(method & ICP_ODOMETRY)
-                computeCorresps(levelCameraMatrix, levelCameraMatrix_inv, resultRt_inv,
-                                srcLevelDepth, srcFrame->pyramidMask[level], dstLevelDepth, dstFrame->pyramidNormalsMask[level],
-                                maxDepthDiff, corresps_icp);
+            AtA = Scalar(0);
+            AtB = Scalar(0);
+            double sigmaRgbd = 0, sigmaICP = 0;
+            if(method == MERGED_ODOMETRY)
+            {
+                int correspsRgbdCount = 0, correspsICPCount = 0;
+                computeMergedCorresps(levelCameraMatrix, levelCameraMatrix_inv, resultRt_inv,
+                                      srcLevelDepth, srcFrame->pyramidMask[level], dstLevelDepth,
+                                      dstFrame->pyramidTexturedMask[level], dstFrame->pyramidNormalsMask[level],
+                                      depthDiffGate, buffers, correspsRgbdCount, correspsICPCount);
 
-            if(corresps_rgbd.rows < minCorrespsCount && corresps_icp.rows < minCorrespsCount)
-                break;
+                if(stats)
+                {
+                    solveTicks = getTickCount();
+                    stats->correspsTimes[level] += (solveTicks - correspsTicks) / getTickFrequency();
+                    stats->correspsRgbdCounts[level] = correspsRgbdCount;
+                    stats->correspsICPCounts[level] = correspsICPCount;
+                }
 
-            Mat AtA(transformDim, transformDim, CV_64FC1, Scalar(0)), AtB(transformDim, 1, CV_64FC1, Scalar(0));
-            if(corresps_rgbd.rows >= minCorrespsCount)
+                if(correspsRgbdCount < minCorrespsCount && correspsICPCount < minCorrespsCount)
+                    break;
+
+                calcMergedLsmMatrices(srcFrame->pyramidImage[level], srcFrame->pyramidCloud[level], resultRt,
+                                      dstFrame->pyramidImage[level], dstFrame->pyramid_dI_dx[level], dstFrame->pyramid_dI_dy[level],
+                                      dstFrame->pyramidCloud[level], dstFrame->pyramidNormals[level],
+                                      buffers, correspsRgbdCount, correspsICPCount,
+                                      correspsRgbdCount >= minCorrespsCount, correspsICPCount >= minCorrespsCount,
+                                      fx, fy, sobelScale, robustKernel, floatAccumulation, AtA, AtB, sigmaRgbd, sigmaICP,
+                                      transfromType);
+            }
+            else if((method & RGBD_ODOMETRY) && inverseCompositional)
             {
-                calcRgbdLsmMatrices(srcFrame->pyramidImage[level], srcFrame->pyramidCloud[level], resultRt,
-                                    dstFrame->pyramidImage[level], dstFrame->pyramid_dI_dx[level], dstFrame->pyramid_dI_dy[level],
-                                    corresps_rgbd, fx, fy, sobelScale,
-                                    AtA_rgbd, AtB_rgbd, rgbdEquationFuncPtr, transformDim);
+                const Mat& dstLevelSamples = dstFrame->pyramidTexturedSamples[level];
+                int correspsCount = 0, chunksCount = 0, chunkSize = 0;
+                if(!dstLevelSamples.empty())
+                    correspsCount = projectSparseCorresps(levelCameraMatrix, levelCameraMatrix_inv, resultRt_inv,
+                                                          srcLevelDepth, srcFrame->pyramidMask[level], dstLevelSamples,
+                                                          depthDiffGate, buffers, chunksCount, chunkSize);
+
+                if(stats)
+                {
+                    solveTicks = getTickCount();
+                    stats->correspsTimes[level] += (solveTicks - correspsTicks) / getTickFrequency();
+                    stats->correspsRgbdCounts[level] = correspsCount;
+                }
 
-                AtA += AtA_rgbd;
-                AtB += AtB_rgbd;
+                if(correspsCount < minCorrespsCount)
+                    break;
+
+                sigmaRgbd = calcRgbdICLsmMatrices(srcFrame->pyramidImage[level], dstFrame->pyramidImage[level],
+                                                  dstLevelSamples, correspsCount, buffers, AtA, AtB, transfromType);
             }
-            if(corresps_icp.rows >= minCorrespsCount)
+            else
             {
-                calcICPLsmMatrices(srcFrame->pyramidCloud[level], resultRt,
-                                   dstFrame->pyramidCloud[level], dstFrame->pyramidNormals[level],
-                                   corresps_icp, AtA_icp, AtB_icp, icpEquationFuncPtr, transformDim);
-                AtA += AtA_icp;
-                AtB += AtB_icp;
+                if((method & RGBD_ODOMETRY) && sparse)
+                    computeSparseCorresps(levelCameraMatrix, levelCameraMatrix_inv, resultRt_inv,
+                                          srcLevelDepth, srcFrame->pyramidMask[level], dstFrame->pyramidTexturedSamples[level],
+                                          depthDiffGate, buffers, 0, corresps_rgbd);
+                else if(method & RGBD_ODOMETRY)
+                    computeCorresps(levelCameraMatrix, levelCameraMatrix_inv, resultRt_inv,
+                                    srcLevelDepth, srcFrame->pyramidMask[level], dstLevelDepth, dstFrame->pyramidTexturedMask[level],
+                                    depthDiffGate, buffers, 0, corresps_rgbd);
+
+                if(method & ICP_ODOMETRY)
+                    computeCorresps(levelCameraMatrix, levelCameraMatrix_inv, resultRt_inv,
+                                    srcLevelDepth, srcFrame->pyramidMask[level], dstLevelDepth, dstFrame->pyramidNormalsMask[level],
+                                    depthDiffGate, buffers, 1, corresps_icp);
+
+                if(stats)
+                {
+                    solveTicks = getTickCount();
+                    stats->correspsTimes[level] += (solveTicks - correspsTicks) / getTickFrequency();
+                    stats->correspsRgbdCounts[level] = corresps_rgbd.rows;
+                    stats->correspsICPCounts[level] = corresps_icp.rows;
+                }
+
+                if(corresps_rgbd.rows < minCorrespsCount && corresps_icp.rows < minCorrespsCount)
+                    break;
+
+                if(corresps_rgbd.rows >= minCorrespsCount)
+                {
+                    const RgbdSubpixelSampling subpixel(levelCameraMatrix, levelCameraMatrix_inv, resultRt_inv,
+                                                        srcLevelDepth, srcFrame->pyramidMask[level], dstLevelDepth,
+                                                        depthDiffGate);
+                    sigmaRgbd = calcRgbdLsmMatrices(srcFrame->pyramidImage[level], srcFrame->pyramidCloud[level], resultRt,
+                                                    dstFrame->pyramidImage[level], dstFrame->pyramid_dI_dx[level], dstFrame->pyramid_dI_dy[level],
+                                                    corresps_rgbd, fx, fy, sobelScale, robustKernel, floatAccumulation,
+                                                    bilinearSampling ? &subpixel : 0, buffers, AtA, AtB, transfromType);
+                }
+
+                if(corresps_icp.rows >= minCorrespsCount)
+                    sigmaICP = calcICPLsmMatrices(srcFrame->pyramidCloud[level], resultRt,
+                                                  dstFrame->pyramidCloud[level], dstFrame->pyramidNormals[level],
+                                                  corresps_icp, robustKernel, floatAccumulation, buffers, AtA, AtB, transfromType);
             }
 
             bool solutionExist = solveSystem(AtA, AtB, determinantThreshold, ksi);
-            if(!solutionExist)
-                break;
 
-            if(transfromType == Odometry::ROTATION)
+            if(stats)
             {
-                Mat tmp(6, 1, CV_64FC1, Scalar(0));
-                ksi.copyTo(tmp.rowRange(0,3));
-                ksi = tmp;
+                stats->solveTimes[level] += (getTickCount() - solveTicks) / getTickFrequency();
+                stats->rmsRgbd[level] = sigmaRgbd;
+                stats->rmsICP[level] = sigmaICP;
             }
-            else if(transfromType == Odometry::TRANSLATION)
+
+            if(!solutionExist)
+                break;
+
+            updateResultRt(ksi, transfromType, resultRt);
+            isOk = true;
+            if(stats)
             {
-                Mat tmp(6, 1, CV_64FC1, Scalar(0));
-                ksi.copyTo(tmp.rowRange(3,6));
-                ksi = tmp;
+                stats->iterCounts[level]++;
+                AtA.copyTo(stats->hessian);
+                hessianSigmaRgbd = sigmaRgbd;
+                hessianSigmaICP = sigmaICP;
             }
 
-            computeProjectiveMatrix(ksi, currRt);
-            resultRt = currRt * resultRt;
-            isOk = true;
+            if(minKsiNorm > 0 && norm(ksi) < minKsiNorm)
+                break;
+
+            if(minResidualChange > 0 && iter > 0 &&
+               isResidualChangeSmall(prevSigmaRgbd, sigmaRgbd, minResidualChange) &&
+               isResidualChangeSmall(prevSigmaICP, sigmaICP, minResidualChange))
+                break;
+
+            prevSigmaRgbd = sigmaRgbd;
+            prevSigmaICP = sigmaICP;
         }
     }
     
-    Rt = resultRt;
+    Rt = Mat(resultRt);
         
     if(isOk)
     {
-        Mat deltaRt;
+        Matx44d deltaRt;
         if(initRt.empty())
             deltaRt = resultRt;
         else
-            deltaRt = resultRt * initRt.inv(DECOMP_SVD);
+            deltaRt = resultRt * initRt_.inv(DECOMP_SVD); // initRt is given by the user, it may be not rigid
 
         isOk = testDeltaTransformation(deltaRt, maxTranslation, maxRotation);
     }
 
+    if(stats && isOk && transformDim == 6)
+        calcInformationMatrix(stats->hessian, method, robustKernel, (method & RGBD_ODOMETRY) && inverseCompositional,
+                              hessianSigmaRgbd, hessianSigmaICP, stats->information);
+
     return isOk;
 }
 
@@ -992,6 +2921,180 @@ warpFrameImpl(const cv::Mat& image, const Mat& depth, const Mat& mask,
     }
 }
 
+static inline float
+warpDepthToMeters(float d)
+{
+    return d;
+}
+
+static inline float
+warpDepthToMeters(ushort d)
+{
+    return d * 0.001f;
+}
+
+/*
+ * First pass of FrameWarper::warp(): the points of the source pixels are built from the ray tables,
+ * transformed, projected (with the distortion of projectPoints if it is set) and the index of the target
+ * pixel (or -1) and the depth are saved per source pixel, together with the range of the target rows
+ * hit by each source row.
+ */
+template<class DepthType>
+struct WarpProjector : public ParallelLoopBody
+{
+    WarpProjector(const Mat& _depth, const Mat& _mask, const Matx44d& _Rt, const Matx33d& _K,
+                  const double* _distCoeff, const float* _rayTables,
+                  Mat& _projIndices, Mat& _projDepths, int* _minV, int* _maxV)
+        : depth(_depth), mask(_mask), Rt(_Rt), K(_K), distCoeff(_distCoeff), rayTables(_rayTables),
+          projIndices(_projIndices), projDepths(_projDepths), minV(_minV), maxV(_maxV)
+    {}
+
+    virtual void operator()(const Range& range) const
+    {
+        const int rows = depth.rows, cols = depth.cols;
+        const float *rays_x = rayTables, *rays_y = rayTables + cols;
+        const double fx = K(0,0), fy = K(1,1), cx = K(0,2), cy = K(1,2);
+
+        for(int v = range.start; v < range.end; v++)
+        {
+            const DepthType *depth_row = depth.ptr<DepthType>(v);
+            const uchar *mask_row = mask.empty() ? 0 : mask.ptr<uchar>(v);
+            int *indices_row = projIndices.ptr<int>(v);
+            float *depths_row = projDepths.ptr<float>(v);
+
+            // R * (x,y,1) = R.col(0) * x + (R.col(1) * y + R.col(2)), the second term is the same for the row
+            const double y = rays_y[v];
+            const double r0 = Rt(0,1) * y + Rt(0,2),
+                         r1 = Rt(1,1) * y + Rt(1,2),
+                         r2 = Rt(2,1) * y + Rt(2,2);
+
+            int rowMinV = rows, rowMaxV = -1;
+            for(int u = 0; u < cols; u++)
+            {
+                indices_row[u] = -1;
+
+                const float d = warpDepthToMeters(depth_row[u]);
+                if((mask_row && !mask_row[u]) || !(d > 0))
+                    continue;
+
+                const double x = rays_x[u];
+                const double tz = d * (Rt(2,0) * x + r2) + Rt(2,3);
+                if(!(tz > 0))
+                    continue;
+
+                const double tz_inv = 1. / tz;
+                double px = (d * (Rt(0,0) * x + r0) + Rt(0,3)) * tz_inv,
+                       py = (d * (Rt(1,0) * x + r1) + Rt(1,3)) * tz_inv;
+                if(distCoeff)
+                    distort(px, py);
+
+                const int u0 = cvRound(fx * px + cx), v0 = cvRound(fy * py + cy);
+                if((unsigned)u0 >= (unsigned)cols || (unsigned)v0 >= (unsigned)rows)
+                    continue;
+
+                indices_row[u] = v0 * cols + u0;
+                depths_row[u] = static_cast<float>(tz);
+                rowMinV = std::min(rowMinV, v0);
+                rowMaxV = std::max(rowMaxV, v0);
+            }
+
+            minV[v] = rowMinV;
+            maxV[v] = rowMaxV;
+        }
+    }
+
+    // The distortion model of projectPoints, distCoeff = (k1,k2,p1,p2,k3,k4,k5,k6)
+    inline void distort(double& x, double& y) const
+    {
+        const double* k = distCoeff;
+        const double r2 = x * x + y * y, r4 = r2 * r2, r6 = r4 * r2;
+        const double radial = (1 + k[0] * r2 + k[1] * r4 + k[4] * r6) / (1 + k[5] * r2 + k[6] * r4 + k[7] * r6);
+        const double a1 = 2 * x * y, a2 = r2 + 2 * x * x, a3 = r2 + 2 * y * y;
+        const double xd = x * radial + k[2] * a1 + k[3] * a2;
+        y = y * radial + k[2] * a3 + k[3] * a1;
+        x = xd;
+    }
+
+    const Mat& depth;
+    const Mat& mask;
+    Matx44d Rt;
+    Matx33d K;
+    const double* distCoeff;
+    const float* rayTables;
+    Mat& projIndices;
+    Mat& projDepths;
+    int* minV;
+    int* maxV;
+};
+
+/*
+ * Second pass of FrameWarper::warp(): each stripe of the target rows is owned by one thread, which clears it
+ * and visits the source pixels projected into it in raster order. The nearest point wins and on equal depths
+ * the earlier one does, as in warpFrame. The z-buffer is the output depth itself.
+ */
+template<class ImageElemType>
+struct WarpResolver : public ParallelLoopBody
+{
+    WarpResolver(const Mat& _image, const Mat& _projIndices, const Mat& _projDepths, const int* _minV, const int* _maxV,
+                 Mat& _warpedImage, Mat& _warpedDepth, Mat& _warpedMask)
+        : image(_image), projIndices(_projIndices), projDepths(_projDepths), minV(_minV), maxV(_maxV),
+          warpedImage(_warpedImage), warpedDepth(_warpedDepth), warpedMask(_warpedMask)
+    {}
+
+    virtual void operator()(const Range& range) const
+    {
+        const int rows = projIndices.rows, cols = projIndices.cols;
+        ImageElemType *warpedImage_ptr = warpedImage.ptr<ImageElemType>();
+        float *warpedDepth_ptr = warpedDepth.ptr<float>();
+        for(int s = range.start; s < range.end; s++)
+        {
+            const int vBegin = s * correspsStripeHeight,
+                      vEnd = std::min(rows, vBegin + correspsStripeHeight);
+            const int indexBegin = vBegin * cols, indexEnd = vEnd * cols;
+
+            std::fill(warpedImage_ptr + indexBegin, warpedImage_ptr + indexEnd, ImageElemType());
+            std::fill(warpedDepth_ptr + indexBegin, warpedDepth_ptr + indexEnd, std::numeric_limits<float>::max());
+
+            for(int v = 0; v < rows; v++)
+            {
+                if(maxV[v] < vBegin || minV[v] >= vEnd)
+                    continue;
+
+                const int *indices_row = projIndices.ptr<int>(v);
+                const float *depths_row = projDepths.ptr<float>(v);
+                const ImageElemType *image_row = image.ptr<ImageElemType>(v);
+                for(int u = 0; u < cols; u++)
+                {
+                    const int index = indices_row[u];
+                    if(index < indexBegin || index >= indexEnd || depths_row[u] >= warpedDepth_ptr[index])
+                        continue;
+
+                    warpedDepth_ptr[index] = depths_row[u];
+                    warpedImage_ptr[index] = image_row[u];
+                }
+            }
+
+            uchar *warpedMask_ptr = warpedMask.ptr<uchar>();
+            for(int i = indexBegin; i < indexEnd; i++)
+            {
+                const bool isWarped = warpedDepth_ptr[i] != std::numeric_limits<float>::max();
+                warpedMask_ptr[i] = isWarped ? 255 : 0;
+                if(!isWarped)
+                    warpedDepth_ptr[i] = std::numeric_limits<float>::quiet_NaN();
+            }
+        }
+    }
+
+    const Mat& image;
+    const Mat& projIndices;
+    const Mat& projDepths;
+    const int* minV;
+    const int* maxV;
+    Mat& warpedImage;
+    Mat& warpedDepth;
+    Mat& warpedMask;
+};
+
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
 namespace cv
@@ -1037,11 +3140,86 @@ void OdometryFrame::releasePyramids()
     pyramid_dI_dx.clear();
     pyramid_dI_dy.clear();
     pyramidTexturedMask.clear();
+    pyramidTexturedSamples.clear();
 
     pyramidNormals.clear();
     pyramidNormalsMask.clear();
 }
 
+OdometryFramePair::OdometryFramePair()
+{}
+
+OdometryFramePair::OdometryFramePair(const Ptr<OdometryFrame>& _srcFrame, const Ptr<OdometryFrame>& _dstFrame,
+                                     const Mat& _initRt)
+    : srcFrame(_srcFrame), dstFrame(_dstFrame), initRt(_initRt)
+{}
+
+OdometryWorkspace::OdometryWorkspace() : pyramidScale(2.)
+{}
+
+OdometryStats::OdometryStats() : prepareTime(0)
+{}
+
+void OdometryStats::reset(int levelCount)
+{
+    iterCounts.assign(levelCount, 0);
+    correspsRgbdCounts.assign(levelCount, 0);
+    correspsICPCounts.assign(levelCount, 0);
+    rmsRgbd.assign(levelCount, 0.);
+    rmsICP.assign(levelCount, 0.);
+    hessian.release();
+    information.release();
+    prepareTime = 0;
+    correspsTimes.assign(levelCount, 0.);
+    solveTimes.assign(levelCount, 0.);
+}
+
+void OdometryWorkspace::create(const Size& frameSize, int levelCount, double _pyramidScale)
+{
+    CV_Assert(levelCount > 0 && _pyramidScale > 1.);
+
+    levels.resize(levelCount);
+    Size levelSize = frameSize;
+    for(int i = 0; i < levelCount; i++)
+    {
+        Level& level = levels[i];
+        const int pixelsCount = levelSize.area();
+        const int stripesCount = (levelSize.height + correspsStripeHeight - 1) / correspsStripeHeight;
+        const int blocksCount = std::max((pixelsCount + lsmBlockSize - 1) / lsmBlockSize, stripesCount);
+
+        level.projTables.create(1, 3 * (levelSize.width + levelSize.height), CV_32FC1);
+        level.projIndices.create(levelSize, CV_32SC1);
+        level.projDepths.create(levelSize, CV_32FC1);
+        level.projRowRanges.create(1, 2 * levelSize.height, CV_32SC1);
+        level.stripeCounts.create(1, 2 * stripesCount, CV_32SC1);
+        level.selectMask.create(levelSize, CV_8UC1);
+        for(int term = 0; term < 2; term++)
+        {
+            level.corresps[term].create(levelSize, CV_16SC2);
+            level.zBuffers[term].create(levelSize, CV_32FC1);
+            level.correspsLists[term].create(pixelsCount, 1, CV_32SC4);
+        }
+        level.diffs.create(1, pixelsCount, CV_32FC1);
+        level.transformedPoints.create(1, pixelsCount, CV_32FC3);
+        level.blockSums.create(1, blocksCount * LsmSums<6>::size, CV_64FC1);
+
+        levelSize = pyramidLevelSize(levelSize, _pyramidScale);
+    }
+}
+
+void OdometryWorkspace::release()
+{
+    cameraMatrix = Matx33d();
+    pyramidScale = 2.;
+    pyramidCameraMatrix.clear();
+    pyramidCameraMatrixInv.clear();
+    iterCounts.clear();
+    levels.clear();
+    AtA.release();
+    AtB.release();
+    ksi.release();
+}
+
 bool Odometry::compute(const Mat& srcImage, const Mat& srcDepth, const Mat& srcMask,
                        const Mat& dstImage, const Mat& dstDepth, const Mat& dstMask,
                        Mat& Rt, const Mat& initRt) const
@@ -1052,17 +3230,129 @@ bool Odometry::compute(const Mat& srcImage, const Mat& srcDepth, const Mat& srcM
     return compute(srcFrame, dstFrame, Rt, initRt);
 }
 
-bool Odometry::compute(Ptr<OdometryFrame>& srcFrame, Ptr<OdometryFrame>& dstFrame, Mat& Rt, const Mat& initRt) const
+bool Odometry::compute(Ptr<OdometryFrame>& srcFrame, Ptr<OdometryFrame>& dstFrame, Mat& Rt, const Mat& initRt,
+                       OdometryStats* stats) const
+{
+    // The buffers are local, so that the concurrent calls on one odometry do not share them
+    OdometryWorkspace localWorkspace;
+    return compute(srcFrame, dstFrame, Rt, initRt, localWorkspace, stats);
+}
+
+bool Odometry::compute(Ptr<OdometryFrame>& srcFrame, Ptr<OdometryFrame>& dstFrame, Mat& Rt, const Mat& initRt,
+                       OdometryWorkspace& _workspace, OdometryStats* stats) const
 {
     checkParams();
 
+    const int64 prepareTicks = stats ? getTickCount() : 0;
+
     Size srcSize = prepareFrameCache(srcFrame, OdometryFrame::CACHE_SRC);
     Size dstSize = prepareFrameCache(dstFrame, OdometryFrame::CACHE_DST);
 
     if(srcSize != dstSize)
         CV_Error(CV_StsBadSize, "srcFrame and dstFrame have to have the same size (resolution).");
 
-    return computeImpl(srcFrame, dstFrame, Rt, initRt);
+    const double prepareTime = stats ? (getTickCount() - prepareTicks) / getTickFrequency() : 0.;
+
+    bool isOk = computeImpl(srcFrame, dstFrame, Rt, initRt, _workspace, stats);
+
+    // computeImpl resets the stats
+    if(stats)
+        stats->prepareTime = prepareTime;
+
+    return isOk;
+}
+
+/*
+ * Second stage of the batch compute: the pairs are distributed over the workers round-robin, each worker
+ * has its own workspace. The frame caches are ready and checked, so the workers call computeImpl() directly:
+ * prepareFrameCache() may still assign the frame members (e.g. the mask) and the frames are shared by the pairs.
+ */
+struct BatchComputeBody : public ParallelLoopBody
+{
+    BatchComputeBody(const Odometry& _odometry, vector<OdometryFramePair>& _pairs, int _workersCount,
+                     vector<Mat>& _Rts, vector<uchar>& _isOk, vector<OdometryWorkspace>& _workspaces,
+                     const vector<double>& _prepareTimes, vector<OdometryStats>* _stats)
+        : odometry(_odometry), pairs(_pairs), workersCount(_workersCount), Rts(_Rts), isOk(_isOk),
+          workspaces(_workspaces), prepareTimes(_prepareTimes), stats(_stats)
+    {}
+
+    virtual void operator()(const Range& range) const
+    {
+        for(int w = range.start; w < range.end; w++)
+        {
+            for(size_t i = w; i < pairs.size(); i += workersCount)
+            {
+                const OdometryFramePair& pair = pairs[i];
+                OdometryStats* pairStats = stats ? &(*stats)[i] : 0;
+                isOk[i] = odometry.computeImpl(pair.srcFrame, pair.dstFrame, Rts[i], pair.initRt,
+                                               workspaces[w], pairStats);
+                // computeImpl resets the stats
+                if(pairStats)
+                    pairStats->prepareTime = prepareTimes[i];
+            }
+        }
+    }
+
+    const Odometry& odometry;
+    vector<OdometryFramePair>& pairs;
+    int workersCount;
+    vector<Mat>& Rts;
+    vector<uchar>& isOk;
+    vector<OdometryWorkspace>& workspaces;
+    const vector<double>& prepareTimes;
+    vector<OdometryStats>* stats;
+};
+
+int Odometry::compute(vector<OdometryFramePair>& pairs, vector<Mat>& Rts, vector<uchar>& isOk,
+                      vector<OdometryWorkspace>& workspaces, vector<OdometryStats>* stats) const
+{
+    checkParams();
+
+    Rts.resize(pairs.size());
+    isOk.assign(pairs.size(), 0);
+    if(stats)
+        stats->resize(pairs.size());
+    if(pairs.empty())
+        return 0;
+
+    // The union of the cache types of every frame. The frames are prepared one by one, because
+    // the odometry helpers (e.g. normalsComputer) are not shared safely; the preparation is parallel inside.
+    std::map<OdometryFrame*, int> cacheTypes;
+    for(size_t i = 0; i < pairs.size(); i++)
+    {
+        if(pairs[i].srcFrame.empty() || pairs[i].dstFrame.empty())
+            CV_Error(CV_StsBadArg, "Null frame pointer.\n");
+        cacheTypes[pairs[i].srcFrame] |= OdometryFrame::CACHE_SRC;
+        cacheTypes[pairs[i].dstFrame] |= OdometryFrame::CACHE_DST;
+    }
+    // The preparation time of a frame goes to the stats of the first pair using it
+    std::map<OdometryFrame*, Size> frameSizes;
+    vector<double> prepareTimes(pairs.size(), 0.);
+    for(size_t i = 0; i < pairs.size(); i++)
+    {
+        const int64 prepareTicks = getTickCount();
+        for(int k = 0; k < 2; k++)
+        {
+            Ptr<OdometryFrame>& frame = k == 0 ? pairs[i].srcFrame : pairs[i].dstFrame;
+            std::map<OdometryFrame*, int>::iterator it = cacheTypes.find(frame);
+            if(it->second)
+            {
+                frameSizes[frame] = prepareFrameCache(frame, it->second);
+                it->second = 0;
+            }
+        }
+        prepareTimes[i] = (getTickCount() - prepareTicks) / getTickFrequency();
+
+        if(frameSizes[pairs[i].srcFrame] != frameSizes[pairs[i].dstFrame])
+            CV_Error(CV_StsBadSize, "srcFrame and dstFrame have to have the same size (resolution).");
+    }
+
+    const int workersCount = std::min(static_cast<int>(pairs.size()), std::max(getNumThreads(), 1));
+    workspaces.resize(workersCount);
+    parallel_for_(Range(0, workersCount),
+                  BatchComputeBody(*this, pairs, workersCount, Rts, isOk, workspaces, prepareTimes, stats));
+
+    return countNonZero(Mat(isOk));
 }
 
 Size Odometry::prepareFrameCache(Ptr<OdometryFrame> &frame, int /*cacheType*/) const
@@ -1081,8 +3371,11 @@ RgbdOdometry::RgbdOdometry() :
     maxPointsPart(DEFAULT_MAX_POINTS_PART()),
     transformType(Odometry::RIGID_BODY_MOTION),
     maxTranslation(DEFAULT_MAX_TRANSLATION()),
-    maxRotation(DEFAULT_MAX_ROTATION())
-
+    maxRotation(DEFAULT_MAX_ROTATION()),
+    minKsiNorm(0), minResidualChange(0),
+    robustKernel(Odometry::ROBUST_KERNEL_SIGMA), floatAccumulation(false), sensorErrorA(0), sensorErrorB(0),
+    pyramidScale(2.), depthDownsampling(Odometry::DEPTH_DOWNSAMPLING_GAUSSIAN),
+    sparse(false), inverseCompositional(false), bilinearSampling(false)
 {
     setDefaultIterCounts(iterCounts);
     setDefaultMinGradientMagnitudes(minGradientMagnitudes);
@@ -1099,7 +3392,11 @@ RgbdOdometry::RgbdOdometry(const Mat& _cameraMatrix,
                            minGradientMagnitudes(Mat(_minGradientMagnitudes).clone()),
                            maxPointsPart(_maxPointsPart),
                            cameraMatrix(_cameraMatrix), transformType(_transformType),
-                           maxTranslation(DEFAULT_MAX_TRANSLATION()), maxRotation(DEFAULT_MAX_ROTATION())
+                           maxTranslation(DEFAULT_MAX_TRANSLATION()), maxRotation(DEFAULT_MAX_ROTATION()),
+                           minKsiNorm(0), minResidualChange(0),
+                           robustKernel(Odometry::ROBUST_KERNEL_SIGMA), floatAccumulation(false), sensorErrorA(0), sensorErrorB(0),
+                           pyramidScale(2.), depthDownsampling(Odometry::DEPTH_DOWNSAMPLING_GAUSSIAN),
+                           sparse(false), inverseCompositional(false), bilinearSampling(false)
 {
     if(iterCounts.empty() || minGradientMagnitudes.empty())
     {
@@ -1114,7 +3411,7 @@ Size RgbdOdometry::prepareFrameCache(Ptr<OdometryFrame>& frame, int cacheType) c
 
     if(frame->image.empty())
     {
-        if(!frame->pyramidImage.empty())
+        if(isLevelReady(frame->pyramidImage, 0))
             frame->image = frame->pyramidImage[0];
         else
             CV_Error(CV_StsBadSize, "Image or pyramidImage have to be set.");
@@ -1123,9 +3420,9 @@ Size RgbdOdometry::prepareFrameCache(Ptr<OdometryFrame>& frame, int cacheType) c
 
     if(frame->depth.empty())
     {
-        if(!frame->pyramidDepth.empty())
+        if(isLevelReady(frame->pyramidDepth, 0))
             frame->depth = frame->pyramidDepth[0];
-        else if(!frame->pyramidCloud.empty())
+        else if(isLevelReady(frame->pyramidCloud, 0))
         {
             Mat cloud = frame->pyramidCloud[0];
             vector<Mat> xyz;
@@ -1137,19 +3434,19 @@ Size RgbdOdometry::prepareFrameCache(Ptr<OdometryFrame>& frame, int cacheType) c
     }
     checkDepth(frame->depth, frame->image.size());
 
-    if(frame->mask.empty() && !frame->pyramidMask.empty())
+    if(frame->mask.empty() && isLevelReady(frame->pyramidMask, 0))
         frame->mask = frame->pyramidMask[0];
     checkMask(frame->mask, frame->image.size());
 
-    preparePyramidImage(frame->image, frame->pyramidImage, iterCounts.total());
+    preparePyramidImage(frame->image, frame->pyramidImage, iterCounts.total(), pyramidScale);
 
-    preparePyramidDepth(frame->depth, frame->pyramidDepth, iterCounts.total());
+    preparePyramidDepth(frame->depth, frame->pyramidDepth, iterCounts.total(), pyramidScale, depthDownsampling);
 
     preparePyramidMask(frame->mask, frame->pyramidDepth, minDepth, maxDepth,
-                       frame->pyramidNormals, frame->pyramidMask);
+                       frame->pyramidNormals, pyramidScale, frame->pyramidMask);
 
     if(cacheType & OdometryFrame::CACHE_SRC)
-        preparePyramidCloud(frame->pyramidDepth, cameraMatrix, frame->pyramidCloud);
+        preparePyramidCloud(frame->pyramidDepth, cameraMatrix, pyramidScale, frame->pyramidCloud);
 
     if(cacheType & OdometryFrame::CACHE_DST)
     {
@@ -1157,6 +3454,8 @@ Size RgbdOdometry::prepareFrameCache(Ptr<OdometryFrame>& frame, int cacheType) c
         preparePyramidSobel(frame->pyramidImage, 0, 1, frame->pyramid_dI_dy);
         preparePyramidTexturedMask(frame->pyramid_dI_dx, frame->pyramid_dI_dy, minGradientMagnitudes,
                                    frame->pyramidMask, maxPointsPart, frame->pyramidTexturedMask);
+        if(sparse || inverseCompositional)
+            preparePyramidTexturedSamples(frame->pyramidTexturedMask, frame->pyramidDepth, frame->pyramidTexturedSamples);
     }
 
     return frame->image.size();
@@ -1166,19 +3465,29 @@ void RgbdOdometry::checkParams() const
 {
     CV_Assert(maxPointsPart > 0. && maxPointsPart <= 1.);
     CV_Assert(cameraMatrix.size() == Size(3,3) && (cameraMatrix.type() == CV_32FC1 || cameraMatrix.type() == CV_64FC1));
+    checkMaxDepthDiffs(maxDepthDiffs, iterCounts);
+    checkPyramidParams(pyramidScale, depthDownsampling);
+    checkRobustKernel(robustKernel);
     CV_Assert(minGradientMagnitudes.size() == iterCounts.size() || minGradientMagnitudes.size() == iterCounts.t().size());
 }
 
-bool RgbdOdometry::computeImpl(const Ptr<OdometryFrame>& srcFrame, const Ptr<OdometryFrame>& dstFrame, Mat& Rt, const Mat& initRt) const
+bool RgbdOdometry::computeImpl(const Ptr<OdometryFrame>& srcFrame, const Ptr<OdometryFrame>& dstFrame, Mat& Rt, const Mat& initRt,
+                                     OdometryWorkspace& _workspace, OdometryStats* stats) const
 {
-    return RGBDICPOdometryImpl(Rt, initRt, srcFrame, dstFrame, cameraMatrix, maxDepthDiff, iterCounts, maxTranslation, maxRotation, RGBD_ODOMETRY, transformType);
+    return RGBDICPOdometryImpl(Rt, initRt, srcFrame, dstFrame, cameraMatrix,
+                               maxDepthDiff, maxDepthDiffs, sensorErrorA, sensorErrorB, iterCounts, pyramidScale, maxTranslation, maxRotation,
+                               minKsiNorm, minResidualChange, RGBD_ODOMETRY, sparse, inverseCompositional, bilinearSampling,
+                               transformType, robustKernel, floatAccumulation, _workspace, stats);
 }
 
 //
 ICPOdometry::ICPOdometry() :
     minDepth(DEFAULT_MIN_DEPTH()), maxDepth(DEFAULT_MAX_DEPTH()),
     maxDepthDiff(DEFAULT_MAX_DEPTH_DIFF()), maxPointsPart(DEFAULT_MAX_POINTS_PART()), transformType(Odometry::RIGID_BODY_MOTION),
-    maxTranslation(DEFAULT_MAX_TRANSLATION()), maxRotation(DEFAULT_MAX_ROTATION())
+    maxTranslation(DEFAULT_MAX_TRANSLATION()), maxRotation(DEFAULT_MAX_ROTATION()),
+    minKsiNorm(0), minResidualChange(0),
+    robustKernel(Odometry::ROBUST_KERNEL_SIGMA), floatAccumulation(false), sensorErrorA(0), sensorErrorB(0),
+    pyramidScale(2.), depthDownsampling(Odometry::DEPTH_DOWNSAMPLING_GAUSSIAN)
 {
     setDefaultIterCounts(iterCounts);
 }
@@ -1190,7 +3499,10 @@ ICPOdometry::ICPOdometry(const Mat& _cameraMatrix,
                          minDepth(_minDepth), maxDepth(_maxDepth), maxDepthDiff(_maxDepthDiff),
                          maxPointsPart(_maxPointsPart), iterCounts(Mat(_iterCounts).clone()),
                          cameraMatrix(_cameraMatrix), transformType(_transformType),
-                         maxTranslation(DEFAULT_MAX_TRANSLATION()), maxRotation(DEFAULT_MAX_ROTATION())
+                         maxTranslation(DEFAULT_MAX_TRANSLATION()), maxRotation(DEFAULT_MAX_ROTATION()),
+                         minKsiNorm(0), minResidualChange(0),
+                         robustKernel(Odometry::ROBUST_KERNEL_SIGMA), floatAccumulation(false), sensorErrorA(0), sensorErrorB(0),
+                         pyramidScale(2.), depthDownsampling(Odometry::DEPTH_DOWNSAMPLING_GAUSSIAN)
 {
     if(iterCounts.empty())
         setDefaultIterCounts(iterCounts);
@@ -1202,9 +3514,9 @@ Size ICPOdometry::prepareFrameCache(Ptr<OdometryFrame>& frame, int cacheType) co
 
     if(frame->depth.empty())
     {
-        if(!frame->pyramidDepth.empty())
+        if(isLevelReady(frame->pyramidDepth, 0))
             frame->depth = frame->pyramidDepth[0];
-        else if(!frame->pyramidCloud.empty())
+        else if(isLevelReady(frame->pyramidCloud, 0))
         {
             Mat cloud = frame->pyramidCloud[0];
             vector<Mat> xyz;
@@ -1216,19 +3528,19 @@ Size ICPOdometry::prepareFrameCache(Ptr<OdometryFrame>& frame, int cacheType) co
     }
     checkDepth(frame->depth, frame->depth.size());
 
-    if(frame->mask.empty() && !frame->pyramidMask.empty())
+    if(frame->mask.empty() && isLevelReady(frame->pyramidMask, 0))
         frame->mask = frame->pyramidMask[0];
     checkMask(frame->mask, frame->depth.size());
 
-    preparePyramidDepth(frame->depth, frame->pyramidDepth, iterCounts.total());
+    preparePyramidDepth(frame->depth, frame->pyramidDepth, iterCounts.total(), pyramidScale, depthDownsampling);
 
-    preparePyramidCloud(frame->pyramidDepth, cameraMatrix, frame->pyramidCloud);
+    preparePyramidCloud(frame->pyramidDepth, cameraMatrix, pyramidScale, frame->pyramidCloud);
 
     if(cacheType & OdometryFrame::CACHE_DST)
     {
         if(frame->normals.empty())
         {
-            if(!frame->pyramidNormals.empty())
+            if(isLevelReady(frame->pyramidNormals, 0))
                 frame->normals = frame->pyramidNormals[0];
             else
             {
@@ -1243,16 +3555,16 @@ Size ICPOdometry::prepareFrameCache(Ptr<OdometryFrame>& frame, int cacheType) co
         }
         checkNormals(frame->normals, frame->depth.size());
 
-        preparePyramidNormals(frame->normals, frame->pyramidDepth, frame->pyramidNormals);
+        preparePyramidNormals(frame->normals, frame->pyramidDepth, pyramidScale, frame->pyramidNormals);
 
         preparePyramidMask(frame->mask, frame->pyramidDepth, minDepth, maxDepth,
-                           frame->pyramidNormals, frame->pyramidMask);
+                           frame->pyramidNormals, pyramidScale, frame->pyramidMask);
 
         preparePyramidNormalsMask(frame->pyramidNormals, frame->pyramidMask, maxPointsPart, frame->pyramidNormalsMask);
     }
     else
         preparePyramidMask(frame->mask, frame->pyramidDepth, minDepth, maxDepth,
-                           frame->pyramidNormals, frame->pyramidMask);
+                           frame->pyramidNormals, pyramidScale, frame->pyramidMask);
 
     return frame->depth.size();
 }
@@ -1261,18 +3573,28 @@ void ICPOdometry::checkParams() const
 {
     CV_Assert(maxPointsPart > 0. && maxPointsPart <= 1.);
     CV_Assert(cameraMatrix.size() == Size(3,3) && (cameraMatrix.type() == CV_32FC1 || cameraMatrix.type() == CV_64FC1));
+    checkMaxDepthDiffs(maxDepthDiffs, iterCounts);
+    checkPyramidParams(pyramidScale, depthDownsampling);
+    checkRobustKernel(robustKernel);
 }
 
-bool ICPOdometry::computeImpl(const Ptr<OdometryFrame>& srcFrame, const Ptr<OdometryFrame>& dstFrame, Mat& Rt, const Mat& initRt) const
+bool ICPOdometry::computeImpl(const Ptr<OdometryFrame>& srcFrame, const Ptr<OdometryFrame>& dstFrame, Mat& Rt, const Mat& initRt,
+                                    OdometryWorkspace& _workspace, OdometryStats* stats) const
 {
-    return RGBDICPOdometryImpl(Rt, initRt, srcFrame, dstFrame, cameraMatrix, maxDepthDiff, iterCounts, maxTranslation, maxRotation, ICP_ODOMETRY, transformType);
+    return RGBDICPOdometryImpl(Rt, initRt, srcFrame, dstFrame, cameraMatrix,
+                               maxDepthDiff, maxDepthDiffs, sensorErrorA, sensorErrorB, iterCounts, pyramidScale, maxTranslation, maxRotation,
+                               minKsiNorm, minResidualChange, ICP_ODOMETRY, false, false, false, transformType,
+                               robustKernel, floatAccumulation, _workspace, stats);
 }
 
 //
 RgbdICPOdometry::RgbdICPOdometry() :
     minDepth(DEFAULT_MIN_DEPTH()), maxDepth(DEFAULT_MAX_DEPTH()),
     maxDepthDiff(DEFAULT_MAX_DEPTH_DIFF()), maxPointsPart(DEFAULT_MAX_POINTS_PART()), transformType(Odometry::RIGID_BODY_MOTION),
-    maxTranslation(DEFAULT_MAX_TRANSLATION()), maxRotation(DEFAULT_MAX_ROTATION())
+    maxTranslation(DEFAULT_MAX_TRANSLATION()), maxRotation(DEFAULT_MAX_ROTATION()),
+    minKsiNorm(0), minResidualChange(0),
+    robustKernel(Odometry::ROBUST_KERNEL_SIGMA), floatAccumulation(false), sensorErrorA(0), sensorErrorB(0),
+    pyramidScale(2.), depthDownsampling(Odometry::DEPTH_DOWNSAMPLING_GAUSSIAN)
 {
     setDefaultIterCounts(iterCounts);
     setDefaultMinGradientMagnitudes(minGradientMagnitudes);
@@ -1287,7 +3609,10 @@ RgbdICPOdometry::RgbdICPOdometry(const Mat& _cameraMatrix,
                                  maxPointsPart(_maxPointsPart), iterCounts(Mat(_iterCounts).clone()),
                                  minGradientMagnitudes(Mat(_minGradientMagnitudes).clone()),
                                  cameraMatrix(_cameraMatrix), transformType(_transformType),
-                                 maxTranslation(DEFAULT_MAX_TRANSLATION()), maxRotation(DEFAULT_MAX_ROTATION())
+                                 maxTranslation(DEFAULT_MAX_TRANSLATION()), maxRotation(DEFAULT_MAX_ROTATION()),
+                                 minKsiNorm(0), minResidualChange(0),
+                                 robustKernel(Odometry::ROBUST_KERNEL_SIGMA), floatAccumulation(false), sensorErrorA(0), sensorErrorB(0),
+                                 pyramidScale(2.), depthDownsampling(Odometry::DEPTH_DOWNSAMPLING_GAUSSIAN)
 {
     if(iterCounts.empty() || minGradientMagnitudes.empty())
     {
@@ -1300,7 +3625,7 @@ Size RgbdICPOdometry::prepareFrameCache(Ptr<OdometryFrame>& frame, int cacheType
 {
     if(frame->image.empty())
     {
-        if(!frame->pyramidImage.empty())
+        if(isLevelReady(frame->pyramidImage, 0))
             frame->image = frame->pyramidImage[0];
         else
             CV_Error(CV_StsBadSize, "Image or pyramidImage have to be set.");
@@ -1309,9 +3634,9 @@ Size RgbdICPOdometry::prepareFrameCache(Ptr<OdometryFrame>& frame, int cacheType
 
     if(frame->depth.empty())
     {
-        if(!frame->pyramidDepth.empty())
+        if(isLevelReady(frame->pyramidDepth, 0))
             frame->depth = frame->pyramidDepth[0];
-        else if(!frame->pyramidCloud.empty())
+        else if(isLevelReady(frame->pyramidCloud, 0))
         {
             Mat cloud = frame->pyramidCloud[0];
             vector<Mat> xyz;
@@ -1323,21 +3648,17 @@ Size RgbdICPOdometry::prepareFrameCache(Ptr<OdometryFrame>& frame, int cacheType
     }
     checkDepth(frame->depth, frame->image.size());
 
-    if(frame->mask.empty() && !frame->pyramidMask.empty())
+    if(frame->mask.empty() && isLevelReady(frame->pyramidMask, 0))
         frame->mask = frame->pyramidMask[0];
     checkMask(frame->mask, frame->image.size());
 
-    preparePyramidImage(frame->image, frame->pyramidImage, iterCounts.total());
-
-    preparePyramidDepth(frame->depth, frame->pyramidDepth, iterCounts.total());
-
-    preparePyramidCloud(frame->pyramidDepth, cameraMatrix, frame->pyramidCloud);
-
-    if(cacheType & OdometryFrame::CACHE_DST)
+    const bool isDstCache = (cacheType & OdometryFrame::CACHE_DST) != 0;
+    bool isNormalsComputing = false;
+    if(isDstCache)
     {
         if(frame->normals.empty())
         {
-            if(!frame->pyramidNormals.empty())
+            if(isLevelReady(frame->pyramidNormals, 0))
                 frame->normals = frame->pyramidNormals[0];
             else
             {
@@ -1347,27 +3668,66 @@ Size RgbdICPOdometry::prepareFrameCache(Ptr<OdometryFrame>& frame, int cacheType
                    cv::norm(normalsComputer->get<Mat>("K"), cameraMatrix) > FLT_EPSILON)
                    normalsComputer = new RgbdNormals(frame->depth.rows, frame->depth.cols, frame->depth.depth(), cameraMatrix, normalWinSize, normalMethod);
 
-                (*normalsComputer)(frame->pyramidCloud[0], frame->normals);
+                isNormalsComputing = true;
             }
         }
-        checkNormals(frame->normals, frame->depth.size());
-
-        preparePyramidNormals(frame->normals, frame->pyramidDepth, frame->pyramidNormals);
+    }
 
-        preparePyramidMask(frame->mask, frame->pyramidDepth, minDepth, maxDepth,
-                           frame->pyramidNormals, frame->pyramidMask);
+    vector<float> minGradMagnitudes;
+    minGradientMagnitudes.copyTo(minGradMagnitudes);
+
+    vector<FrameCacheTask> tasks;
+    vector<Mat> pyramidCameraMatrix, pyramidValidMask;
+    FrameCacheBody body(tasks, *frame, iterCounts.total(), pyramidCameraMatrix, pyramidValidMask,
+                        minDepth, maxDepth, minGradMagnitudes, maxPointsPart, pyramidScale, depthDownsampling,
+                        normalsComputer);
+
+    tasks.push_back(FrameCacheTask(FrameCacheTask::IMAGE_PYRAMID));
+    tasks.push_back(FrameCacheTask(FrameCacheTask::DEPTH_PYRAMID));
+    parallel_for_(Range(0, static_cast<int>(tasks.size())), body);
+
+    const vector<Mat>& pyramidDepth = frame->pyramidDepth;
+    resizePyramid(frame->pyramidCloud, pyramidDepth, CV_32FC3, "Incorrect size of pyramidCloud.");
+    resizePyramid(frame->pyramidMask, pyramidDepth, CV_8UC1,
+                  "Levels count of pyramidMask has to be equal or less than size of pyramidDepth.");
+    buildPyramidCameraMatrix(cameraMatrix, pyramidDepth.size(), pyramidScale, pyramidCameraMatrix);
+
+    // the heaviest task (normals) goes first
+    tasks.clear();
+    if(isDstCache)
+        tasks.push_back(FrameCacheTask(FrameCacheTask::NORMALS));
+    tasks.push_back(FrameCacheTask(FrameCacheTask::VALID_MASK_PYRAMID));
+    for(size_t i = isNormalsComputing ? 1 : 0; i < pyramidDepth.size(); i++)
+        tasks.push_back(FrameCacheTask(FrameCacheTask::CLOUD, static_cast<int>(i)));
+    if(isDstCache)
+    {
+        resizePyramid(frame->pyramid_dI_dx, frame->pyramidImage, CV_16SC1, "Incorrect size of pyramidSobel.");
+        resizePyramid(frame->pyramid_dI_dy, frame->pyramidImage, CV_16SC1, "Incorrect size of pyramidSobel.");
+        for(size_t i = 0; i < frame->pyramidImage.size(); i++)
+        {
+            tasks.push_back(FrameCacheTask(FrameCacheTask::SOBEL_DX, static_cast<int>(i)));
+            tasks.push_back(FrameCacheTask(FrameCacheTask::SOBEL_DY, static_cast<int>(i)));
+        }
+    }
+    parallel_for_(Range(0, static_cast<int>(tasks.size())), body);
 
-        preparePyramidSobel(frame->pyramidImage, 1, 0, frame->pyramid_dI_dx);
-        preparePyramidSobel(frame->pyramidImage, 0, 1, frame->pyramid_dI_dy);
-        preparePyramidTexturedMask(frame->pyramid_dI_dx, frame->pyramid_dI_dy,
-                                   minGradientMagnitudes, frame->pyramidMask,
-                                   maxPointsPart, frame->pyramidTexturedMask);
+    tasks.clear();
+    for(size_t i = 0; i < pyramidValidMask.size(); i++)
+        tasks.push_back(FrameCacheTask(FrameCacheTask::MASK, static_cast<int>(i)));
+    parallel_for_(Range(0, static_cast<int>(tasks.size())), body);
 
-        preparePyramidNormalsMask(frame->pyramidNormals, frame->pyramidMask, maxPointsPart, frame->pyramidNormalsMask);
+    if(isDstCache)
+    {
+        resizePyramid(frame->pyramidTexturedMask, frame->pyramid_dI_dx, CV_8UC1, "Incorrect size of pyramidTexturedMask.");
+        resizePyramid(frame->pyramidNormalsMask, frame->pyramidMask, CV_8UC1, "Incorrect size of pyramidNormalsMask.");
+
+        tasks.clear();
+        for(size_t i = 0; i < frame->pyramidTexturedMask.size(); i++)
+            tasks.push_back(FrameCacheTask(FrameCacheTask::TEXTURED_MASK, static_cast<int>(i)));
+        for(size_t i = 0; i < frame->pyramidNormalsMask.size(); i++)
+            tasks.push_back(FrameCacheTask(FrameCacheTask::NORMALS_MASK, static_cast<int>(i)));
+        parallel_for_(Range(0, static_cast<int>(tasks.size())), body);
     }
-    else
-        preparePyramidMask(frame->mask, frame->pyramidDepth, minDepth, maxDepth,
-                           frame->pyramidNormals, frame->pyramidMask);
 
     return frame->image.size();
 }
@@ -1376,12 +3736,19 @@ void RgbdICPOdometry::checkParams() const
 {
     CV_Assert(maxPointsPart > 0. && maxPointsPart <= 1.);
     CV_Assert(cameraMatrix.size() == Size(3,3) && (cameraMatrix.type() == CV_32FC1 || cameraMatrix.type() == CV_64FC1));
+    checkMaxDepthDiffs(maxDepthDiffs, iterCounts);
+    checkPyramidParams(pyramidScale, depthDownsampling);
+    checkRobustKernel(robustKernel);
     CV_Assert(minGradientMagnitudes.size() == iterCounts.size() || minGradientMagnitudes.size() == iterCounts.t().size());
 }
 
-bool RgbdICPOdometry::computeImpl(const Ptr<OdometryFrame>& srcFrame, const Ptr<OdometryFrame>& dstFrame, Mat& Rt, const Mat& initRt) const
+bool RgbdICPOdometry::computeImpl(const Ptr<OdometryFrame>& srcFrame, const Ptr<OdometryFrame>& dstFrame, Mat& Rt, const Mat& initRt,
+                                        OdometryWorkspace& _workspace, OdometryStats* stats) const
 {
-    return RGBDICPOdometryImpl(Rt, initRt, srcFrame, dstFrame, cameraMatrix, maxDepthDiff, iterCounts,  maxTranslation, maxRotation, MERGED_ODOMETRY, transformType);
+    return RGBDICPOdometryImpl(Rt, initRt, srcFrame, dstFrame, cameraMatrix,
+                               maxDepthDiff, maxDepthDiffs, sensorErrorA, sensorErrorB, iterCounts, pyramidScale, maxTranslation, maxRotation,
+                               minKsiNorm, minResidualChange, MERGED_ODOMETRY, false, false, false, transformType,
+                               robustKernel, floatAccumulation, _workspace, stats);
 }
 
 //
@@ -1398,4 +3765,100 @@ warpFrame(const Mat& image, const Mat& depth, const Mat& mask,
     else
         CV_Error(CV_StsBadArg, "Image has to be type of CV_8UC1 or CV_8UC3");
 }
+
+FrameWarper::FrameWarper()
+{}
+
+FrameWarper::FrameWarper(const Mat& _cameraMatrix, const Size& _frameSize, const Mat& _distCoeff)
+{
+    setCamera(_cameraMatrix, _frameSize, _distCoeff);
+}
+
+void FrameWarper::setCamera(const Mat& _cameraMatrix, const Size& _frameSize, const Mat& _distCoeff)
+{
+    CV_Assert(_cameraMatrix.size() == Size(3,3) && (_cameraMatrix.type() == CV_32FC1 || _cameraMatrix.type() == CV_64FC1));
+    CV_Assert(_frameSize.width > 0 && _frameSize.height > 0);
+
+    if(_distCoeff.empty() || countNonZero(_distCoeff) == 0)
+        distCoeff.release();
+    else
+    {
+        const int distCoeffCount = static_cast<int>(_distCoeff.total());
+        if((distCoeffCount != 4 && distCoeffCount != 5 && distCoeffCount != 8) || _distCoeff.channels() != 1)
+            CV_Error(CV_StsBadArg, "Distortion coefficients have to be a vector of 4, 5 or 8 elements");
+
+        distCoeff = Mat::zeros(1, 8, CV_64FC1);
+        Mat dst = distCoeff.colRange(0, distCoeffCount);
+        _distCoeff.reshape(1, 1).convertTo(dst, CV_64F);
+    }
+
+    Matx33d K;
+    Mat K_header(3, 3, CV_64FC1, K.val);
+    _cameraMatrix.convertTo(K_header, CV_64F);
+
+    if(!rayTables.empty() && K == cameraMatrix && _frameSize == frameSize)
+        return;
+
+    cameraMatrix = K;
+    frameSize = _frameSize;
+
+    rayTables.create(1, frameSize.width + frameSize.height, CV_32FC1);
+    float *rays_x = rayTables.ptr<float>(), *rays_y = rays_x + frameSize.width;
+    for(int u = 0; u < frameSize.width; u++)
+        rays_x[u] = static_cast<float>((u - K(0,2)) / K(0,0));
+    for(int v = 0; v < frameSize.height; v++)
+        rays_y[v] = static_cast<float>((v - K(1,2)) / K(1,1));
+}
+
+void FrameWarper::warp(const Mat& image, const Mat& depth, const Mat& mask, const Mat& Rt,
+                       Mat& warpedImage, Mat& warpedDepth, Mat& warpedMask)
+{
+    if(rayTables.empty())
+        CV_Error(CV_StsBadArg, "The camera has to be set before the warping");
+    if(image.size() != frameSize || depth.size() != frameSize)
+        CV_Error(CV_StsBadSize, "Image and depth have to be of the frame size of the camera");
+    if(depth.type() != CV_32FC1 && depth.type() != CV_16UC1)
+        CV_Error(CV_StsBadArg, "Depth has to be type of CV_32FC1 or CV_16UC1");
+    CV_Assert(mask.empty() || (mask.size() == frameSize && mask.type() == CV_8UC1));
+    CV_Assert(Rt.size() == Size(4,4) && (Rt.type() == CV_32FC1 || Rt.type() == CV_64FC1));
+
+    Matx44d Rt_;
+    Mat Rt_header(4, 4, CV_64FC1, Rt_.val);
+    Rt.convertTo(Rt_header, CV_64F);
+
+    const int rows = frameSize.height;
+    projIndices.create(frameSize, CV_32SC1);
+    projDepths.create(frameSize, CV_32FC1);
+    projRowRanges.create(1, 2 * rows, CV_32SC1);
+    int *minV = projRowRanges.ptr<int>(), *maxV = minV + rows;
+
+    const double* distCoeff_ptr = distCoeff.empty() ? 0 : distCoeff.ptr<double>();
+    if(depth.type() == CV_32FC1)
+        parallel_for_(Range(0, rows), WarpProjector<float>(depth, mask, Rt_, cameraMatrix, distCoeff_ptr,
+                                                           rayTables.ptr<float>(), projIndices, projDepths, minV, maxV));
+    else
+        parallel_for_(Range(0, rows), WarpProjector<ushort>(depth, mask, Rt_, cameraMatrix, distCoeff_ptr,
+                                                            rayTables.ptr<float>(), projIndices, projDepths, minV, maxV));
+
+    // the resolver addresses the outputs by the linear pixel indices
+    Mat* outputs[] = {&warpedImage, &warpedDepth, &warpedMask};
+    for(int i = 0; i < 3; i++)
+    {
+        if(!outputs[i]->isContinuous())
+            outputs[i]->release();
+    }
+    warpedImage.create(frameSize, image.type());
+    warpedDepth.create(frameSize, CV_32FC1);
+    warpedMask.create(frameSize, CV_8UC1);
+
+    const Range stripes(0, (rows + correspsStripeHeight - 1) / correspsStripeHeight);
+    if(image.type() == CV_8UC1)
+        parallel_for_(stripes, WarpResolver<uchar>(image, projIndices, projDepths, minV, maxV,
+                                                   warpedImage, warpedDepth, warpedMask));
+    else if(image.type() == CV_8UC3)
+        parallel_for_(stripes, WarpResolver<Point3_<uchar> >(image, projIndices, projDepths, minV, maxV,
+                                                             warpedImage, warpedDepth, warpedMask));
+    else
+        CV_Error(CV_StsBadArg, "Image has to be type of CV_8UC1 or CV_8UC3");
+}
 } // namespace cv
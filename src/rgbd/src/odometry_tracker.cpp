@@ -0,0 +1,216 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <opencv2/rgbd/rgbd.hpp>
+
+namespace cv
+{
+  /** Count the points of the keyframe on the given pyramid level that are visible in the frame
+   * after the transformation Rt (from the keyframe to the frame), and the inliers among them.
+   */
+  static void
+  countOverlap(const OdometryFrame& keyframe, const OdometryFrame& frame, const Matx44d& Rt,
+               const Matx33d& levelCameraMatrix, int level, double maxDepthDiff, int maxColorDiff,
+               int& keyframeCount, int& overlapCount, int& inliersCount)
+  {
+    const Mat& cloud0 = keyframe.pyramidCloud[level];
+    const Mat& mask0 = keyframe.pyramidMask[level];
+    const Mat& depth1 = frame.pyramidDepth[level];
+    const Mat& mask1 = frame.pyramidMask[level];
+
+    const bool useImages = (int)keyframe.pyramidImage.size() > level && !keyframe.pyramidImage[level].empty() &&
+                           (int)frame.pyramidImage.size() > level && !frame.pyramidImage[level].empty();
+
+    const double fx = levelCameraMatrix(0,0), fy = levelCameraMatrix(1,1),
+                 cx = levelCameraMatrix(0,2), cy = levelCameraMatrix(1,2);
+
+    keyframeCount = overlapCount = inliersCount = 0;
+    for(int v0 = 0; v0 < cloud0.rows; v0++)
+    {
+      const Point3f* cloud0_row = cloud0.ptr<Point3f>(v0);
+      const uchar* mask0_row = mask0.ptr<uchar>(v0);
+      const uchar* image0_row = useImages ? keyframe.pyramidImage[level].ptr<uchar>(v0) : 0;
+      for(int u0 = 0; u0 < cloud0.cols; u0++)
+      {
+        if(!mask0_row[u0])
+          continue;
+        keyframeCount++;
+
+        const Point3f& p0 = cloud0_row[u0];
+        const double x = Rt(0,0) * p0.x + Rt(0,1) * p0.y + Rt(0,2) * p0.z + Rt(0,3);
+        const double y = Rt(1,0) * p0.x + Rt(1,1) * p0.y + Rt(1,2) * p0.z + Rt(1,3);
+        const double z = Rt(2,0) * p0.x + Rt(2,1) * p0.y + Rt(2,2) * p0.z + Rt(2,3);
+        if(z <= 0)
+          continue;
+
+        const int u1 = cvRound(fx * x / z + cx), v1 = cvRound(fy * y / z + cy);
+        if((unsigned)u1 >= (unsigned)depth1.cols || (unsigned)v1 >= (unsigned)depth1.rows || !mask1.at<uchar>(v1,u1))
+          continue;
+        overlapCount++;
+
+        if(std::abs(depth1.at<float>(v1,u1) - z) > maxDepthDiff)
+          continue;
+        if(useImages && std::abs(static_cast<int>(image0_row[u0]) -
+                                 static_cast<int>(frame.pyramidImage[level].at<uchar>(v1,u1))) > maxColorDiff)
+          continue;
+        inliersCount++;
+      }
+    }
+  }
+
+  OdometryTracker::OdometryTracker() :
+    minInliersRatio(DEFAULT_MIN_INLIERS_RATIO()),
+    minKeyframeOverlap(DEFAULT_MIN_KEYFRAME_OVERLAP()),
+    minKeyframeInliersRatio(DEFAULT_MIN_KEYFRAME_INLIERS_RATIO()),
+    maxInlierDepthDiff(DEFAULT_MAX_INLIER_DEPTH_DIFF()),
+    maxInlierColorDiff(DEFAULT_MAX_INLIER_COLOR_DIFF()),
+    checkLevel(1),
+    keyframeSwitched(false)
+  {}
+
+  OdometryTracker::OdometryTracker(const Ptr<Odometry>& _odometry) :
+    odometry(_odometry),
+    minInliersRatio(DEFAULT_MIN_INLIERS_RATIO()),
+    minKeyframeOverlap(DEFAULT_MIN_KEYFRAME_OVERLAP()),
+    minKeyframeInliersRatio(DEFAULT_MIN_KEYFRAME_INLIERS_RATIO()),
+    maxInlierDepthDiff(DEFAULT_MAX_INLIER_DEPTH_DIFF()),
+    maxInlierColorDiff(DEFAULT_MAX_INLIER_COLOR_DIFF()),
+    checkLevel(1),
+    keyframeSwitched(false)
+  {}
+
+  bool
+  OdometryTracker::track(Ptr<OdometryFrame>& frame, Mat& pose)
+  {
+    CV_Assert(!odometry.empty());
+    CV_Assert(!frame.empty());
+    CV_Assert(checkLevel >= 0);
+
+    keyframeSwitched = false;
+    if(keyframe.empty())
+    {
+      odometry->prepareFrameCache(frame, OdometryFrame::CACHE_SRC);
+      keyframe = frame;
+      keyframePose = Mat::eye(4, 4, CV_64FC1);
+      lastRt = Mat::eye(4, 4, CV_64FC1);
+      keyframeSwitched = true;
+      keyframePose.copyTo(pose);
+      if(!motionModel.empty())
+        motionModel->reset();
+      return true;
+    }
+
+    // The model predicts the transformation from the frame to the last one, the initial transformation
+    // from the keyframe to the frame goes through the last frame
+    Mat initRt = lastRt;
+    if(!motionModel.empty())
+      initRt = motionModel->predict().inv(DECOMP_SVD) * lastRt;
+
+    Mat Rt;
+    if(!odometry->compute(keyframe, frame, Rt, initRt, workspace))
+    {
+      if(!motionModel.empty())
+        motionModel->reset();
+      return false;
+    }
+
+    // The pyramids of both frames are ready after compute, the check runs on one of their levels
+    const int level = std::min(checkLevel, static_cast<int>(keyframe->pyramidCloud.size()) - 1);
+    Mat cameraMatrix;
+    odometry->getMat("cameraMatrix").convertTo(cameraMatrix, CV_64FC1);
+    const double pyramidScale = odometry->getDouble("pyramidScale");
+    Matx33d levelCameraMatrix = cameraMatrix;
+    for(int i = 0; i < level; i++)
+      levelCameraMatrix = (1. / pyramidScale) * levelCameraMatrix;
+    levelCameraMatrix(2,2) = 1.;
+
+    int keyframeCount, overlapCount, inliersCount;
+    countOverlap(*keyframe, *frame, Matx44d(Rt), levelCameraMatrix, level, maxInlierDepthDiff, maxInlierColorDiff,
+                 keyframeCount, overlapCount, inliersCount);
+
+    const double overlap = keyframeCount ? static_cast<double>(overlapCount) / keyframeCount : 0.;
+    const double inliersRatio = overlapCount ? static_cast<double>(inliersCount) / overlapCount : 0.;
+    if(inliersRatio < minInliersRatio)
+    {
+      if(!motionModel.empty())
+        motionModel->reset();
+      return false;
+    }
+
+    pose = keyframePose * Rt.inv(DECOMP_SVD);
+    if(!motionModel.empty())
+      motionModel->update(lastRt * Rt.inv(DECOMP_SVD));
+    lastRt = Rt;
+
+    if(overlap < minKeyframeOverlap || inliersRatio < minKeyframeInliersRatio)
+    {
+      // Only the SRC levels that are missing are computed, the DST ones are reused
+      odometry->prepareFrameCache(frame, OdometryFrame::CACHE_SRC);
+      keyframe = frame;
+      pose.copyTo(keyframePose);
+      lastRt = Mat::eye(4, 4, CV_64FC1);
+      keyframeSwitched = true;
+    }
+
+    return true;
+  }
+
+  void
+  OdometryTracker::reset()
+  {
+    keyframe.release();
+    keyframePose.release();
+    lastRt.release();
+    keyframeSwitched = false;
+  }
+
+  Ptr<OdometryFrame>
+  OdometryTracker::getKeyframe() const
+  {
+    return keyframe;
+  }
+
+  Mat
+  OdometryTracker::getKeyframePose() const
+  {
+    return keyframePose;
+  }
+
+  bool
+  OdometryTracker::isKeyframeSwitched() const
+  {
+    return keyframeSwitched;
+  }
+}
@@ -71,7 +71,19 @@ namespace cv
       obj.info()->addParam(obj, "maxPointsPart", obj.maxPointsPart);
       obj.info()->addParam(obj, "transformType", obj.transformType);
       obj.info()->addParam(obj, "maxTranslation", obj.maxTranslation);
-      obj.info()->addParam(obj, "maxRotation", obj.maxRotation);)
+      obj.info()->addParam(obj, "maxRotation", obj.maxRotation);
+      obj.info()->addParam(obj, "minKsiNorm", obj.minKsiNorm);
+      obj.info()->addParam(obj, "minResidualChange", obj.minResidualChange);
+      obj.info()->addParam(obj, "robustKernel", obj.robustKernel);
+      obj.info()->addParam(obj, "floatAccumulation", obj.floatAccumulation);
+      obj.info()->addParam(obj, "maxDepthDiffs", obj.maxDepthDiffs);
+      obj.info()->addParam(obj, "sensorErrorA", obj.sensorErrorA);
+      obj.info()->addParam(obj, "sensorErrorB", obj.sensorErrorB);
+      obj.info()->addParam(obj, "pyramidScale", obj.pyramidScale);
+      obj.info()->addParam(obj, "depthDownsampling", obj.depthDownsampling);
+      obj.info()->addParam(obj, "sparse", obj.sparse);
+      obj.info()->addParam(obj, "inverseCompositional", obj.inverseCompositional);
+      obj.info()->addParam(obj, "bilinearSampling", obj.bilinearSampling);)
 
   CV_INIT_ALGORITHM(ICPOdometry, "RGBD.ICPOdometry",
       obj.info()->addParam(obj, "cameraMatrix", obj.cameraMatrix);
@@ -83,6 +95,15 @@ namespace cv
       obj.info()->addParam(obj, "transformType", obj.transformType);
       obj.info()->addParam(obj, "maxTranslation", obj.maxTranslation);
       obj.info()->addParam(obj, "maxRotation", obj.maxRotation);
+      obj.info()->addParam(obj, "minKsiNorm", obj.minKsiNorm);
+      obj.info()->addParam(obj, "minResidualChange", obj.minResidualChange);
+      obj.info()->addParam(obj, "robustKernel", obj.robustKernel);
+      obj.info()->addParam(obj, "floatAccumulation", obj.floatAccumulation);
+      obj.info()->addParam(obj, "maxDepthDiffs", obj.maxDepthDiffs);
+      obj.info()->addParam(obj, "sensorErrorA", obj.sensorErrorA);
+      obj.info()->addParam(obj, "sensorErrorB", obj.sensorErrorB);
+      obj.info()->addParam(obj, "pyramidScale", obj.pyramidScale);
+      obj.info()->addParam(obj, "depthDownsampling", obj.depthDownsampling);
       obj.info()->addParam(obj, "normalsComputer", obj.normalsComputer, true);)
 
   CV_INIT_ALGORITHM(RgbdICPOdometry, "RGBD.RgbdICPOdometry",
@@ -96,8 +117,30 @@ namespace cv
       obj.info()->addParam(obj, "transformType", obj.transformType);
       obj.info()->addParam(obj, "maxTranslation", obj.maxTranslation);
       obj.info()->addParam(obj, "maxRotation", obj.maxRotation);
+      obj.info()->addParam(obj, "minKsiNorm", obj.minKsiNorm);
+      obj.info()->addParam(obj, "minResidualChange", obj.minResidualChange);
+      obj.info()->addParam(obj, "robustKernel", obj.robustKernel);
+      obj.info()->addParam(obj, "floatAccumulation", obj.floatAccumulation);
+      obj.info()->addParam(obj, "maxDepthDiffs", obj.maxDepthDiffs);
+      obj.info()->addParam(obj, "sensorErrorA", obj.sensorErrorA);
+      obj.info()->addParam(obj, "sensorErrorB", obj.sensorErrorB);
+      obj.info()->addParam(obj, "pyramidScale", obj.pyramidScale);
+      obj.info()->addParam(obj, "depthDownsampling", obj.depthDownsampling);
       obj.info()->addParam(obj, "normalsComputer", obj.normalsComputer, true);)
 
+  CV_INIT_ALGORITHM(ConstantVelocityModel, "RGBD.ConstantVelocityModel",
+      obj.info()->addParam(obj, "velocity", obj.velocity, true);)
+
+  CV_INIT_ALGORITHM(OdometryTracker, "RGBD.OdometryTracker",
+      obj.info()->addParam(obj, "odometry", obj.odometry);
+      obj.info()->addParam(obj, "minInliersRatio", obj.minInliersRatio);
+      obj.info()->addParam(obj, "minKeyframeOverlap", obj.minKeyframeOverlap);
+      obj.info()->addParam(obj, "minKeyframeInliersRatio", obj.minKeyframeInliersRatio);
+      obj.info()->addParam(obj, "maxInlierDepthDiff", obj.maxInlierDepthDiff);
+      obj.info()->addParam(obj, "maxInlierColorDiff", obj.maxInlierColorDiff);
+      obj.info()->addParam(obj, "checkLevel", obj.checkLevel);
+      obj.info()->addParam(obj, "motionModel", obj.motionModel);)
+
   bool
   initModule_rgbd(void)
   {
@@ -107,6 +150,8 @@ namespace cv
     all &= !RgbdOdometry_info_auto.name().empty();
     all &= !ICPOdometry_info_auto.name().empty();
     all &= !RgbdICPOdometry_info_auto.name().empty();
+    all &= !ConstantVelocityModel_info_auto.name().empty();
+    all &= !OdometryTracker_info_auto.name().empty();
     return all;
   }
 }
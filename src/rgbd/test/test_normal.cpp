@@ -155,6 +155,18 @@ gen_points_3d(std::vector<Plane>& planes_out, cv::Mat_<unsigned char> &plane_mas
   normals = outn;
 }
 
+/** Gives access to the count of the normals data shared in the process
+ */
+class RgbdNormalsSharing: public cv::RgbdNormals
+{
+public:
+  static int
+  count()
+  {
+    return shared_impls_count();
+  }
+};
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 class CV_RgbdNormalsTest: public cvtest::BaseTest
@@ -173,7 +185,7 @@ protected:
     try
     {
       cv::Mat_<unsigned char> plane_mask;
-      for (unsigned char i = 0; i < 3; ++i)
+      for (unsigned char i = 0; i < 4; ++i)
       {
         cv::RgbdNormals::RGBD_NORMALS_METHOD method;
         // inner vector: whether it's 1 plane or 3 planes
@@ -207,6 +219,14 @@ protected:
             errors[1][0] = 0.02;
             errors[1][1] = 0.04;
             break;
+          case 3:
+            method = cv::RgbdNormals::RGBD_NORMALS_METHOD_INTEGRAL;
+            std::cout << std::endl << "*** INTEGRAL" << std::endl;
+            errors[0][0] = 0.001;
+            errors[0][1] = 0.05;
+            errors[1][0] = 0.001;
+            errors[1][1] = 0.05;
+            break;
         }
 
         for (unsigned char j = 0; j < 2; ++j)
@@ -233,6 +253,35 @@ protected:
           std::cout << "mean diff: " << (err_mean / 5) << std::endl;
           EXPECT_LE(err_mean/5, errors[j][0])<< " thresh: " << errors[j][0] << std::endl;
 
+          // Another computer with the same parameters shares the cached data, which has to outlive it
+          const int impls_count = RgbdNormalsSharing::count();
+          {
+            cv::RgbdNormals shared_computer(H, W, depth, K, 5, method);
+            shared_computer.initialize();
+            EXPECT_EQ(impls_count, RgbdNormalsSharing::count());
+
+            std::vector<cv::Mat> channels;
+            cv::split(points3d, channels);
+            cv::Mat normals, shared_normals;
+            normals_computer(channels[2], normals);
+            shared_computer(channels[2], shared_normals);
+            // the LINEMOD normals of the borders are NaN
+            const int margin = 8;
+            const cv::Rect interior(margin, margin, W - 2 * margin, H - 2 * margin);
+            EXPECT_EQ(0, cv::norm(normals(interior), shared_normals(interior), cv::NORM_INF));
+            if (method == cv::RgbdNormals::RGBD_NORMALS_METHOD_LINEMOD)
+              EXPECT_FALSE(cv::checkRange(normals.row(0)));
+          }
+          EXPECT_EQ(impls_count, RgbdNormalsSharing::count());
+
+          // The cached data of other parameters is released with its last user
+          {
+            cv::RgbdNormals other_computer(H, W, depth, K, 3, method);
+            other_computer.initialize();
+            EXPECT_EQ(impls_count + 1, RgbdNormalsSharing::count());
+          }
+          EXPECT_EQ(impls_count, RgbdNormalsSharing::count());
+
           // 3 discontinuities, more error expected.
           std::cout << "3 planes" << std::endl;
           err_mean = 0;
@@ -271,6 +320,16 @@ protected:
       normals_computer(points3d, in_normals);
     tm.stop();
 
+    // From the depth only, the points are never created but the normals have to be the same
+    if (normals_computer.method() != cv::RgbdNormals::RGBD_NORMALS_METHOD_LINEMOD)
+    {
+      std::vector<cv::Mat> channels;
+      cv::split(points3d, channels);
+      cv::Mat depth_normals;
+      normals_computer(channels[2], depth_normals);
+      EXPECT_LE(cv::norm(depth_normals, in_normals, cv::NORM_INF), 1e-2);
+    }
+
     cv::Mat_<cv::Vec3f> normals, ground_normals;
     in_normals.convertTo(normals, CV_32FC3);
     in_ground_normals.convertTo(ground_normals, CV_32FC3);
@@ -295,6 +354,41 @@ protected:
   }
 };
 
+/** The integral image method takes any odd window from 3, its cost does not depend on the size
+ */
+class CV_RgbdNormalsIntegralTest: public CV_RgbdNormalsTest
+{
+protected:
+  void
+  run(int)
+  {
+    const int large_window_size = 31;
+    cv::RgbdNormals normals_computer(H, W, CV_32F, K, large_window_size,
+                                     cv::RgbdNormals::RGBD_NORMALS_METHOD_INTEGRAL);
+    normals_computer.initialize();
+
+    // the integral image kept by the first computation is reused by the next ones
+    std::vector<Plane> plane_params;
+    cv::Mat_<unsigned char> plane_mask;
+    cv::Mat points3d, ground_normals;
+    float err_mean = 0;
+    for (int ii = 0; ii < 3; ++ii)
+    {
+      gen_points_3d(plane_params, plane_mask, points3d, ground_normals, 1);
+      err_mean += testit(points3d, ground_normals, normals_computer);
+    }
+    EXPECT_LE(err_mean / 3, 0.001);
+
+    const int invalid_window_sizes[] = { 1, 2, 4, 30 };
+    for (size_t i = 0; i < sizeof(invalid_window_sizes) / sizeof(invalid_window_sizes[0]); ++i)
+    {
+      cv::RgbdNormals invalid_computer(H, W, CV_32F, K, invalid_window_sizes[i],
+                                       cv::RgbdNormals::RGBD_NORMALS_METHOD_INTEGRAL);
+      EXPECT_THROW(invalid_computer.initialize(), cv::Exception);
+    }
+  }
+};
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 class CV_RgbdPlaneTest: public cvtest::BaseTest
@@ -405,6 +499,12 @@ TEST(Rgbd_Normals, compute)
   test.safe_run();
 }
 
+TEST(Rgbd_Normals, integralWindowSize)
+{
+  CV_RgbdNormalsIntegralTest test;
+  test.safe_run();
+}
+
 TEST(Rgbd_Plane, compute)
 {
   CV_RgbdPlaneTest test;
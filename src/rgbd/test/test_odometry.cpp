@@ -162,6 +162,17 @@ public:
 protected:
     bool readData(Mat& image, Mat& depth) const;
     static void generateRandomTransformation(Mat& R, Mat& t);
+
+    static Mat cameraMatrix();
+    // Reads the test frame and sets the camera matrix of the odometry (if any)
+    bool prepareData(Mat& K, Mat& image, Mat& depth);
+    // The frame warped by the given motion (or a random one) and dilated due to inaccuracy after warping
+    static void warpDilatedFrame(const Mat& image, const Mat& depth, const Mat& rvec, const Mat& tvec, const Mat& K,
+                                 Mat& warpedImage, Mat& warpedDepth);
+    static void generateWarpedFrame(const Mat& image, const Mat& depth, const Mat& K,
+                                    Mat& rvec, Mat& tvec, Mat& warpedImage, Mat& warpedDepth);
+    // Fails the test if less than a half of the poses are computed
+    bool checkComputedCount(int computedCount, int iterCount);
     
     virtual void run(int);
 
@@ -220,7 +231,7 @@ void CV_OdometryTest::generateRandomTransformation(Mat& rvec, Mat& tvec)
     normalize(tvec, tvec, rng.uniform(0.007f, maxTranslation));
 }
 
-void CV_OdometryTest::run(int)
+Mat CV_OdometryTest::cameraMatrix()
 {
     float fx = 525.0f, // default
           fy = 525.0f,
@@ -233,12 +244,50 @@ void CV_OdometryTest::run(int)
         K.at<float>(0,2) = cx;
         K.at<float>(1,2) = cy;
     }
-    
-    Mat image, depth;
+    return K;
+}
+
+bool CV_OdometryTest::prepareData(Mat& K, Mat& image, Mat& depth)
+{
+    K = cameraMatrix();
     if(!readData(image, depth))
+        return false;
+
+    if(!odometry.empty())
+        odometry->set("cameraMatrix", K);
+    return true;
+}
+
+void CV_OdometryTest::warpDilatedFrame(const Mat& image, const Mat& depth, const Mat& rvec, const Mat& tvec,
+                                       const Mat& K, Mat& warpedImage, Mat& warpedDepth)
+{
+    warpFrame(image, depth, rvec, tvec, K, warpedImage, warpedDepth);
+    dilateFrame(warpedImage, warpedDepth); // due to inaccuracy after warping
+}
+
+void CV_OdometryTest::generateWarpedFrame(const Mat& image, const Mat& depth, const Mat& K,
+                                          Mat& rvec, Mat& tvec, Mat& warpedImage, Mat& warpedDepth)
+{
+    generateRandomTransformation(rvec, tvec);
+    warpDilatedFrame(image, depth, rvec, tvec, K, warpedImage, warpedDepth);
+}
+
+bool CV_OdometryTest::checkComputedCount(int computedCount, int iterCount)
+{
+    if(computedCount < iterCount / 2)
+    {
+        ts->printf(cvtest::TS::LOG, "\nToo few computed poses: %d / %d", computedCount, iterCount);
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+        return false;
+    }
+    return true;
+}
+
+void CV_OdometryTest::run(int)
+{
+    Mat K, image, depth;
+    if(!prepareData(K, image, depth))
         return;
-        
-    odometry->set("cameraMatrix", K);
     
     Mat calcRt;
     
@@ -269,11 +318,8 @@ void CV_OdometryTest::run(int)
     int better_5times_count = 0;
     for(int iter = 0; iter < iterCount; iter++)
     {
-        Mat rvec, tvec;
-        generateRandomTransformation(rvec, tvec);
-        Mat warpedImage, warpedDepth;
-        warpFrame(image, depth, rvec, tvec, K, warpedImage, warpedDepth);
-        dilateFrame(warpedImage, warpedDepth); // due to inaccuracy after warping
+        Mat rvec, tvec, warpedImage, warpedDepth;
+        generateWarpedFrame(image, depth, K, rvec, tvec, warpedImage, warpedDepth);
         
         bool isComputed = odometry->compute(image, depth, Mat(), warpedImage, warpedDepth, Mat(), calcRt);
         if(!isComputed)
@@ -327,6 +373,646 @@ void CV_OdometryTest::run(int)
     }
 }
 
+/*
+ * The float accumulation of the normal equations has to give the poses of the double one
+ * up to the float rounding.
+ */
+class CV_OdometryFloatAccumulationTest : public CV_OdometryTest
+{
+public:
+    CV_OdometryFloatAccumulationTest(const Ptr<Odometry>& _odometry, double _maxRtDiff) :
+        CV_OdometryTest(_odometry, 0, 0),
+        maxRtDiff(_maxRtDiff) {}
+
+protected:
+    virtual void run(int);
+
+    double maxRtDiff;
+};
+
+void CV_OdometryFloatAccumulationTest::run(int)
+{
+    Mat K, image, depth;
+    if(!prepareData(K, image, depth))
+        return;
+
+    int iterCount = 20;
+    int comparedCount = 0;
+    double maxDiff = 0;
+    for(int iter = 0; iter < iterCount; iter++)
+    {
+        Mat rvec, tvec, warpedImage, warpedDepth;
+        generateWarpedFrame(image, depth, K, rvec, tvec, warpedImage, warpedDepth);
+
+        Mat doubleRt, floatRt;
+        odometry->set("floatAccumulation", false);
+        bool isDoubleComputed = odometry->compute(image, depth, Mat(), warpedImage, warpedDepth, Mat(), doubleRt);
+        odometry->set("floatAccumulation", true);
+        bool isFloatComputed = odometry->compute(image, depth, Mat(), warpedImage, warpedDepth, Mat(), floatRt);
+        if(!isDoubleComputed || !isFloatComputed)
+            continue;
+
+        comparedCount++;
+        maxDiff = std::max(maxDiff, norm(doubleRt, floatRt, NORM_INF));
+
+#if SHOW_DEBUG_LOG
+        std::cout << "Iter " << iter << "; diff " << norm(doubleRt, floatRt, NORM_INF) << std::endl;
+#endif
+    }
+
+    checkComputedCount(comparedCount, iterCount);
+
+    if(maxDiff > maxRtDiff)
+    {
+        ts->printf(cvtest::TS::LOG, "\nFloat and double accumulations give different poses: diff = %f", maxDiff);
+        ts->set_failed_test_info(cvtest::TS::FAIL_BAD_ACCURACY);
+    }
+}
+
+/*
+ * With a part of the destination frame replaced by outliers (a patch moved in depth and brightened, but within
+ * the correspondence gates), the robust kernel has to give more accurate poses than the ordinary least squares.
+ */
+class CV_OdometryRobustKernelTest : public CV_OdometryTest
+{
+public:
+    CV_OdometryRobustKernelTest(const Ptr<Odometry>& _odometry, int _robustKernel) :
+        CV_OdometryTest(_odometry, 0, 0),
+        robustKernel(_robustKernel) {}
+
+protected:
+    virtual void run(int);
+
+    int robustKernel;
+};
+
+void CV_OdometryRobustKernelTest::run(int)
+{
+    Mat K, image, depth;
+    if(!prepareData(K, image, depth))
+        return;
+
+    int iterCount = 10;
+    int comparedCount = 0;
+    double robustError = 0, leastSquaresError = 0;
+    for(int iter = 0; iter < iterCount; iter++)
+    {
+        Mat rvec, tvec, warpedImage, warpedDepth;
+        generateWarpedFrame(image, depth, K, rvec, tvec, warpedImage, warpedDepth);
+
+        // The outliers: a fifth of the frame is moved by 3 cm and brightened
+        Rect outliersRect(image.cols / 4, image.rows / 4, image.cols / 2, image.rows * 2 / 5);
+        Mat outliersDepth = warpedDepth(outliersRect), outliersImage = warpedImage(outliersRect);
+        outliersDepth += Scalar(0.03);
+        outliersImage += Scalar(40);
+
+        double errors[2];
+        bool isComputed = true;
+        for(int k = 0; k < 2; k++)
+        {
+            odometry->set("robustKernel", k == 0 ? robustKernel : static_cast<int>(Odometry::ROBUST_KERNEL_NONE));
+            Mat calcRt;
+            isComputed = isComputed &&
+                         odometry->compute(image, depth, Mat(), warpedImage, warpedDepth, Mat(), calcRt);
+            if(!isComputed)
+                break;
+
+            Mat calcRvec;
+            Rodrigues(calcRt(Rect(0,0,3,3)), calcRvec);
+            calcRvec = calcRvec.reshape(rvec.channels(), rvec.rows);
+            Mat calcTvec = calcRt(Rect(3,0,1,3));
+            errors[k] = norm(rvec - calcRvec) / norm(rvec) + norm(tvec - calcTvec) / norm(tvec);
+        }
+        if(!isComputed)
+            continue;
+
+        comparedCount++;
+        robustError += errors[0];
+        leastSquaresError += errors[1];
+
+#if SHOW_DEBUG_LOG
+        std::cout << "Iter " << iter << "; robust error " << errors[0] << "; L2 error " << errors[1] << std::endl;
+#endif
+    }
+
+    if(!checkComputedCount(comparedCount, iterCount))
+        return;
+
+    if(robustError >= leastSquaresError)
+    {
+        ts->printf(cvtest::TS::LOG, "\nThe robust kernel is not more accurate than L2 on the outliers: %f / %f",
+                   robustError / comparedCount, leastSquaresError / comparedCount);
+        ts->set_failed_test_info(cvtest::TS::FAIL_BAD_ACCURACY);
+    }
+}
+
+/*
+ * The stats of the computation have to be filled for all the pyramid levels.
+ */
+class CV_OdometryStatsTest : public CV_OdometryTest
+{
+public:
+    CV_OdometryStatsTest(const Ptr<Odometry>& _odometry) :
+        CV_OdometryTest(_odometry, 0, 0) {}
+
+protected:
+    virtual void run(int);
+};
+
+void CV_OdometryStatsTest::run(int)
+{
+    Mat K, image, depth;
+    if(!prepareData(K, image, depth))
+        return;
+
+    Mat rvec, tvec, warpedImage, warpedDepth;
+    generateWarpedFrame(image, depth, K, rvec, tvec, warpedImage, warpedDepth);
+
+    Ptr<OdometryFrame> srcFrame = new OdometryFrame(image, depth);
+    Ptr<OdometryFrame> dstFrame = new OdometryFrame(warpedImage, warpedDepth);
+    Mat Rt;
+    OdometryStats stats;
+    if(!odometry->compute(srcFrame, dstFrame, Rt, Mat(), &stats))
+    {
+        ts->printf(cvtest::TS::LOG, "\nOdometry is not computed");
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+        return;
+    }
+
+    const size_t levelCount = odometry->getMat("iterCounts").total();
+    if(stats.iterCounts.size() != levelCount || stats.correspsRgbdCounts.size() != levelCount ||
+       stats.correspsICPCounts.size() != levelCount || stats.rmsRgbd.size() != levelCount ||
+       stats.rmsICP.size() != levelCount || stats.correspsTimes.size() != levelCount ||
+       stats.solveTimes.size() != levelCount)
+    {
+        ts->printf(cvtest::TS::LOG, "\nIncorrect count of levels in the stats");
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+        return;
+    }
+
+    // The warped frame is not exactly the source one, so the residuals of the used terms are positive
+    if(stats.iterCounts[0] <= 0 || stats.correspsRgbdCounts[0] + stats.correspsICPCounts[0] <= 0 ||
+       (stats.correspsRgbdCounts[0] > 0 && !(cvIsNaN(stats.rmsRgbd[0]) == 0 && cvIsInf(stats.rmsRgbd[0]) == 0 &&
+                                            stats.rmsRgbd[0] > 0)) ||
+       (stats.correspsICPCounts[0] > 0 && !(cvIsNaN(stats.rmsICP[0]) == 0 && cvIsInf(stats.rmsICP[0]) == 0 &&
+                                           stats.rmsICP[0] > 0)))
+    {
+        ts->printf(cvtest::TS::LOG, "\nIncorrect correspondences or residuals of the finest level");
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+    }
+
+    if(stats.prepareTime <= 0 || stats.correspsTimes[0] <= 0 || stats.solveTimes[0] <= 0)
+    {
+        ts->printf(cvtest::TS::LOG, "\nIncorrect timings of the finest level");
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+    }
+
+    // The residual of the first iteration of the finest level: the same computation stopped after it
+    // (the coarser levels are the same). The iterations must not increase it.
+    {
+        Mat iterCounts = odometry->getMat("iterCounts").clone(), firstIterCounts = iterCounts.clone();
+        firstIterCounts.at<int>(0) = 1;
+        odometry->set("iterCounts", firstIterCounts);
+        Ptr<OdometryFrame> firstSrcFrame = new OdometryFrame(image, depth);
+        Ptr<OdometryFrame> firstDstFrame = new OdometryFrame(warpedImage, warpedDepth);
+        Mat firstRt;
+        OdometryStats firstStats;
+        bool isFirstComputed = odometry->compute(firstSrcFrame, firstDstFrame, firstRt, Mat(), &firstStats);
+        odometry->set("iterCounts", iterCounts);
+
+        const double eps = 1e-6;
+        if(!isFirstComputed || firstStats.iterCounts[0] != 1 ||
+           stats.rmsRgbd[0] > firstStats.rmsRgbd[0] * (1 + eps) || stats.rmsICP[0] > firstStats.rmsICP[0] * (1 + eps))
+        {
+            ts->printf(cvtest::TS::LOG, "\nThe residuals increase from the first iteration to the last one:"
+                       " RGB-D %f -> %f, ICP %f -> %f", firstStats.rmsRgbd[0], stats.rmsRgbd[0],
+                       firstStats.rmsICP[0], stats.rmsICP[0]);
+            ts->set_failed_test_info(cvtest::TS::FAIL_BAD_ACCURACY);
+        }
+    }
+
+    if(stats.hessian.size() != Size(6,6) || stats.hessian.type() != CV_64FC1 ||
+       norm(stats.hessian, stats.hessian.t()) > 1e-6 * norm(stats.hessian))
+    {
+        ts->printf(cvtest::TS::LOG, "\nIncorrect Hessian in the stats");
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+    }
+
+    // The information matrix has to be positive definite
+    Mat eigenvalues;
+    if(stats.information.size() != Size(6,6) || !eigen(stats.information, eigenvalues) ||
+       eigenvalues.at<double>(5) <= 0)
+    {
+        ts->printf(cvtest::TS::LOG, "\nIncorrect information matrix in the stats");
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+    }
+}
+
+/*
+ * The convergence criteria have to stop the iterations earlier than the fixed iteration counts
+ * while keeping the poses accurate.
+ */
+class CV_OdometryConvergenceTest : public CV_OdometryTest
+{
+public:
+    CV_OdometryConvergenceTest(const Ptr<Odometry>& _odometry, double _minKsiNorm, double _minResidualChange,
+                               double _maxError1) :
+        CV_OdometryTest(_odometry, _maxError1, 0),
+        minKsiNorm(_minKsiNorm),
+        minResidualChange(_minResidualChange) {}
+
+protected:
+    virtual void run(int);
+
+    double minKsiNorm, minResidualChange;
+};
+
+void CV_OdometryConvergenceTest::run(int)
+{
+    Mat K, image, depth;
+    if(!prepareData(K, image, depth))
+        return;
+
+    int iterCount = 20;
+    int comparedCount = 0, accurateCount = 0;
+    int fullIterations = 0, stoppedIterations = 0;
+    for(int iter = 0; iter < iterCount; iter++)
+    {
+        Mat rvec, tvec, warpedImage, warpedDepth;
+        generateWarpedFrame(image, depth, K, rvec, tvec, warpedImage, warpedDepth);
+
+        // The same frames are used by both computations, their caches are prepared by the first one
+        Ptr<OdometryFrame> srcFrame = new OdometryFrame(image, depth);
+        Ptr<OdometryFrame> dstFrame = new OdometryFrame(warpedImage, warpedDepth);
+
+        Mat fullRt, stoppedRt;
+        OdometryStats fullStats, stoppedStats;
+        odometry->set("minKsiNorm", 0.);
+        odometry->set("minResidualChange", 0.);
+        bool isFullComputed = odometry->compute(srcFrame, dstFrame, fullRt, Mat(), &fullStats);
+        odometry->set("minKsiNorm", minKsiNorm);
+        odometry->set("minResidualChange", minResidualChange);
+        bool isStoppedComputed = odometry->compute(srcFrame, dstFrame, stoppedRt, Mat(), &stoppedStats);
+        if(!isFullComputed || !isStoppedComputed)
+            continue;
+
+        comparedCount++;
+        for(size_t level = 0; level < fullStats.iterCounts.size(); level++)
+            fullIterations += fullStats.iterCounts[level];
+        for(size_t level = 0; level < stoppedStats.iterCounts.size(); level++)
+            stoppedIterations += stoppedStats.iterCounts[level];
+
+        Mat calcRvec;
+        Rodrigues(stoppedRt(Rect(0,0,3,3)), calcRvec);
+        calcRvec = calcRvec.reshape(rvec.channels(), rvec.rows);
+        Mat calcTvec = stoppedRt(Rect(3,0,1,3));
+        if(norm(rvec - calcRvec) < norm(rvec) && norm(tvec - calcTvec) < norm(tvec))
+            accurateCount++;
+
+#if SHOW_DEBUG_LOG
+        std::cout << "Iter " << iter << "; diff " << norm(fullRt, stoppedRt, NORM_INF) << std::endl;
+#endif
+    }
+
+    if(!checkComputedCount(comparedCount, iterCount))
+        return;
+
+    if(stoppedIterations >= fullIterations)
+    {
+        ts->printf(cvtest::TS::LOG, "\nThe convergence criteria do not stop the iterations: %d / %d",
+                   stoppedIterations, fullIterations);
+        ts->set_failed_test_info(cvtest::TS::FAIL_BAD_ACCURACY);
+    }
+
+    if(static_cast<double>(accurateCount) < maxError1 * static_cast<double>(comparedCount))
+    {
+        ts->printf(cvtest::TS::LOG, "\nIncorrect count of accurate poses with the convergence criteria: %d / %d",
+                   accurateCount, comparedCount);
+        ts->set_failed_test_info(cvtest::TS::FAIL_BAD_ACCURACY);
+    }
+}
+
+/*
+ * The tracker has to give the poses of the frames warped by the growing motion
+ * relative to the first frame (the keyframe).
+ */
+class CV_OdometryTrackerTest : public CV_OdometryTest
+{
+public:
+    CV_OdometryTrackerTest(const Ptr<Odometry>& _odometry, double _maxTranslationError, double _maxRotationError,
+                           const Ptr<MotionModel>& _motionModel = Ptr<MotionModel>()) :
+        CV_OdometryTest(_odometry, 0, 0),
+        maxTranslationError(_maxTranslationError),
+        maxRotationError(_maxRotationError),
+        motionModel(_motionModel) {}
+
+protected:
+    virtual void run(int);
+
+    double maxTranslationError;
+    double maxRotationError;
+    Ptr<MotionModel> motionModel;
+};
+
+void CV_OdometryTrackerTest::run(int)
+{
+    Mat K, image, depth;
+    if(!prepareData(K, image, depth))
+        return;
+    OdometryTracker tracker(odometry);
+    if(!motionModel.empty())
+        tracker.setAlgorithm("motionModel", motionModel);
+
+    Mat pose;
+    Ptr<OdometryFrame> firstFrame = new OdometryFrame(image, depth);
+    if(!tracker.track(firstFrame, pose) || !tracker.isKeyframeSwitched() ||
+       norm(pose, Mat::eye(4,4,CV_64FC1)) > DBL_EPSILON)
+    {
+        ts->printf(cvtest::TS::LOG, "\nThe first frame has to become the keyframe with the identity pose");
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+        return;
+    }
+
+    Mat rvecStep, tvecStep;
+    generateRandomTransformation(rvecStep, tvecStep);
+    rvecStep *= 0.5;
+    tvecStep *= 0.5;
+
+    int framesCount = 5;
+    for(int i = 1; i <= framesCount; i++)
+    {
+        Mat rvec = rvecStep * i, tvec = tvecStep * i;
+        Mat warpedImage, warpedDepth;
+        warpDilatedFrame(image, depth, rvec, tvec, K, warpedImage, warpedDepth);
+
+        Ptr<OdometryFrame> frame = new OdometryFrame(warpedImage, warpedDepth);
+        if(!tracker.track(frame, pose))
+        {
+            ts->printf(cvtest::TS::LOG, "\nThe frame %d is not tracked", i);
+            ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+            return;
+        }
+
+        // The pose is the inverse of the applied motion
+        Mat R;
+        Rodrigues(rvec, R);
+        Mat Rt = Mat::eye(4,4,CV_64FC1);
+        R.copyTo(Rt(Rect(0,0,3,3)));
+        tvec.copyTo(Rt(Rect(3,0,1,3)));
+        Mat diffRt = pose * Rt, diffRvec;
+        Rodrigues(diffRt(Rect(0,0,3,3)), diffRvec);
+
+        double translationError = norm(diffRt(Rect(3,0,1,3))),
+               rotationError = norm(diffRvec);
+        if(translationError > maxTranslationError || rotationError > maxRotationError)
+        {
+            ts->printf(cvtest::TS::LOG, "\nIncorrect pose of the frame %d: translation error %f, rotation error %f",
+                       i, translationError, rotationError);
+            ts->set_failed_test_info(cvtest::TS::FAIL_BAD_ACCURACY);
+        }
+    }
+}
+
+/*
+ * The batch compute has to give the results of the pair by pair one. The frames of a chain are shared
+ * by the neighbouring pairs and are unmasked, so the workers have to only read them.
+ */
+class CV_OdometryBatchTest : public CV_OdometryTest
+{
+public:
+    CV_OdometryBatchTest(const Ptr<Odometry>& _odometry) :
+        CV_OdometryTest(_odometry, 0, 0) {}
+
+protected:
+    virtual void run(int);
+};
+
+void CV_OdometryBatchTest::run(int)
+{
+    Mat K, image, depth;
+    if(!prepareData(K, image, depth))
+        return;
+
+    Mat rvecStep, tvecStep;
+    generateRandomTransformation(rvecStep, tvecStep);
+    rvecStep *= 0.5;
+    tvecStep *= 0.5;
+
+    const int framesCount = 6;
+    vector<Mat> images(framesCount), depths(framesCount);
+    vector<Ptr<OdometryFrame> > frames(framesCount);
+    images[0] = image;
+    depths[0] = depth;
+    for(int i = 1; i < framesCount; i++)
+    {
+        warpDilatedFrame(image, depth, rvecStep * i, tvecStep * i, K, images[i], depths[i]);
+    }
+    for(int i = 0; i < framesCount; i++)
+        frames[i] = new OdometryFrame(images[i], depths[i]);
+
+    vector<OdometryFramePair> pairs;
+    for(int i = 1; i < framesCount; i++)
+        pairs.push_back(OdometryFramePair(frames[i], frames[i-1]));
+
+    vector<Mat> Rts;
+    vector<uchar> isOk;
+    vector<OdometryWorkspace> workspaces;
+    const int threadsCount = getNumThreads();
+    setNumThreads(4);
+    int computedCount = odometry->compute(pairs, Rts, isOk, workspaces);
+    setNumThreads(threadsCount);
+
+    if(Rts.size() != pairs.size() || isOk.size() != pairs.size() || computedCount != countNonZero(Mat(isOk)))
+    {
+        ts->printf(cvtest::TS::LOG, "\nIncorrect sizes or count of the batch results");
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+        return;
+    }
+    checkComputedCount(computedCount, static_cast<int>(pairs.size()));
+
+    for(size_t i = 0; i < pairs.size(); i++)
+    {
+        Ptr<OdometryFrame> srcFrame = new OdometryFrame(images[i+1], depths[i+1]);
+        Ptr<OdometryFrame> dstFrame = new OdometryFrame(images[i], depths[i]);
+        Mat Rt;
+        bool isComputed = odometry->compute(srcFrame, dstFrame, Rt);
+        if(isComputed != (isOk[i] != 0) || (isComputed && norm(Rt, Rts[i], NORM_INF) > 1e-9))
+        {
+            ts->printf(cvtest::TS::LOG, "\nThe batch result of the pair %d differs from its compute()", static_cast<int>(i));
+            ts->set_failed_test_info(cvtest::TS::FAIL_BAD_ACCURACY);
+        }
+    }
+
+    // No pairs
+    vector<OdometryFramePair> noPairs;
+    if(odometry->compute(noPairs, Rts, isOk, workspaces) != 0 || !Rts.empty() || !isOk.empty())
+    {
+        ts->printf(cvtest::TS::LOG, "\nThe batch compute of no pairs has to give no results");
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+    }
+
+    // A null frame is an error
+    pairs.push_back(OdometryFramePair(frames[0], Ptr<OdometryFrame>()));
+    bool isThrown = false;
+    try
+    {
+        odometry->compute(pairs, Rts, isOk, workspaces);
+    }
+    catch(const cv::Exception&)
+    {
+        isThrown = true;
+    }
+    if(!isThrown)
+    {
+        ts->printf(cvtest::TS::LOG, "\nThe batch compute accepts a null frame");
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+    }
+}
+
+/*
+ * The constant velocity model has to predict the last update: its logarithm and exponent of SE(3)
+ * are inverse to each other, for small and large rotations.
+ */
+class CV_ConstantVelocityModelTest : public cvtest::BaseTest
+{
+protected:
+    virtual void run(int);
+
+    static Mat rigidTransformation(const Vec3d& rvec, const Vec3d& tvec);
+};
+
+Mat CV_ConstantVelocityModelTest::rigidTransformation(const Vec3d& rvec, const Vec3d& tvec)
+{
+    Mat Rt = Mat::eye(4,4,CV_64FC1), R;
+    Rodrigues(Mat(rvec), R);
+    R.copyTo(Rt(Rect(0,0,3,3)));
+    Mat(tvec).copyTo(Rt(Rect(3,0,1,3)));
+    return Rt;
+}
+
+void CV_ConstantVelocityModelTest::run(int)
+{
+    ConstantVelocityModel model;
+    if(norm(model.predict(), Mat::eye(4,4,CV_64FC1)) > DBL_EPSILON)
+    {
+        ts->printf(cvtest::TS::LOG, "\nThe prediction without the motion history has to be the identity");
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+    }
+
+    // 1. The prediction after one update is exp(log(Rt)) = Rt, the rotation angles go from the small angle
+    // approximations of the Jacobians to near pi
+    RNG& rng = theRNG();
+    const double angles[] = {0, 1e-8, 1e-3, 0.1, 1., 2.5, 3.};
+    for(size_t i = 0; i < sizeof(angles) / sizeof(angles[0]); i++)
+    {
+        Vec3d rvec(rng.uniform(-1., 1.), rng.uniform(-1., 1.), rng.uniform(-1., 1.));
+        rvec *= angles[i] / norm(rvec);
+        Vec3d tvec(rng.uniform(-1., 1.), rng.uniform(-1., 1.), rng.uniform(-1., 1.));
+        Mat Rt = rigidTransformation(rvec, tvec);
+
+        model.update(Rt);
+        double diff = norm(model.predict(), Rt, NORM_INF);
+        if(diff > 1e-9)
+        {
+            ts->printf(cvtest::TS::LOG, "\nexp(log(Rt)) differs from Rt by %g for the angle %g", diff, angles[i]);
+            ts->set_failed_test_info(cvtest::TS::FAIL_BAD_ACCURACY);
+        }
+
+        // Half of the time gives the half of the motion
+        Mat halfRt = model.predict(0.5);
+        diff = norm(halfRt * halfRt, Rt, NORM_INF);
+        if(diff > 1e-9)
+        {
+            ts->printf(cvtest::TS::LOG, "\nThe half time prediction is not the half motion (diff %g)", diff);
+            ts->set_failed_test_info(cvtest::TS::FAIL_BAD_ACCURACY);
+        }
+    }
+
+    // 2. The increments of the motion with a constant velocity are predicted
+    model.reset();
+    Mat increment = rigidTransformation(Vec3d(0.01, -0.02, 0.015), Vec3d(0.005, 0.01, -0.02));
+    Mat pose = Mat::eye(4,4,CV_64FC1), prevPose;
+    for(int i = 0; i < 2; i++)
+    {
+        prevPose = pose;
+        pose = increment * pose;
+        model.update(pose * prevPose.inv());
+    }
+    double diff = norm(model.predict(), increment, NORM_INF);
+    if(diff > 1e-9)
+    {
+        ts->printf(cvtest::TS::LOG, "\nThe prediction differs from the constant increment by %g", diff);
+        ts->set_failed_test_info(cvtest::TS::FAIL_BAD_ACCURACY);
+    }
+
+    model.reset();
+    if(norm(model.predict(), Mat::eye(4,4,CV_64FC1)) > DBL_EPSILON)
+    {
+        ts->printf(cvtest::TS::LOG, "\nThe prediction after reset has to be the identity");
+        ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+    }
+}
+
+/*
+ * FrameWarper has to give the warp of warpFrame (up to the rounding of the projections)
+ * and to reuse its outputs for the next frames.
+ */
+class CV_FrameWarperTest : public CV_OdometryTest
+{
+public:
+    CV_FrameWarperTest() :
+        CV_OdometryTest(Ptr<Odometry>(), 0, 0) {}
+
+protected:
+    virtual void run(int);
+};
+
+void CV_FrameWarperTest::run(int)
+{
+    Mat K, image, depth;
+    if(!prepareData(K, image, depth))
+        return;
+
+    FrameWarper warper(K, image.size());
+    Mat warpedImage, warpedDepth, warpedMask;
+    for(int i = 0; i < 3; i++)
+    {
+        Mat rvec, tvec;
+        generateRandomTransformation(rvec, tvec);
+        Mat R;
+        Rodrigues(rvec, R);
+        Mat Rt = Mat::eye(4,4,CV_64FC1);
+        R.copyTo(Rt(Rect(0,0,3,3)));
+        tvec.copyTo(Rt(Rect(3,0,1,3)));
+
+        Mat mask = (image > 30);
+
+        Mat gtImage, gtDepth, gtMask;
+        cv::warpFrame(image, depth, mask, Rt, K, Mat(), gtImage, &gtDepth, &gtMask);
+
+        const uchar* warpedDepthData = warpedDepth.data;
+        warper.warp(image, depth, mask, Rt, warpedImage, warpedDepth, warpedMask);
+        if(i > 0 && warpedDepth.data != warpedDepthData)
+        {
+            ts->printf(cvtest::TS::LOG, "\nThe output depth is reallocated");
+            ts->set_failed_test_info(cvtest::TS::FAIL_INVALID_OUTPUT);
+        }
+
+        // The rays and the projection are computed with different roundings, so few border pixels can differ
+        const int maxDiffsCount = static_cast<int>(image.total()) / 1000;
+        Mat sameMask = (gtMask == warpedMask) & (gtImage == warpedImage);
+        Mat depthDiff = abs(gtDepth - warpedDepth);
+        int diffsCount = static_cast<int>(image.total()) - countNonZero(sameMask) +
+                         countNonZero((depthDiff > 1e-4) & gtMask & warpedMask);
+        if(diffsCount > maxDiffsCount || countNonZero(warpedMask) == 0)
+        {
+            ts->printf(cvtest::TS::LOG, "\nIncorrect warp, %d pixels are different", diffsCount);
+            ts->set_failed_test_info(cvtest::TS::FAIL_BAD_ACCURACY);
+            return;
+        }
+    }
+}
+
 /****************************************************************************************\
 *                                Tests registrations                                     *
 \****************************************************************************************/
@@ -337,6 +1023,30 @@ TEST(RGBD_Odometry_Rgbd, algorithmic)
     test.safe_run();
 }
 
+TEST(RGBD_Odometry_Rgbd, sparse)
+{
+    Ptr<Odometry> odometry = Algorithm::create<Odometry>("RGBD.RgbdOdometry");
+    odometry->set("sparse", true);
+    CV_OdometryTest test(odometry, 0.99, 0.94);
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_Rgbd, inverseCompositional)
+{
+    Ptr<Odometry> odometry = Algorithm::create<Odometry>("RGBD.RgbdOdometry");
+    odometry->set("inverseCompositional", true);
+    CV_OdometryTest test(odometry, 0.99, 0.94);
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_Rgbd, bilinearSampling)
+{
+    Ptr<Odometry> odometry = Algorithm::create<Odometry>("RGBD.RgbdOdometry");
+    odometry->set("bilinearSampling", true);
+    CV_OdometryTest test(odometry, 0.99, 0.94);
+    test.safe_run();
+}
+
 TEST(RGBD_Odometry_ICP, algorithmic)
 {
     CV_OdometryTest test(Algorithm::create<Odometry>("RGBD.ICPOdometry"), 0.99, 0.99);
@@ -348,3 +1058,171 @@ TEST(RGBD_Odometry_RgbdICP, algorithmic)
     CV_OdometryTest test(Algorithm::create<Odometry>("RGBD.RgbdICPOdometry"), 0.99, 0.99);
     test.safe_run();
 }
+
+TEST(RGBD_Odometry_RgbdICP, convergenceCriteria)
+{
+    Ptr<Odometry> odometry = Algorithm::create<Odometry>("RGBD.RgbdICPOdometry");
+    odometry->set("minKsiNorm", 1e-6);
+    odometry->set("minResidualChange", 1e-3);
+    CV_OdometryTest test(odometry, 0.99, 0.99);
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_RgbdICP, convergenceCriteriaStopEarly)
+{
+    CV_OdometryConvergenceTest test(Algorithm::create<Odometry>("RGBD.RgbdICPOdometry"), 1e-6, 1e-3, 0.95);
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_RgbdICP, depthDiffGate)
+{
+    Ptr<Odometry> odometry = Algorithm::create<Odometry>("RGBD.RgbdICPOdometry");
+    odometry->set("maxDepthDiffs", Mat(Vec4f(0.05f, 0.07f, 0.1f, 0.15f)));
+    odometry->set("sensorErrorA", 0.0075);
+    CV_OdometryTest test(odometry, 0.99, 0.99);
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_Rgbd, pyramidScale)
+{
+    Ptr<Odometry> odometry = Algorithm::create<Odometry>("RGBD.RgbdOdometry");
+    odometry->set("pyramidScale", 1.5);
+    odometry->set("iterCounts", Mat(Vec<int,6>(3,5,7,7,7,10)));
+    odometry->set("minGradientMagnitudes", Mat(Vec<float,6>(10,10,10,10,10,10)));
+    CV_OdometryTest test(odometry, 0.99, 0.94);
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_RgbdICP, depthDownsampling)
+{
+    Ptr<Odometry> odometry = Algorithm::create<Odometry>("RGBD.RgbdICPOdometry");
+    odometry->set("depthDownsampling", Odometry::DEPTH_DOWNSAMPLING_MEDIAN);
+    CV_OdometryTest test(odometry, 0.99, 0.99);
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_RgbdICP, robustKernel)
+{
+    Ptr<Odometry> odometry = Algorithm::create<Odometry>("RGBD.RgbdICPOdometry");
+    odometry->set("robustKernel", Odometry::ROBUST_KERNEL_HUBER);
+    CV_OdometryTest test(odometry, 0.99, 0.99);
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_RgbdICP, robustKernelTukey)
+{
+    Ptr<Odometry> odometry = Algorithm::create<Odometry>("RGBD.RgbdICPOdometry");
+    odometry->set("robustKernel", Odometry::ROBUST_KERNEL_TUKEY);
+    CV_OdometryTest test(odometry, 0.99, 0.99);
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_RgbdICP, robustKernelCauchy)
+{
+    Ptr<Odometry> odometry = Algorithm::create<Odometry>("RGBD.RgbdICPOdometry");
+    odometry->set("robustKernel", Odometry::ROBUST_KERNEL_CAUCHY);
+    CV_OdometryTest test(odometry, 0.99, 0.99);
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_RgbdICP, robustKernelNone)
+{
+    Ptr<Odometry> odometry = Algorithm::create<Odometry>("RGBD.RgbdICPOdometry");
+    odometry->set("robustKernel", Odometry::ROBUST_KERNEL_NONE);
+    CV_OdometryTest test(odometry, 0.95, 0.9);
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_RgbdICP, robustKernelOutliers)
+{
+    const int kernels[] = {Odometry::ROBUST_KERNEL_SIGMA, Odometry::ROBUST_KERNEL_HUBER,
+                           Odometry::ROBUST_KERNEL_TUKEY, Odometry::ROBUST_KERNEL_CAUCHY};
+    for(size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+    {
+        CV_OdometryRobustKernelTest test(Algorithm::create<Odometry>("RGBD.RgbdICPOdometry"), kernels[i]);
+        test.safe_run();
+    }
+}
+
+TEST(RGBD_Odometry_RgbdICP, robustKernelRange)
+{
+    Ptr<Odometry> odometry = Algorithm::create<Odometry>("RGBD.RgbdICPOdometry");
+    odometry->set("cameraMatrix", Mat::eye(3,3,CV_32FC1));
+    odometry->set("robustKernel", Odometry::ROBUST_KERNEL_CAUCHY + 1);
+    Ptr<OdometryFrame> frame = new OdometryFrame(Mat(8, 8, CV_8UC1, Scalar(0)), Mat(8, 8, CV_32FC1, Scalar(1)));
+    Mat Rt;
+    EXPECT_THROW(odometry->compute(frame, frame, Rt), cv::Exception);
+}
+
+TEST(RGBD_Odometry_Rgbd, floatAccumulation)
+{
+    CV_OdometryFloatAccumulationTest test(Algorithm::create<Odometry>("RGBD.RgbdOdometry"), 1e-3);
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_ICP, floatAccumulation)
+{
+    CV_OdometryFloatAccumulationTest test(Algorithm::create<Odometry>("RGBD.ICPOdometry"), 1e-3);
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_RgbdICP, floatAccumulation)
+{
+    CV_OdometryFloatAccumulationTest test(Algorithm::create<Odometry>("RGBD.RgbdICPOdometry"), 1e-3);
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_Rgbd, tracker)
+{
+    CV_OdometryTrackerTest test(Algorithm::create<Odometry>("RGBD.RgbdOdometry"), 0.01, 0.01);
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_RgbdICP, tracker)
+{
+    CV_OdometryTrackerTest test(Algorithm::create<Odometry>("RGBD.RgbdICPOdometry"), 0.01, 0.01);
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_RgbdICP, trackerMotionModel)
+{
+    CV_OdometryTrackerTest test(Algorithm::create<Odometry>("RGBD.RgbdICPOdometry"), 0.01, 0.01,
+                                new ConstantVelocityModel());
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_Rgbd, batch)
+{
+    CV_OdometryBatchTest test(Algorithm::create<Odometry>("RGBD.RgbdOdometry"));
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_RgbdICP, batch)
+{
+    CV_OdometryBatchTest test(Algorithm::create<Odometry>("RGBD.RgbdICPOdometry"));
+    test.safe_run();
+}
+
+TEST(RGBD_MotionModel, constantVelocity)
+{
+    CV_ConstantVelocityModelTest test;
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_Rgbd, stats)
+{
+    CV_OdometryStatsTest test(Algorithm::create<Odometry>("RGBD.RgbdOdometry"));
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry_RgbdICP, stats)
+{
+    CV_OdometryStatsTest test(Algorithm::create<Odometry>("RGBD.RgbdICPOdometry"));
+    test.safe_run();
+}
+
+TEST(RGBD_Odometry, frameWarper)
+{
+    CV_FrameWarperTest test;
+    test.safe_run();
+}